@@ -0,0 +1,429 @@
+#include <stdint.h>
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <third_party/libyuv/include/libyuv/convert.h>
+#include <third_party/libyuv/include/libyuv/convert_from_argb.h>
+#include <WebRTCStreamer.h>
+#include <internal/ConcurrentQueue.h>
+#include <internal/CustomOpenCVCapturer.h>
+#include <internal/SignalingMessage.h>
+#include <internal/StripePool.h>
+#include <internal/Bgr24Converter.h>
+#include <internal/videorenderer.h>
+#include <internal/StreamContext.h>
+
+// Micro benchmarks of the per-frame path, each one run from VGA to 4K:
+//   queue contention, WebRTCStreamer::Send, CustomOpenCVCapturer conversion,
+//   VideoRenderer::OnFrame, and the signaling JSON encoding.
+
+static void Resolutions(benchmark::internal::Benchmark* bench)
+{
+	bench->Args({ 640, 480, 1 });
+	bench->Args({ 1280, 720, 1 });
+	bench->Args({ 1920, 1080, 1 });
+	bench->Args({ 3840, 2160, 1 });
+}
+
+static cv::Mat MakeFrame(int width, int height, int type)
+{
+	cv::Mat frame(height, width, type);
+	cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+	return frame;
+}
+
+static void SetFrameCounters(benchmark::State& state, size_t bytesPerFrame)
+{
+	state.SetItemsProcessed(state.iterations());
+	state.SetBytesProcessed(state.iterations() * bytesPerFrame);
+}
+
+/* ---------------------------------------------------------------------------
+**  ConcurrentQueue<cv::Mat>: thread 0 produces, the others consume
+** -------------------------------------------------------------------------*/
+static void BM_ConcurrentQueuePushPop(benchmark::State& state)
+{
+	static core::queue::ConcurrentQueue<cv::Mat> queue;
+	static cv::Mat frame;
+	if (state.thread_index == 0)
+	{
+		queue.clear();
+		frame = MakeFrame(state.range(0), state.range(1), CV_8UC3);
+	}
+
+	for (auto _ : state)
+	{
+		if (state.thread_index == 0)
+		{
+			queue.clear();
+			queue.push(frame);
+		}
+		else
+		{
+			cv::Mat popped;
+			benchmark::DoNotOptimize(queue.try_pop(popped));
+		}
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ConcurrentQueuePushPop)->Apply(Resolutions)->ThreadRange(2, 8)->UseRealTime();
+
+/* ---------------------------------------------------------------------------
+**  WebRTCStreamer::Send, the server does not need to be started but Send is
+**  a no-op without viewers: one is faked (1), or not (0)
+** -------------------------------------------------------------------------*/
+class BenchStreamer : public WebRTCStreamer
+{
+public:
+	BenchStreamer(int viewers) : WebRTCStreamer(0, ".") { subscribersChanged(viewers); }
+};
+
+static void BM_StreamerSend(benchmark::State& state)
+{
+	BenchStreamer streamer(state.range(2));
+	cv::Mat frame = MakeFrame(state.range(0), state.range(1), CV_8UC3);
+
+	for (auto _ : state)
+	{
+		streamer.Send(frame);
+	}
+	SetFrameCounters(state, frame.total() * frame.elemSize());
+}
+BENCHMARK(BM_StreamerSend)->Apply(Resolutions)->Args({ 1920, 1080, 0 });
+
+static void BM_StreamerSendShared(benchmark::State& state)
+{
+	BenchStreamer streamer(state.range(2));
+	cv::Mat frame = MakeFrame(state.range(0), state.range(1), CV_8UC3);
+
+	for (auto _ : state)
+	{
+		streamer.SendShared(frame);
+	}
+	SetFrameCounters(state, frame.total() * frame.elemSize());
+}
+BENCHMARK(BM_StreamerSendShared)->Apply(Resolutions);
+
+// sub-rectangle of a 4K camera frame, queued as is and converted through its step
+static void BM_StreamerSendRoi(benchmark::State& state)
+{
+	BenchStreamer streamer(1);
+	cv::Mat camera = MakeFrame(3840, 2160, CV_8UC3);
+	cv::Mat frame = camera(cv::Rect(960, 540, state.range(0), state.range(1)));
+
+	for (auto _ : state)
+	{
+		streamer.SendShared(frame);
+		rtc::scoped_refptr<webrtc::I420Buffer> buffer = CustomOpenCVCapturer::ConvertToI420(frame);
+		benchmark::DoNotOptimize(buffer.get());
+	}
+	SetFrameCounters(state, frame.total() * frame.elemSize());
+}
+BENCHMARK(BM_StreamerSendRoi)->Args({ 1280, 720 })->Args({ 1920, 1080 });
+
+/* ---------------------------------------------------------------------------
+**  CustomOpenCVCapturer conversion to I420, per input format
+** -------------------------------------------------------------------------*/
+static void BM_CapturerConvertToI420(benchmark::State& state, int type)
+{
+	cv::Mat frame = MakeFrame(state.range(0), state.range(1), type);
+
+	for (auto _ : state)
+	{
+		rtc::scoped_refptr<webrtc::I420Buffer> buffer = CustomOpenCVCapturer::ConvertToI420(frame);
+		benchmark::DoNotOptimize(buffer.get());
+	}
+	SetFrameCounters(state, frame.total() * frame.elemSize());
+}
+BENCHMARK_CAPTURE(BM_CapturerConvertToI420, gray, CV_8UC1)->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_CapturerConvertToI420, bgr, CV_8UC3)->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_CapturerConvertToI420, bgra, CV_8UC4)->Apply(Resolutions);
+
+// 4K BGR conversion split between the caller and 0..4 pool workers
+static void BM_CapturerConvertToI420Stripes(benchmark::State& state)
+{
+	StripePool::configure(state.range(0), 0);
+	cv::Mat frame = MakeFrame(3840, 2160, CV_8UC3);
+
+	for (auto _ : state)
+	{
+		rtc::scoped_refptr<webrtc::I420Buffer> buffer = CustomOpenCVCapturer::ConvertToI420(frame);
+		benchmark::DoNotOptimize(buffer.get());
+	}
+	SetFrameCounters(state, frame.total() * frame.elemSize());
+	StripePool::configure(0, 0);
+}
+BENCHMARK(BM_CapturerConvertToI420Stripes)->ArgName("workers")->DenseRange(0, 4)->UseRealTime();
+
+/* ---------------------------------------------------------------------------
+**  BGR24 to I420 / NV12: one pass kernels against the cvtColor + ARGBToI420
+**  two pass path. Each kernel is first checked against libyuv::RGB24ToI420
+**  (libyuv rounds its SIMD averages differently, hence the tolerance); the
+**  full check over odd sizes and ROIs is test/bgr24_converter.cpp.
+** -------------------------------------------------------------------------*/
+static const int kMaxDiffFromLibyuv = 2;
+
+static int MaxDiff(const uint8_t* a, const uint8_t* b, size_t size, size_t step = 1)
+{
+	int diff = 0;
+	for (size_t i = 0; i < size; i++)
+		diff = std::max(diff, std::abs(static_cast<int>(a[i * step]) - static_cast<int>(b[i])));
+	return diff;
+}
+
+static int MaxDiffFromLibyuv(const cv::Mat& frame, bool nv12)
+{
+	int width = frame.cols;
+	int height = frame.rows;
+	int chroma = ((width + 1) / 2) * ((height + 1) / 2);
+	rtc::scoped_refptr<webrtc::I420Buffer> expected = webrtc::I420Buffer::Create(width, height);
+	// libyuv RGB24 is BGR in memory order
+	libyuv::RGB24ToI420(frame.ptr(), static_cast<int>(frame.step),
+	                    expected->MutableDataY(), expected->StrideY(),
+	                    expected->MutableDataU(), expected->StrideU(),
+	                    expected->MutableDataV(), expected->StrideV(),
+	                    width, height);
+
+	std::vector<uint8_t> y(width * height);
+	std::vector<uint8_t> u(chroma);
+	std::vector<uint8_t> v(chroma);
+	std::vector<uint8_t> uv(2 * chroma);
+	if (nv12)
+	{
+		Bgr24Converter::toNV12(frame.ptr(), static_cast<int>(frame.step), y.data(), width,
+		                       uv.data(), 2 * ((width + 1) / 2), width, height);
+	}
+	else
+	{
+		Bgr24Converter::toI420(frame.ptr(), static_cast<int>(frame.step), y.data(), width,
+		                       u.data(), (width + 1) / 2, v.data(), (width + 1) / 2, width, height);
+	}
+
+	return std::max({ MaxDiff(y.data(), expected->DataY(), y.size()),
+	                  MaxDiff(nv12 ? uv.data() : u.data(), expected->DataU(), u.size(), nv12 ? 2 : 1),
+	                  MaxDiff(nv12 ? uv.data() + 1 : v.data(), expected->DataV(), v.size(), nv12 ? 2 : 1) });
+}
+
+static void BM_Bgr24Kernel(benchmark::State& state, Bgr24Converter::Kernel kernel, bool nv12)
+{
+	if (!Bgr24Converter::setKernel(kernel))
+	{
+		state.SkipWithError("kernel not supported by this cpu");
+		return;
+	}
+	// odd sizes exercise the scalar tails of the vector kernels
+	cv::Mat frame = MakeFrame(state.range(0), state.range(1), CV_8UC3);
+	if (MaxDiffFromLibyuv(frame, nv12) > kMaxDiffFromLibyuv || MaxDiffFromLibyuv(frame(cv::Rect(1, 1, 101, 37)), nv12) > kMaxDiffFromLibyuv)
+	{
+		state.SkipWithError("output differs from libyuv::RGB24ToI420");
+		Bgr24Converter::resetKernel();
+		return;
+	}
+
+	int width = frame.cols;
+	int height = frame.rows;
+	rtc::scoped_refptr<webrtc::I420Buffer> buffer = webrtc::I420Buffer::Create(width, height);
+	std::vector<uint8_t> uv(2 * ((width + 1) / 2) * ((height + 1) / 2));
+	for (auto _ : state)
+	{
+		if (nv12)
+			Bgr24Converter::toNV12(frame.ptr(), static_cast<int>(frame.step), buffer->MutableDataY(), buffer->StrideY(),
+			                       uv.data(), 2 * ((width + 1) / 2), width, height);
+		else
+			Bgr24Converter::toI420(frame.ptr(), static_cast<int>(frame.step), buffer->MutableDataY(), buffer->StrideY(),
+			                       buffer->MutableDataU(), buffer->StrideU(), buffer->MutableDataV(), buffer->StrideV(),
+			                       width, height);
+		benchmark::DoNotOptimize(buffer->DataY());
+	}
+	SetFrameCounters(state, frame.total() * frame.elemSize());
+
+	Bgr24Converter::resetKernel();
+}
+BENCHMARK_CAPTURE(BM_Bgr24Kernel, i420_scalar, Bgr24Converter::kScalar, false)->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Bgr24Kernel, i420_sse41, Bgr24Converter::kSSE41, false)->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Bgr24Kernel, i420_avx2, Bgr24Converter::kAVX2, false)->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Bgr24Kernel, i420_avx512, Bgr24Converter::kAVX512, false)->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Bgr24Kernel, i420_neon, Bgr24Converter::kNEON, false)->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Bgr24Kernel, nv12_scalar, Bgr24Converter::kScalar, true)->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Bgr24Kernel, nv12_sse41, Bgr24Converter::kSSE41, true)->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Bgr24Kernel, nv12_avx2, Bgr24Converter::kAVX2, true)->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Bgr24Kernel, nv12_avx512, Bgr24Converter::kAVX512, true)->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Bgr24Kernel, nv12_neon, Bgr24Converter::kNEON, true)->Apply(Resolutions);
+
+// the path the kernels replace, and libyuv's own one pass conversion
+static void BM_Bgr24TwoPass(benchmark::State& state)
+{
+	cv::Mat frame = MakeFrame(state.range(0), state.range(1), CV_8UC3);
+	rtc::scoped_refptr<webrtc::I420Buffer> buffer = webrtc::I420Buffer::Create(frame.cols, frame.rows);
+
+	for (auto _ : state)
+	{
+		cv::Mat bgra;
+		cv::cvtColor(frame, bgra, CV_BGR2BGRA);
+		libyuv::ARGBToI420(bgra.ptr(), static_cast<int>(bgra.step),
+		                   buffer->MutableDataY(), buffer->StrideY(),
+		                   buffer->MutableDataU(), buffer->StrideU(),
+		                   buffer->MutableDataV(), buffer->StrideV(),
+		                   frame.cols, frame.rows);
+		benchmark::DoNotOptimize(buffer->DataY());
+	}
+	SetFrameCounters(state, frame.total() * frame.elemSize());
+}
+BENCHMARK(BM_Bgr24TwoPass)->Apply(Resolutions);
+
+static void BM_Bgr24Libyuv(benchmark::State& state)
+{
+	cv::Mat frame = MakeFrame(state.range(0), state.range(1), CV_8UC3);
+	rtc::scoped_refptr<webrtc::I420Buffer> buffer = webrtc::I420Buffer::Create(frame.cols, frame.rows);
+
+	for (auto _ : state)
+	{
+		libyuv::RGB24ToI420(frame.ptr(), static_cast<int>(frame.step),
+		                    buffer->MutableDataY(), buffer->StrideY(),
+		                    buffer->MutableDataU(), buffer->StrideU(),
+		                    buffer->MutableDataV(), buffer->StrideV(),
+		                    frame.cols, frame.rows);
+		benchmark::DoNotOptimize(buffer->DataY());
+	}
+	SetFrameCounters(state, frame.total() * frame.elemSize());
+}
+BENCHMARK(BM_Bgr24Libyuv)->Apply(Resolutions);
+
+/* ---------------------------------------------------------------------------
+**  VideoRenderer::OnFrame per consumer of the decoded frames: none, the frame
+**  is dropped (0), Capture() reading the queue (1), a shared ring (2), a Y4M
+**  recording (3)
+** -------------------------------------------------------------------------*/
+enum RendererConsumer
+{
+	kRendererIdle,
+	kRendererQueue,
+	kRendererSharedRing,
+	kRendererRecorder
+};
+
+// no source behind it: VideoRenderer only registers with the track
+class BenchVideoTrack : public webrtc::VideoTrackInterface
+{
+public:
+	void RegisterObserver(webrtc::ObserverInterface*) override {}
+	void UnregisterObserver(webrtc::ObserverInterface*) override {}
+	std::string kind() const override { return kVideoKind; }
+	std::string id() const override { return "bench"; }
+	bool enabled() const override { return true; }
+	bool set_enabled(bool) override { return true; }
+	TrackState state() const override { return kLive; }
+	void AddOrUpdateSink(rtc::VideoSinkInterface<webrtc::VideoFrame>*, const rtc::VideoSinkWants&) override {}
+	void RemoveSink(rtc::VideoSinkInterface<webrtc::VideoFrame>*) override {}
+	webrtc::VideoTrackSourceInterface* GetSource() const override { return nullptr; }
+};
+
+static void BM_RendererOnFrame(benchmark::State& state)
+{
+	int width = state.range(0);
+	int height = state.range(1);
+	RendererConsumer consumer = static_cast<RendererConsumer>(state.range(2));
+
+	std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> queue = std::make_shared<core::queue::ConcurrentQueue<cv::Mat>>();
+	std::shared_ptr<StreamContext> context = StreamContext::attach(*queue);
+	if (consumer == kRendererSharedRing && !context->sharedRing->open("benchHotPathRing", 4, width, height, WEBRTC_RING_I420))
+	{
+		state.SkipWithError("shared ring not available");
+		return;
+	}
+	if (consumer == kRendererRecorder)
+	{
+		std::shared_ptr<StreamRecorder> recorder = StreamRecorder::create("/dev/null", StreamRecorder::Y4m);
+		if (!recorder)
+		{
+			state.SkipWithError("recorder not available");
+			return;
+		}
+		context->recorder->set(recorder);
+	}
+
+	rtc::scoped_refptr<webrtc::VideoTrackInterface> track(new rtc::RefCountedObject<BenchVideoTrack>());
+	VideoRenderer renderer(width, height, track, queue);
+	webrtc::VideoFrame frame(CustomOpenCVCapturer::ConvertToI420(MakeFrame(width, height, CV_8UC3)), 0, rtc::TimeMillis(),
+	                         webrtc::kVideoRotation_0);
+
+	// the renderer converts for a queue read recently
+	cv::Mat popped;
+	if (consumer == kRendererQueue)
+		queue->try_pop(popped);
+
+	for (auto _ : state)
+	{
+		renderer.OnFrame(frame);
+		if (consumer == kRendererQueue)
+			queue->try_pop(popped);
+	}
+
+	context->sharedRing->close();
+	context->recorder->set(nullptr);
+	SetFrameCounters(state, width * height * 4);
+}
+BENCHMARK(BM_RendererOnFrame)->Apply(Resolutions)
+	->Args({ 1920, 1080, kRendererIdle })->Args({ 1920, 1080, kRendererSharedRing })->Args({ 1920, 1080, kRendererRecorder });
+
+/* ---------------------------------------------------------------------------
+**  signaling JSON, not resolution dependent: a candidate batch (0) and an
+**  offer sized like a real one (1)
+** -------------------------------------------------------------------------*/
+static Json::Value MakeOffer()
+{
+	std::string sdp = "v=0\r\no=- 4611731400430051336 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n";
+	for (int i = 0; i < 60; i++)
+	{
+		sdp += "a=rtpmap:" + std::to_string(96 + i) + " VP8/90000\r\na=rtcp-fb:" + std::to_string(96 + i) + " nack pli\r\n";
+	}
+	Json::Value offer;
+	offer["type"] = "offer";
+	offer["sdp"] = sdp;
+	return offer;
+}
+
+static Json::Value MakeCandidates()
+{
+	Json::Value candidates(Json::arrayValue);
+	for (int i = 0; i < 8; i++)
+	{
+		Json::Value candidate;
+		candidate["sdpMid"] = "video";
+		candidate["sdpMLineIndex"] = 0;
+		candidate["candidate"] = "candidate:" + std::to_string(i) + " 1 udp 2122260223 192.168.1." + std::to_string(i) + " 50000 typ host generation 0";
+		candidates.append(candidate);
+	}
+	return makeIceCandidatesMessage(candidates);
+}
+
+static void BM_SignalingEncode(benchmark::State& state)
+{
+	Json::Value message = state.range(0) ? MakeOffer() : MakeCandidates();
+	for (auto _ : state)
+	{
+		std::string payload = writeSignalingMessage(message);
+		benchmark::DoNotOptimize(payload.data());
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SignalingEncode)->ArgName("offer")->Arg(0)->Arg(1);
+
+static void BM_SignalingDecode(benchmark::State& state)
+{
+	std::string payload = writeSignalingMessage(state.range(0) ? MakeOffer() : MakeCandidates());
+	for (auto _ : state)
+	{
+		Json::Value message;
+		benchmark::DoNotOptimize(readSignalingMessage(payload, message));
+	}
+	state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(BM_SignalingDecode)->ArgName("offer")->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN();
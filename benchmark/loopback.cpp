@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <internal/PeerConnectionManager.h>
+#include <internal/videorenderer.h>
+#include <WebRTCStreamer.h>
+
+// In-process loopback: a sending PeerConnectionManager streams synthetic frames
+// to a receiving one through the same path as WebRTCStreamer -> WebRTCCapturer
+// (WebRTCStreamer::Send -> ConcurrentQueue -> CustomOpenCVCapturer -> encoder
+// ... decoder -> VideoRenderer).
+// Each frame carries its index as black/white blocks, so the receiver can match
+// it with its push time. Results are printed as one JSON line.
+//
+// usage: benchLoopback [width] [height] [fps] [seconds]
+
+static const int kIdBits = 32;
+static const int kIdBlockHeight = 32;
+static const char kPeerId[] = "loopback";
+
+static int64_t nowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 24 bits of frame index, 8 bits of check so that a damaged read is not counted
+static uint32_t makeFrameId(uint32_t index)
+{
+	index &= 0xFFFFFF;
+	return index | (((index * 31 + 7) & 0xFF) << 24);
+}
+
+static bool checkFrameId(uint32_t id, uint32_t& index)
+{
+	index = id & 0xFFFFFF;
+	return (id >> 24) == ((index * 31 + 7) & 0xFF);
+}
+
+static void drawFrame(cv::Mat& frame, uint32_t index)
+{
+	// moving background so that the encoder has some work to do
+	frame.setTo(cv::Scalar((index * 3) & 0xFF, (index * 5) & 0xFF, 96));
+
+	uint32_t id = makeFrameId(index);
+	int blockWidth = frame.cols / kIdBits;
+	for (int bit = 0; bit < kIdBits; bit++)
+	{
+		cv::Scalar color = (id & (1u << bit)) ? cv::Scalar(255, 255, 255) : cv::Scalar(0, 0, 0);
+		frame(cv::Rect(bit * blockWidth, 0, blockWidth, kIdBlockHeight)).setTo(color);
+	}
+}
+
+static bool readFrame(const cv::Mat& frame, uint32_t& index)
+{
+	int blockWidth = frame.cols / kIdBits;
+	if (blockWidth < 4 || frame.rows < kIdBlockHeight)
+		return false;
+
+	uint32_t id = 0;
+	for (int bit = 0; bit < kIdBits; bit++)
+	{
+		// center of the block, away from the blurred edges
+		cv::Rect center(bit * blockWidth + blockWidth / 4, kIdBlockHeight / 4, blockWidth / 2, kIdBlockHeight / 2);
+		cv::Scalar mean = cv::mean(frame(center));
+		if ((mean[0] + mean[1] + mean[2]) / 3 > 128)
+			id |= (1u << bit);
+	}
+	return checkFrameId(id, index);
+}
+
+// cpu time (ms) of the threads of this process, summed by thread name
+static std::map<std::string, double> threadCpuMs()
+{
+	std::map<std::string, double> cpu;
+	long ticks = sysconf(_SC_CLK_TCK);
+	DIR* dir = opendir("/proc/self/task");
+	if (!dir)
+		return cpu;
+
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (entry->d_name[0] == '.')
+			continue;
+
+		std::ifstream stat(std::string("/proc/self/task/") + entry->d_name + "/stat");
+		std::string line;
+		if (!std::getline(stat, line))
+			continue;
+
+		// pid (comm) state ppid ... field 14 utime, 15 stime
+		size_t open = line.find('(');
+		size_t close = line.rfind(')');
+		if (open == std::string::npos || close == std::string::npos)
+			continue;
+		std::string name = line.substr(open + 1, close - open - 1);
+
+		std::vector<std::string> fields;
+		size_t pos = close + 2;
+		while (pos < line.size())
+		{
+			size_t next = line.find(' ', pos);
+			if (next == std::string::npos)
+				next = line.size();
+			fields.push_back(line.substr(pos, next - pos));
+			pos = next + 1;
+		}
+		if (fields.size() < 13)
+			continue;
+
+		double ms = (atof(fields[11].c_str()) + atof(fields[12].c_str())) * 1000.0 / ticks;
+		cpu[name] += ms;
+	}
+	closedir(dir);
+	return cpu;
+}
+
+static void pumpUntil(std::function<bool()> done, int timeoutMs)
+{
+	int64_t deadline = nowUs() + timeoutMs * 1000LL;
+	while (!done() && nowUs() < deadline)
+	{
+		rtc::Thread::Current()->ProcessMessages(10);
+	}
+}
+
+static Json::Value localDescription(PeerConnectionManager& manager)
+{
+	Json::Value desc;
+	PeerConnectionManager::PeerConnectionObserver* observer = manager.getPeerConnectionObserver(kPeerId);
+	if (observer && observer->getPeerConnection()->local_description())
+	{
+		std::string sdp;
+		observer->getPeerConnection()->local_description()->ToString(&sdp);
+		desc["type"] = observer->getPeerConnection()->local_description()->type();
+		desc["sdp"] = sdp;
+	}
+	return desc;
+}
+
+// A WebRTCStreamer without its server: the sending manager reads its queue, and
+// a viewer is faked or Send drops every frame.
+class LoopbackStreamer : public WebRTCStreamer
+{
+public:
+	LoopbackStreamer() : WebRTCStreamer(0, ".") { subscribersChanged(1); }
+
+	// not owning, as the streamer gives it to its server
+	std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> queue()
+	{
+		return std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>>(
+			static_cast<core::queue::ConcurrentQueue<cv::Mat> *>(stack.get()), [](core::queue::ConcurrentQueue<cv::Mat> *) {});
+	}
+};
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0.0;
+	size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(p * (sorted.size() - 1) + 0.5));
+	return sorted[rank];
+}
+
+int main(int argc, char ** argv)
+{
+	int width = (argc > 1) ? atoi(argv[1]) : 1280;
+	int height = (argc > 2) ? atoi(argv[2]) : 720;
+	int fps = (argc > 3) ? atoi(argv[3]) : 30;
+	int seconds = (argc > 4) ? atoi(argv[4]) : 10;
+
+	// this thread is the signaling thread of both managers
+	rtc::ThreadManager::Instance()->WrapCurrentThread();
+	pthread_setname_np(pthread_self(), "signaling");
+
+	// before the managers: the capturer of the sender reads its queue until they are gone
+	LoopbackStreamer streamer;
+	std::list<std::string> iceServerList;
+	PeerConnectionManager sender(iceServerList, webrtc::AudioDeviceModule::kDummyAudio, ".*");
+	PeerConnectionManager receiver(iceServerList, webrtc::AudioDeviceModule::kDummyAudio, ".*");
+	std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> input = streamer.queue();
+	std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> output = std::make_shared<core::queue::ConcurrentQueue<cv::Mat>>();
+
+	// receiving side, as WebRTCCapturer does
+	std::atomic<bool> receiverGathered(false);
+	PeerConnectionManager::PeerConnectionObserver* receiverObserver = receiver.createClientOffer(kPeerId);
+	receiverObserver->SetOnIceGatheringComplete([&receiverGathered]() { receiverGathered = true; });
+	receiverObserver->setFuncOnAddStream([output](PeerConnectionManager::PeerConnectionObserver* observer,
+	                                              rtc::scoped_refptr<webrtc::MediaStreamInterface> stream)
+	{
+		webrtc::VideoTrackVector tracks = stream->GetVideoTracks();
+		if (tracks.size() > 0)
+		{
+			observer->setVideosink(new VideoRenderer(1, 1, tracks[0], output));
+		}
+	});
+
+	// sending side, as WebRTCStreamer does; offer and answer are exchanged once
+	// the candidates are gathered, there is no trickle in a loopback
+	int64_t joinStart = nowUs();
+	std::atomic<bool> senderGathered(false);
+	sender.createClientOffer(kPeerId)->SetOnIceGatheringComplete([&senderGathered]() { senderGathered = true; });
+	sender.createOffer(kPeerId, "", input, nullptr);
+	pumpUntil([&senderGathered]() { return senderGathered.load(); }, 5000);
+
+	receiver.createAnswerToClientOffer(kPeerId, localDescription(sender), nullptr);
+	pumpUntil([&receiverGathered]() { return receiverGathered.load(); }, 5000);
+	sender.setAnswer(kPeerId, localDescription(receiver));
+
+	size_t maxFrames = static_cast<size_t>(fps) * seconds + 1;
+	std::vector<std::atomic<int64_t>> pushTimes(maxFrames);
+	for (auto& t : pushTimes)
+		t = 0;
+
+	std::atomic<bool> running(true);
+	std::atomic<uint32_t> sent(0);
+	std::vector<double> latenciesMs;
+	std::vector<bool> seen(maxFrames, false);
+	size_t received = 0;
+	size_t unreadable = 0;
+	int64_t firstFrameUs = 0;
+
+	std::map<std::string, double> cpuStart = threadCpuMs();
+	int64_t start = nowUs();
+
+	std::thread source([&]()
+	{
+		pthread_setname_np(pthread_self(), "bench_source");
+		cv::Mat frame(height, width, CV_8UC3);
+		int64_t period = 1000000 / fps;
+		for (uint32_t index = 0; index < maxFrames && running; index++)
+		{
+			drawFrame(frame, index);
+			pushTimes[index] = nowUs();
+
+			// one Mat for every frame: Send copies it
+			streamer.Send(frame);
+			sent = index + 1;
+
+			std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(start + (index + 1) * period)));
+		}
+	});
+
+	std::thread sink([&]()
+	{
+		pthread_setname_np(pthread_self(), "bench_sink");
+		while (running)
+		{
+			cv::Mat frame;
+			if (!output->trypop_until(frame, 100))
+				continue;
+
+			int64_t arrival = nowUs();
+			uint32_t index = 0;
+			if (!readFrame(frame, index) || index >= maxFrames || pushTimes[index] == 0)
+			{
+				unreadable++;
+				continue;
+			}
+			if (seen[index])
+				continue;
+
+			seen[index] = true;
+			received++;
+			if (!firstFrameUs)
+				firstFrameUs = arrival;
+			latenciesMs.push_back((arrival - pushTimes[index]) / 1000.0);
+		}
+	});
+
+	pumpUntil([]() { return false; }, seconds * 1000 + 500);
+	running = false;
+	source.join();
+	sink.join();
+
+	int64_t elapsed = nowUs() - start;
+	std::map<std::string, double> cpuEnd = threadCpuMs();
+
+	receiver.hangUp(kPeerId);
+	sender.hangUp(kPeerId);
+
+	std::sort(latenciesMs.begin(), latenciesMs.end());
+	double elapsedS = elapsed / 1000000.0;
+	double dropRate = sent > 0 ? 1.0 - static_cast<double>(received) / sent : 0.0;
+
+	fprintf(stdout, "{\"width\": %d, \"height\": %d, \"fps\": %d, \"seconds\": %.3f, \"join_ms\": %.3f, "
+		"\"sent\": %u, \"received\": %zu, \"unreadable\": %zu, \"drop_rate\": %.4f, \"delivered_fps\": %.2f, "
+		"\"latency_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, \"cpu_ms\": {",
+		width, height, fps, elapsedS, firstFrameUs ? (firstFrameUs - joinStart) / 1000.0 : -1.0,
+		sent.load(), received, unreadable, dropRate, received / elapsedS,
+		percentile(latenciesMs, 0.5), percentile(latenciesMs, 0.9), percentile(latenciesMs, 0.99),
+		latenciesMs.empty() ? 0.0 : latenciesMs.back());
+
+	const char* separator = "";
+	for (auto& stage : cpuEnd)
+	{
+		double ms = stage.second - cpuStart[stage.first];
+		fprintf(stdout, "%s\"%s\": %.1f", separator, stage.first.c_str(), ms);
+		separator = ", ";
+	}
+	fprintf(stdout, "}}\n");
+
+	return 0;
+}
@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <internal/PeerConnectionManager.h>
+
+// Connect then disconnect N peers subscribed to the same OpenCV stream and
+// report the time spent in each phase as JSON.
+int main(int argc, char ** argv)
+{
+	int nbPeers = (argc > 1) ? atoi(argv[1]) : 1000;
+
+	std::list<std::string> iceServerList;
+	PeerConnectionManager manager(iceServerList, webrtc::AudioDeviceModule::kDummyAudio, ".*");
+	std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> stack = std::make_shared<core::queue::ConcurrentQueue<cv::Mat>>();
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < nbPeers; i++)
+	{
+		std::string peerId = "peer" + std::to_string(i);
+		manager.createClientOffer(peerId);
+		manager.startOpenCVStreaming(peerId, stack);
+	}
+	auto connected = std::chrono::steady_clock::now();
+	unsigned int streams = manager.getStreamList().size();
+
+	for (int i = 0; i < nbPeers; i++)
+	{
+		manager.hangUp("peer" + std::to_string(i));
+	}
+	auto disconnected = std::chrono::steady_clock::now();
+
+	double connectMs = std::chrono::duration<double, std::milli>(connected - start).count();
+	double disconnectMs = std::chrono::duration<double, std::milli>(disconnected - connected).count();
+
+	fprintf(stdout, "{\"peers\": %d, \"streams\": %u, \"streams_left\": %u, \"connect_ms\": %.3f, \"disconnect_ms\": %.3f, \"disconnect_us_per_peer\": %.3f}\n",
+		nbPeers, streams, manager.getStreamList().size(), connectMs, disconnectMs,
+		nbPeers > 0 ? disconnectMs * 1000.0 / nbPeers : 0.0);
+
+	return 0;
+}
@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <internal/PeerConnectionManager.h>
+
+// Load generator: N native viewers join a running WebRTCStreamer through its
+// WHEP endpoint, decode the stream and record join latency, fps and freezes.
+// Results are printed as one JSON line, with one entry per viewer.
+//
+// usage: benchViewers <host> <port> [viewers] [seconds] [ramp_ms]
+
+static int64_t nowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct HttpResponse
+{
+	int status = 0;
+	std::string headers;
+	std::string body;
+};
+
+// One HTTPS request on its own connection, the server certificate is not checked.
+static bool httpsRequest(const std::string& host, int port, const std::string& method, const std::string& path,
+                         const std::string& contentType, const std::string& body, HttpResponse& response)
+{
+	try
+	{
+		boost::asio::io_service io;
+		boost::asio::ssl::context ctx(boost::asio::ssl::context::sslv23_client);
+		ctx.set_verify_mode(boost::asio::ssl::verify_none);
+		boost::asio::ssl::stream<boost::asio::ip::tcp::socket> stream(io, ctx);
+
+		boost::asio::ip::tcp::resolver resolver(io);
+		boost::asio::connect(stream.lowest_layer(), resolver.resolve(boost::asio::ip::tcp::resolver::query(host, std::to_string(port))));
+		stream.handshake(boost::asio::ssl::stream_base::client);
+
+		std::string request = method + " " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n";
+		if (!body.empty())
+		{
+			request += "Content-Type: " + contentType + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+		}
+		request += "\r\n" + body;
+		boost::asio::write(stream, boost::asio::buffer(request));
+
+		std::string raw;
+		char buffer[4096];
+		boost::system::error_code ec;
+		while (!ec)
+		{
+			size_t size = stream.read_some(boost::asio::buffer(buffer), ec);
+			raw.append(buffer, size);
+		}
+
+		size_t endOfHeaders = raw.find("\r\n\r\n");
+		if (raw.compare(0, 5, "HTTP/") != 0 || endOfHeaders == std::string::npos)
+			return false;
+
+		response.status = atoi(raw.c_str() + raw.find(' ') + 1);
+		response.headers = raw.substr(0, endOfHeaders);
+		response.body = raw.substr(endOfHeaders + 4);
+		return true;
+	}
+	catch (const std::exception& e)
+	{
+		RTC_LOG(LS_ERROR) << method << " " << path << " failed: " << e.what();
+		return false;
+	}
+}
+
+static std::string headerValue(const std::string& headers, const std::string& name)
+{
+	std::string lower = headers;
+	std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+	std::string key = "\r\n" + name + ":";
+	std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+
+	size_t pos = lower.find(key);
+	if (pos == std::string::npos)
+		return std::string();
+	pos += key.size();
+	size_t end = headers.find("\r\n", pos);
+	std::string value = headers.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+	value.erase(0, value.find_first_not_of(' '));
+	return value;
+}
+
+struct ViewerStats
+{
+	std::mutex mutex;
+	int64_t firstFrameUs = 0;
+	int64_t lastFrameUs = 0;
+	size_t frames = 0;
+	size_t freezes = 0;
+	double frozenMs = 0;
+	double avgIntervalMs = 0;
+	int width = 0;
+	int height = 0;
+};
+
+// Counts decoded frames; a freeze is an inter-frame delay above
+// max(3 * average delay, average delay + 150 ms), as webrtc stats define it.
+class StatsSink : public PeerConnectionManager::VideoSink
+{
+public:
+	StatsSink(webrtc::VideoTrackInterface* track, std::shared_ptr<ViewerStats> stats) : VideoSink(track), m_stats(stats) {}
+
+	void OnFrame(const webrtc::VideoFrame& video_frame) override
+	{
+		int64_t now = nowUs();
+		std::lock_guard<std::mutex> lock(m_stats->mutex);
+		if (m_stats->frames > 0)
+		{
+			double interval = (now - m_stats->lastFrameUs) / 1000.0;
+			if (m_stats->frames > 10 && interval > std::max(3 * m_stats->avgIntervalMs, m_stats->avgIntervalMs + 150))
+			{
+				m_stats->freezes++;
+				m_stats->frozenMs += interval;
+			}
+			m_stats->avgIntervalMs = (m_stats->frames == 1) ? interval : 0.9 * m_stats->avgIntervalMs + 0.1 * interval;
+		}
+		else
+		{
+			m_stats->firstFrameUs = now;
+		}
+		m_stats->lastFrameUs = now;
+		m_stats->frames++;
+		m_stats->width = video_frame.width();
+		m_stats->height = video_frame.height();
+	}
+
+protected:
+	std::shared_ptr<ViewerStats> m_stats;
+};
+
+struct Viewer
+{
+	enum State { kWaiting, kGathering, kPosting, kJoined, kFailed };
+
+	std::string peerId;
+	State state = kWaiting;
+	int64_t startUs = 0;
+	int64_t joinStartUs = 0;
+	std::atomic<bool> gathered{ false };
+	std::future<bool> post;
+	HttpResponse answer;
+	std::string location;
+	std::shared_ptr<ViewerStats> stats = std::make_shared<ViewerStats>();
+};
+
+static void startViewer(PeerConnectionManager& manager, Viewer& viewer)
+{
+	viewer.joinStartUs = nowUs();
+	PeerConnectionManager::PeerConnectionObserver* observer = manager.createClientOffer(viewer.peerId);
+	if (!observer)
+	{
+		viewer.state = Viewer::kFailed;
+		return;
+	}
+
+	Viewer* self = &viewer;
+	observer->SetOnIceGatheringComplete([self]() { self->gathered = true; });
+	std::shared_ptr<ViewerStats> stats = viewer.stats;
+	observer->setFuncOnAddStream([stats](PeerConnectionManager::PeerConnectionObserver* peerConnectionObserver,
+	                                     rtc::scoped_refptr<webrtc::MediaStreamInterface> stream)
+	{
+		webrtc::VideoTrackVector tracks = stream->GetVideoTracks();
+		if (tracks.size() > 0)
+		{
+			peerConnectionObserver->setVideosink(new StatsSink(tracks[0], stats));
+		}
+	});
+
+	// receive only offer, answered by the WHEP endpoint with all its candidates
+	rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc = observer->getPeerConnection();
+	webrtc::PeerConnectionInterface::RTCOfferAnswerOptions options;
+	options.offer_to_receive_video = 1;
+	options.offer_to_receive_audio = 0;
+	pc->CreateOffer(PeerConnectionManager::CreateSessionDescriptionObserver::Create(pc), options);
+	viewer.state = Viewer::kGathering;
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <host> <port> [viewers] [seconds] [ramp_ms]\n", argv[0]);
+		return 1;
+	}
+	std::string host = argv[1];
+	int port = atoi(argv[2]);
+	int nbViewers = (argc > 3) ? atoi(argv[3]) : 10;
+	int seconds = (argc > 4) ? atoi(argv[4]) : 30;
+	int rampMs = (argc > 5) ? atoi(argv[5]) : 100;
+
+	// this thread is the signaling thread of all the viewers
+	rtc::ThreadManager::Instance()->WrapCurrentThread();
+
+	std::list<std::string> iceServerList;
+	PeerConnectionManager manager(iceServerList, webrtc::AudioDeviceModule::kDummyAudio, ".*");
+
+	int64_t start = nowUs();
+	std::vector<std::unique_ptr<Viewer>> viewers;
+	for (int i = 0; i < nbViewers; i++)
+	{
+		std::unique_ptr<Viewer> viewer(new Viewer());
+		viewer->peerId = "viewer" + std::to_string(i);
+		viewer->startUs = start + static_cast<int64_t>(i) * rampMs * 1000;
+		viewers.push_back(std::move(viewer));
+	}
+
+	int64_t end = start + static_cast<int64_t>(nbViewers) * rampMs * 1000 + seconds * 1000000LL;
+	while (nowUs() < end)
+	{
+		rtc::Thread::Current()->ProcessMessages(5);
+
+		for (auto& viewer : viewers)
+		{
+			switch (viewer->state)
+			{
+			case Viewer::kWaiting:
+				if (nowUs() >= viewer->startUs)
+					startViewer(manager, *viewer);
+				break;
+
+			case Viewer::kGathering:
+				if (viewer->gathered)
+				{
+					std::string sdp;
+					manager.getPeerConnectionObserver(viewer->peerId)->getPeerConnection()->local_description()->ToString(&sdp);
+					Viewer* self = viewer.get();
+					viewer->post = std::async(std::launch::async, [self, host, port, sdp]()
+					{
+						return httpsRequest(host, port, "POST", "/whep", "application/sdp", sdp, self->answer);
+					});
+					viewer->state = Viewer::kPosting;
+				}
+				break;
+
+			case Viewer::kPosting:
+				if (viewer->post.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+				{
+					if (!viewer->post.get() || viewer->answer.status != 201)
+					{
+						RTC_LOG(LS_ERROR) << viewer->peerId << " WHEP status:" << viewer->answer.status;
+						viewer->state = Viewer::kFailed;
+						break;
+					}
+					Json::Value answer;
+					answer["type"] = "answer";
+					answer["sdp"] = viewer->answer.body;
+					manager.setAnswer(viewer->peerId, answer);
+					viewer->location = headerValue(viewer->answer.headers, "Location");
+					viewer->state = Viewer::kJoined;
+				}
+				break;
+
+			default:
+				break;
+			}
+		}
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	double cpuMs = usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0
+		+ usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+
+	int64_t stop = nowUs();
+	size_t joined = 0;
+	size_t receiving = 0;
+	size_t totalFreezes = 0;
+	double totalFps = 0;
+	std::string clients;
+	for (auto& viewer : viewers)
+	{
+		std::lock_guard<std::mutex> lock(viewer->stats->mutex);
+		double fps = 0;
+		double joinMs = -1;
+		if (viewer->state == Viewer::kJoined)
+			joined++;
+		if (viewer->stats->frames > 1)
+		{
+			receiving++;
+			fps = (viewer->stats->frames - 1) * 1000000.0 / std::max<int64_t>(1, viewer->stats->lastFrameUs - viewer->stats->firstFrameUs);
+			joinMs = (viewer->stats->firstFrameUs - viewer->joinStartUs) / 1000.0;
+		}
+		totalFps += fps;
+		totalFreezes += viewer->stats->freezes;
+
+		char entry[256];
+		snprintf(entry, sizeof(entry), "%s{\"id\": \"%s\", \"joined\": %s, \"join_ms\": %.1f, \"frames\": %zu, \"fps\": %.2f, \"freezes\": %zu, \"frozen_ms\": %.1f, \"width\": %d, \"height\": %d}",
+			clients.empty() ? "" : ", ", viewer->peerId.c_str(), viewer->state == Viewer::kJoined ? "true" : "false",
+			joinMs, viewer->stats->frames, fps, viewer->stats->freezes, viewer->stats->frozenMs,
+			viewer->stats->width, viewer->stats->height);
+		clients += entry;
+	}
+
+	fprintf(stdout, "{\"viewers\": %d, \"joined\": %zu, \"receiving\": %zu, \"mean_fps\": %.2f, \"freezes\": %zu, \"seconds\": %.3f, \"client_cpu_ms\": %.1f, \"clients\": [%s]}\n",
+		nbViewers, joined, receiving, receiving > 0 ? totalFps / receiving : 0.0, totalFreezes,
+		(stop - start) / 1000000.0, cpuMs, clients.c_str());
+
+	// leave the server clean
+	for (auto& viewer : viewers)
+	{
+		if (viewer->state == Viewer::kPosting)
+			viewer->post.wait();
+		manager.hangUp(viewer->peerId);
+		if (!viewer->location.empty())
+		{
+			HttpResponse response;
+			httpsRequest(host, port, "DELETE", viewer->location, "", "", response);
+		}
+	}
+
+	return 0;
+}
@@ -1,8 +1,16 @@
 #pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <thread>
 #include <mutex>
+#include <string>
 #include <opencv2/core/mat.hpp>
 #include "WebRTCServer_export.h"
+#include "WebRTCStats.h"
+#include "WebRTCQueuePolicy.h"
+#include "WebRTCSharedRing.h"
+#include "WebRTCRecorder.h"
 
 
 
@@ -13,8 +21,36 @@ protected:
 	std::shared_ptr<std::thread> webRTC_task;
 	std::mutex safe_quard;
 	std::shared_ptr<void> stack;
+	std::shared_ptr<void> capture_wait;
+	std::shared_ptr<void> stats;
+	std::shared_ptr<void> sequence;
+	std::shared_ptr<void> shared_ring;
+	// recording in progress, and the tap of the renderer; recorder_guard before stats_guard
+	std::shared_ptr<void> recorder;
+	std::shared_ptr<void> recorder_tap;
+	std::mutex recorder_guard;
+	// peer connection manager of the running server, guarded by stats_guard not to wait for Capture
+	std::mutex stats_guard;
+	void* peers;
 	void* ws;
 	char * working_dir;
+	int media_udp_port;
+	int media_tcp_port;
+	std::atomic<int> subscribers;
+	std::mutex subscribers_guard;
+	std::function<void(bool)> on_subscribers;
+	std::shared_ptr<std::thread> delivery_task;
+	// a delivery thread stopped from its own callback, joined by the next
+	// stopDelivery() from another thread or by the destructor
+	std::shared_ptr<std::thread> stopped_delivery_task;
+	std::mutex delivery_guard;
+	// a delivery thread ends when this is not its own generation anymore
+	std::atomic<int> delivery_generation;
+	std::function<void(const cv::Mat&)> on_frame;
+
+	void subscribersChanged(int peers);
+	void deliverFrames(int generation);
+	void stopDelivery();
 
 public:
 	WebRTCCapturer(int i_port, const char * work_dir);
@@ -24,5 +60,112 @@ public:
 
 	int stopWebRTCServer();
 
+	// Serve all peers from one UDP port (and one TCP port if not 0). Must be called before startWebRTCServer.
+	void setMediaPort(int udp_port, int tcp_port = 0);
+
 	cv::Mat Capture();
+
+	// Blocks until a frame newer than lastSequence was decoded, 0 for any frame, and
+	// returns it with its sequence in info. Empty after timeoutMs. Independent of
+	// Capture(): every caller sees every frame it is fast enough for, shared read-only.
+	cv::Mat CaptureNext(uint64_t lastSequence, int timeoutMs, WebRTCFrameInfo* info = nullptr);
+
+	// Broadcast of the decoded frames: each reader has its own backlog of shared frames
+	// with its own policy (WEBRTC_QUEUE_FIFO_BLOCK holds the decoder for every reader).
+	// Returns the reader id, -1 for an invalid policy.
+	int addReader(const WebRTCQueuePolicy& policy);
+	void removeReader(int reader);
+	// Next frame of the reader, empty after timeoutMs. The Mat is shared read-only.
+	cv::Mat Read(int reader, int timeoutMs, WebRTCFrameInfo* info = nullptr);
+	bool getReaderStats(int reader, WebRTCReaderStats* stats);
+
+	// Push delivery instead of Capture(): callback is invoked from a dedicated thread
+	// with each decoded BGRA frame, the Mat is not shared and may be kept.
+	// Do not mix with Capture(), both take from the same queue. nullptr stops the delivery.
+	void setOnFrame(std::function<void(const cv::Mat&)> callback);
+
+	// Also write each decoded frame, I420 or BGR (WEBRTC_RING_PACKED), to the shared
+	// memory ring `name` that any number of processes read (see WebRTCSharedRing.h),
+	// whether this one reads the frames or not. Slots fit maxWidth x maxHeight, bigger
+	// frames are dropped. Replaces the previous ring. False if it cannot be created.
+	bool publishSharedRing(const std::string& name, int slots, int maxWidth, int maxHeight,
+	                       WebRTCSharedRingFormat format = WEBRTC_RING_I420);
+	void closeSharedRing();
+
+	// Record the received video to path, see WebRTCRecorder.h. Replaces the previous
+	// recording. False if the file cannot be created.
+	bool startRecording(const std::string& path, WebRTCRecordFormat format);
+	// Writes the backlog and completes the file.
+	void stopRecording();
+	// false while not recording
+	bool getRecorderStats(WebRTCRecorderStats* stats);
+
+	// Decoded frames waiting for Capture(), latest frame only by default.
+	// WEBRTC_QUEUE_FIFO_BLOCK holds the decoder until Capture() makes room.
+	// False for an invalid policy.
+	bool setQueuePolicy(const WebRTCQueuePolicy& policy);
+
+	WebRTCStreamStats getStats();
+
+	// true while a peer is connected, i.e. frames may come
+	bool hasSubscribers() const;
+
+	// Called from the server thread when the first peer connects (true) and when the last one leaves (false).
+	void setOnSubscribersChanged(std::function<void(bool)> callback);
 };
+
+typedef void * cWebCapturer;
+
+WEBRTCSERVER_EXPORT cWebCapturer newWebRTCCapturer(int port, const char * workdir);
+
+WEBRTCSERVER_EXPORT void deleteWebRTCCapturer(cWebCapturer * ctx);
+
+WEBRTCSERVER_EXPORT void startCapturerServer(cWebCapturer ctx);
+
+WEBRTCSERVER_EXPORT void stopCapturerServer(cWebCapturer ctx);
+
+// Fill stats, 0 on success.
+WEBRTCSERVER_EXPORT int getCapturerStats(cWebCapturer ctx, WebRTCStreamStats* stats);
+
+WEBRTCSERVER_EXPORT int hasCapturerSubscribers(cWebCapturer ctx);
+
+WEBRTCSERVER_EXPORT void setCapturerSubscribersCallback(cWebCapturer ctx, WebRTCSubscribersCallback callback, void* user_data);
+
+// See WebRTCCapturer::CaptureNext, the BGRA pixels are copied to data with rows of
+// width * 4 bytes. Returns 1 for a frame, 0 on timeout, -1 if size is too small:
+// info then has the frame size and the call can be retried with the same last_sequence.
+WEBRTCSERVER_EXPORT int captureNextFrame(cWebCapturer ctx, uint64_t last_sequence, int timeout_ms,
+                                         uint8_t* data, int size, WebRTCFrameInfo* info);
+
+// See WebRTCCapturer::addReader, -1 on error.
+WEBRTCSERVER_EXPORT int addCapturerReader(cWebCapturer ctx, const WebRTCQueuePolicy* policy);
+
+WEBRTCSERVER_EXPORT void removeCapturerReader(cWebCapturer ctx, int reader);
+
+// Next frame of the reader copied like captureNextFrame: 1, 0 on timeout, -1 if
+// size is too small (the frame is then lost for this reader, info has its size).
+WEBRTCSERVER_EXPORT int readCapturerFrame(cWebCapturer ctx, int reader, int timeout_ms,
+                                          uint8_t* data, int size, WebRTCFrameInfo* info);
+
+// 0 on success.
+WEBRTCSERVER_EXPORT int getCapturerReaderStats(cWebCapturer ctx, int reader, WebRTCReaderStats* stats);
+
+// Push delivery, see WebRTCCapturer::setOnFrame. NULL stops it.
+WEBRTCSERVER_EXPORT void setCapturerFrameCallback(cWebCapturer ctx, WebRTCFrameCallback callback, void* user_data);
+
+// 0 on success.
+WEBRTCSERVER_EXPORT int setCapturerQueuePolicy(cWebCapturer ctx, const WebRTCQueuePolicy* policy);
+
+// See WebRTCCapturer::publishSharedRing, format is a WebRTCSharedRingFormat. 0 on success.
+WEBRTCSERVER_EXPORT int publishCapturerSharedRing(cWebCapturer ctx, const char* name, int slots,
+                                                  int max_width, int max_height, int format);
+
+WEBRTCSERVER_EXPORT void closeCapturerSharedRing(cWebCapturer ctx);
+
+// See WebRTCCapturer::startRecording, format is a WebRTCRecordFormat. 0 on success.
+WEBRTCSERVER_EXPORT int startCapturerRecording(cWebCapturer ctx, const char* path, int format);
+
+WEBRTCSERVER_EXPORT void stopCapturerRecording(cWebCapturer ctx);
+
+// 0 on success, -1 while not recording.
+WEBRTCSERVER_EXPORT int getCapturerRecorderStats(cWebCapturer ctx, WebRTCRecorderStats* stats);
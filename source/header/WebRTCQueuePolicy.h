@@ -0,0 +1,18 @@
+#pragma once
+
+// Frame queue between the application and the WebRTC side of a stream:
+// Send() to the encoder for a WebRTCStreamer, decoded frames to Capture()
+// for a WebRTCCapturer.
+typedef enum
+{
+	WEBRTC_QUEUE_LATEST_ONLY = 0, // the newest frame replaces the waiting ones (default, live viewing)
+	WEBRTC_QUEUE_FIFO_BLOCK = 1,  // up to max_depth frames, the producer waits for room
+	WEBRTC_QUEUE_FIFO_FAIL = 2    // up to max_depth frames, a new frame is rejected when full
+} WebRTCQueueMode;
+
+typedef struct
+{
+	WebRTCQueueMode mode;
+	int             max_depth;  // FIFO modes, at least 1
+	int             max_age_ms; // older frames are dropped unconsumed, 0 for no limit
+} WebRTCQueuePolicy;
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+// Recording of the video a WebRTCCapturer receives, written by a thread of
+// its own: a slow disk drops frames (dropped_frames), it never holds the decoder.
+typedef enum
+{
+	WEBRTC_RECORD_Y4M = 0,    // decoded frames, 4:2:0, scaled to the size of the first frame
+	WEBRTC_RECORD_ENCODED = 1 // frames as received, before decoding: IVF for VP8 and VP9,
+	                          // Annex-B elementary stream for H264. Starts at a key frame,
+	                          // the stream of the first peer sending one only.
+} WebRTCRecordFormat;
+
+typedef struct
+{
+	uint64_t frames;         // written or waiting to be
+	uint64_t dropped_frames; // backlog full, or a frame of another codec or peer (ENCODED)
+	uint64_t bytes;          // written to the file
+	int      backlog_bytes;  // waiting for the disk
+} WebRTCRecorderStats;
@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+#include "WebRTCServer_export.h"
+
+// Frame ring in POSIX shared memory (/dev/shm/<name>, Linux only) between a
+// process writing frames and the processes reading them, without copy across
+// the process boundary. The owner creates it (WebRTCStreamer::openSharedRing
+// to read, WebRTCCapturer::publishSharedRing to write), the other side opens
+// it by name.
+//
+// Layout: a WebRTCSharedRingHeader, then slot_count slots of slot_stride
+// bytes from first_slot. A slot is a WebRTCSharedRingSlot followed, at
+// WEBRTC_SHARED_RING_SLOT_HEADER, by slot_bytes of pixels.
+//
+// Protocol, all words accessed atomically:
+//   writer: CAS state FREE -> WRITING (or READY -> WRITING for a slot that is
+//           not `latest`: nobody reads that frame), fill pixels and
+//           metadata, state = READY, latest = slot, published++, FUTEX_WAKE
+//           on published (shared futex).
+//   reader: keeps its own cursor, the sequence of the last frame it took.
+//           FUTEX_WAIT while published equals the cursor, then CAS state of
+//           `latest` READY -> READING for the first reader, n -> n + 1 for
+//           each other one (state - READING + 1 readers), use the pixels, and
+//           CAS n -> n - 1, READING -> READY for the last one.
+// A slot being read is not written: the writer needs one slot more than the
+// readers hold plus the latest one. WebRTCStreamer holds up to its queue
+// max_depth + 1.
+//
+// Leases: a reader (an opened ring that reads) takes an entry r of
+// reader_pids with its pid before its first read, is counted once in the
+// state of a slot however many frames of it it holds, and sets bit r of the
+// slot readers while it does. When it finds no slot, the writer looks for
+// entries whose process is gone (readers in the same pid namespace): it
+// marks the entry WEBRTC_READER_RECLAIMING, clears bit r of every slot, one
+// READING count less for each bit it cleared, and frees the entry (0).
+
+// Pixels of a slot: WEBRTC_RING_PACKED, rows of stride bytes of channels bytes
+// per pixel. WEBRTC_RING_I420: planes Y (stride, height rows), U then V
+// ((stride + 1) / 2, (height + 1) / 2 rows), channels is 1.
+
+#define WEBRTC_SHARED_RING_MAGIC       0x47525257u /* "WRRG" */
+#define WEBRTC_SHARED_RING_VERSION     3
+#define WEBRTC_SHARED_RING_SLOT_HEADER 64
+#define WEBRTC_SHARED_RING_MAX_READERS 32
+#define WEBRTC_READER_RECLAIMING       0xFFFFFFFFu
+
+enum
+{
+	WEBRTC_SLOT_FREE = 0,
+	WEBRTC_SLOT_WRITING = 1,
+	WEBRTC_SLOT_READY = 2,
+	WEBRTC_SLOT_READING = 3
+};
+
+typedef enum
+{
+	WEBRTC_RING_PACKED = 0,
+	WEBRTC_RING_I420 = 0x30323449 /* "I420" */
+} WebRTCSharedRingFormat;
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slot_count;
+	uint32_t published;   // futex word, incremented by each publish
+	int32_t  latest;      // slot of the last publish, -1 before the first one
+	uint32_t reserved;
+	uint64_t slot_bytes;  // pixel capacity of a slot
+	uint64_t slot_stride; // distance between two slots
+	uint64_t first_slot;  // offset of slot 0
+	uint32_t reader_pids[WEBRTC_SHARED_RING_MAX_READERS]; // 0: free entry
+} WebRTCSharedRingHeader;
+
+typedef struct
+{
+	uint32_t state;
+	int32_t  width;
+	int32_t  height;
+	int32_t  channels;    // 1 gray, 3 BGR, 4 BGRA
+	int32_t  stride;      // bytes per row (of the Y plane)
+	uint32_t format;      // WebRTCSharedRingFormat
+	int64_t  timestamp_us;
+	uint64_t sequence;    // publish count when written
+	uint32_t readers;     // bit r: reader r holds the slot
+	uint32_t reserved;
+} WebRTCSharedRingSlot;
+
+typedef void * cWebSharedRing;
+
+// Side that did not create the ring. NULL if it does not exist or is not a ring.
+WEBRTCSERVER_EXPORT cWebSharedRing openSharedRing(const char * name);
+
+WEBRTCSERVER_EXPORT void closeSharedRing(cWebSharedRing * ring);
+
+// Writer: pixels of a free slot to fill, NULL if every slot is busy (drop the frame).
+WEBRTCSERVER_EXPORT uint8_t* acquireSharedRingSlot(cWebSharedRing ring, int* slot, int* capacity);
+
+// Writer: make the slot the latest frame and wake the readers. 0 on success.
+WEBRTCSERVER_EXPORT int publishSharedRingSlot(cWebSharedRing ring, int slot, int width, int height,
+                                              int channels, int stride, int64_t timestamp_us);
+
+// Same for I420 planes (see WEBRTC_RING_I420).
+WEBRTCSERVER_EXPORT int publishSharedRingI420Slot(cWebSharedRing ring, int slot, int width, int height,
+                                                  int stride, int64_t timestamp_us);
+
+// Reader: latest frame if newer than the cursor *last_published (0 at first), waiting
+// up to timeout_ms. Pixels stay valid until releaseSharedRingSlot. NULL on timeout.
+// Any number of readers, each with its own cursor, from at most
+// WEBRTC_SHARED_RING_MAX_READERS opened rings: NULL when there are more.
+WEBRTCSERVER_EXPORT const uint8_t* readSharedRingSlot(cWebSharedRing ring, uint32_t* last_published, int timeout_ms,
+                                                      int* slot, WebRTCSharedRingSlot* info);
+
+WEBRTCSERVER_EXPORT void releaseSharedRingSlot(cWebSharedRing ring, int slot);
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+
+// Live statistics of a WebRTCStreamer or a WebRTCCapturer.
+// Rates are measured over one second windows and fall to 0 when frames stop.
+//
+// Streamer: input = Send() calls, output = frames handed to the encoder,
+//           conversion = BGR/gray/BGRA to I420.
+// Capturer: input = decoded frames, output = Capture() calls,
+//           conversion = I420 to BGRA.
+typedef struct
+{
+	double   input_fps;
+	double   output_fps;
+	uint64_t dropped_frames;     // never consumed: replaced, rejected, expired or skipped
+	int      width;              // last output frame
+	int      height;
+	double   conversion_ms;      // average over the last window
+	int      viewers;            // connected peers
+	int      target_bitrate_bps; // sum over the peers, 0 on the receiving side
+	uint64_t rejected_frames;    // part of dropped_frames: queue full in WEBRTC_QUEUE_FIFO_FAIL mode
+	uint64_t expired_frames;     // part of dropped_frames: older than max_age_ms
+	int      queue_depth;        // frames waiting in the queue
+	uint64_t ring_frames;        // capturer: frames written to the shared memory ring
+	uint64_t ring_dropped;       // capturer: not written, every slot read or frame above the ring size
+} WebRTCStreamStats;
+
+// Decoded frame returned by WebRTCCapturer::CaptureNext.
+typedef struct
+{
+	uint64_t sequence;      // increases by one per frame published, from 1
+	int64_t  timestamp_us;  // steady clock, when the frame was decoded
+	uint32_t rtp_timestamp; // 90 kHz, from the sender
+	int      width;
+	int      height;
+} WebRTCFrameInfo;
+
+// One reader of the decoded frames of a WebRTCCapturer, see WebRTCCapturer::addReader.
+typedef struct
+{
+	uint64_t delivered_frames;
+	uint64_t dropped_frames;  // never read: replaced, rejected or expired
+	uint64_t rejected_frames; // part of dropped_frames: backlog full in WEBRTC_QUEUE_FIFO_FAIL mode
+	uint64_t expired_frames;  // part of dropped_frames: older than max_age_ms
+	int      queue_depth;     // frames waiting for this reader
+} WebRTCReaderStats;
+
+// Called when the first peer connects (1) and when the last one leaves (0).
+typedef void (*WebRTCSubscribersCallback)(void* user_data, int has_subscribers);
+
+// Decoded BGRA frame of a WebRTCCapturer, the pixels are valid during the call only.
+typedef void (*WebRTCFrameCallback)(void* user_data, const uint8_t* data, int width, int height, int stride);
@@ -1,9 +1,14 @@
 #pragma once
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <string>
 #include <opencv2/core/mat.hpp>
 #include "WebRTCServer_export.h"
+#include "WebRTCStats.h"
+#include "WebRTCQueuePolicy.h"
 
 class WEBRTCSERVER_EXPORT WebRTCStreamer
 {
@@ -12,9 +17,26 @@ protected:
 	std::shared_ptr<std::thread> webRTC_task;
 	std::mutex safe_quard;
 	std::shared_ptr<void> stack;
+	std::shared_ptr<void> stats;
+	// peer connection manager of the running server, guarded by stats_guard not to wait for Send
+	std::mutex stats_guard;
+	void* peers;
 	void* ws;
 	char * working_dir;
 	void *_contextWebRTC;
+	int media_udp_port;
+	int media_tcp_port;
+	std::atomic<int> subscribers;
+	std::mutex subscribers_guard;
+	std::function<void(bool)> on_subscribers;
+	std::shared_ptr<void> ring;
+	std::shared_ptr<std::thread> ring_task;
+	std::atomic<bool> ring_running;
+	std::mutex ring_guard;
+
+	void subscribersChanged(int peers);
+	void ingestRing();
+	bool enqueue(const cv::Mat& mat, bool shared);
 
 public:
 	WebRTCStreamer(int i_port, const char * work_dir);
@@ -25,7 +47,38 @@ public:
 
 	int stopWebRTCServer();
 
-	void Send(const cv::Mat& mat);
+	// Serve all peers from one UDP port (and one TCP port if not 0). Must be called before startWebRTCServer.
+	void setMediaPort(int udp_port, int tcp_port = 0);
+
+	// No-op while no peer is connected. The frame is copied: the next one may be
+	// captured into the same Mat.
+	// Returns false if the frame was not queued: no peer, queue full (WEBRTC_QUEUE_FIFO_FAIL)
+	// or the last peer left while waiting for room (WEBRTC_QUEUE_FIFO_BLOCK).
+	bool Send(const cv::Mat& mat);
+
+	// Same without copy when OpenCV owns the pixels, ROIs and padded rows included:
+	// write the next frame into a new Mat, not into this one. A Mat over external
+	// memory is still copied.
+	bool SendShared(const cv::Mat& mat);
+
+	// Latest frame only by default. False for an invalid policy.
+	bool setQueuePolicy(const WebRTCQueuePolicy& policy);
+
+	WebRTCStreamStats getStats();
+
+	bool hasSubscribers() const;
+
+	// Called from the server thread when the first peer connects (true) and when the last one leaves (false).
+	void setOnSubscribersChanged(std::function<void(bool)> callback);
+
+	// Create the shared memory ring `name` (see WebRTCSharedRing.h) and SendShared, from a
+	// thread of ours, each frame another process publishes in it. The slot pixels are
+	// queued as they are: use at least the queue max_depth + 3 slots, one more with
+	// WEBRTC_QUEUE_FIFO_BLOCK, or the process writing drops frames. Replaces the
+	// previous ring. False if it cannot be created (Linux only).
+	bool openSharedRing(const std::string& name, int slots, size_t slotBytes);
+
+	void closeSharedRing();
 
 };
 
@@ -33,7 +86,14 @@ typedef void * cWebStreamer;
 
 WEBRTCSERVER_EXPORT cWebStreamer newWebRTCStreamer(int port, const char * workdir);
 
-WEBRTCSERVER_EXPORT void sendNewFrame(cWebStreamer ctx, uint8_t* data, int width, int height, int channel);
+// 1 if the frame was queued, 0 otherwise (see WebRTCStreamer::Send).
+WEBRTCSERVER_EXPORT int sendNewFrame(cWebStreamer ctx, uint8_t* data, int width, int height, int channel);
+
+// Same with rows of stride bytes (padded rows, sub-rectangle of a bigger image).
+WEBRTCSERVER_EXPORT int sendNewFrameWithStride(cWebStreamer ctx, uint8_t* data, int width, int height, int channel, int stride);
+
+// 0 on success.
+WEBRTCSERVER_EXPORT int setStreamerQueuePolicy(cWebStreamer ctx, const WebRTCQueuePolicy* policy);
 
 WEBRTCSERVER_EXPORT void deleteWebRTCStreamer(cWebStreamer * ctx);
 
@@ -41,3 +101,40 @@ WEBRTCSERVER_EXPORT void startStreamerServer(cWebStreamer ctx);
 
 WEBRTCSERVER_EXPORT void stopStreamerServer(cWebStreamer ctx);
 
+WEBRTCSERVER_EXPORT void setStreamerMediaPort(cWebStreamer ctx, int udp_port, int tcp_port);
+
+// Fill stats, 0 on success.
+WEBRTCSERVER_EXPORT int getStreamerStats(cWebStreamer ctx, WebRTCStreamStats* stats);
+
+// 1 while at least one peer is connected, sendNewFrame is a no-op otherwise.
+WEBRTCSERVER_EXPORT int hasStreamerSubscribers(cWebStreamer ctx);
+
+WEBRTCSERVER_EXPORT void setStreamerSubscribersCallback(cWebStreamer ctx, WebRTCSubscribersCallback callback, void* user_data);
+
+// Stream the frames another process writes in the shared memory ring name, 0 on success.
+WEBRTCSERVER_EXPORT int openStreamerSharedRing(cWebStreamer ctx, const char* name, int slots, int slot_bytes);
+
+WEBRTCSERVER_EXPORT void closeStreamerSharedRing(cWebStreamer ctx);
+
+// Record the frame pipeline spans (streamer and capturer), off by default.
+WEBRTCSERVER_EXPORT void setFrameTracing(int enabled);
+
+// Write the recorded spans as Chrome trace JSON, 0 on success.
+WEBRTCSERVER_EXPORT int dumpFrameTrace(const char* path);
+
+// Minimum severity (0 sensitive, 1 verbose, 2 info, 3 warning, 4 error, 5 none) of a log
+// category: "webrtc", "signaling", "media" or "network". 0 on success.
+WEBRTCSERVER_EXPORT int setLogLevel(const char* category, int severity);
+
+// Split the colour conversion of frames of at least min_pixels into stripes run by
+// worker threads (shared by all the streams) and the calling one. 0 worker disables it.
+// Default: frames above 2560x1440, min(3, cores - 1) workers.
+WEBRTCSERVER_EXPORT void setConversionThreads(int workers, int min_pixels);
+
+// Clear the per-stage latency histograms of all streams and peers.
+WEBRTCSERVER_EXPORT void resetLatencyHistograms();
+
+// Copy the latency histograms as JSON into buffer (null terminated when size > 0).
+// Returns the length of the JSON, a value >= size means it was truncated.
+WEBRTCSERVER_EXPORT int dumpLatencyHistograms(char* buffer, int size);
+
@@ -0,0 +1,105 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** AsyncLog.h
+**
+** Logging off the media threads: messages go through a bounded lock-free
+** queue to a writer thread, and are dropped (and counted) when it is full.
+** webrtc logs are routed to it as a rtc::LogSink, our own call sites use
+** CLOG with a runtime level per category, or CLOG_EVERY_MS for per-frame
+** messages.
+** -------------------------------------------------------------------------*/
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "rtc_base/logging.h"
+
+enum LogCategory
+{
+	kLogWebRTC,      // webrtc internals, received through the rtc::LogSink
+	kLogSignaling,   // offers, answers, candidates, websocket and http handlers
+	kLogMedia,       // per-frame capture, conversion and rendering
+	kLogNetwork,     // sockets and ports
+	kLogCategoryCount
+};
+
+class AsyncLog : public rtc::LogSink
+{
+public:
+	static AsyncLog& instance();
+
+	// Replace the synchronous debug output by the writer thread.
+	void start();
+	void stop();
+
+	static void setLevel(LogCategory category, rtc::LoggingSeverity severity);
+	static bool setLevel(const std::string& category, rtc::LoggingSeverity severity);
+
+	static bool isEnabled(LogCategory category, rtc::LoggingSeverity severity)
+	{
+		return severity >= s_levels[category].load(std::memory_order_relaxed);
+	}
+
+	// true at most once per periodMs for a given call site
+	static bool sample(std::atomic<int64_t>& last, int periodMs);
+
+	bool push(std::string&& message);
+	uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+	// rtc::LogSink
+	void OnLogMessage(const std::string& message) override;
+
+private:
+	AsyncLog();
+	~AsyncLog() override;
+
+	void run();
+
+	static const size_t kQueueSize = 4096;
+
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		std::string         message;
+	};
+
+	std::unique_ptr<Cell[]>       m_cells;
+	std::atomic<size_t>           m_enqueuePos;
+	size_t                        m_dequeuePos;
+	std::atomic<uint64_t>         m_dropped;
+	std::atomic<bool>             m_running;
+	std::unique_ptr<std::thread>  m_writer;
+
+	static std::atomic<int>       s_levels[kLogCategoryCount];
+};
+
+// One message of our call sites, queued on destruction.
+class AsyncLogMessage
+{
+public:
+	AsyncLogMessage(LogCategory category, rtc::LoggingSeverity severity, const char* file, int line);
+	~AsyncLogMessage();
+
+	std::ostream& stream() { return m_stream; }
+
+private:
+	std::ostringstream m_stream;
+};
+
+#define CLOG(category, sev) \
+	if (!AsyncLog::isEnabled(category, rtc::sev)) {} \
+	else AsyncLogMessage(category, rtc::sev, __FILE__, __LINE__).stream()
+
+#define CLOG_EVERY_MS(category, sev, periodMs) \
+	if (!AsyncLog::isEnabled(category, rtc::sev) \
+	    || !AsyncLog::sample([]() -> std::atomic<int64_t>& { static std::atomic<int64_t> last(0); return last; }(), periodMs)) {} \
+	else AsyncLogMessage(category, rtc::sev, __FILE__, __LINE__).stream()
@@ -0,0 +1,50 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** Bgr24Converter.h
+**
+** One pass conversion of packed BGR24 (OpenCV CV_8UC3, libyuv "RGB24") to
+** I420 or NV12, BT.601 limited range with the coefficients of libyuv.
+** The row kernel is chosen at run time: AVX-512BW, AVX2, SSE4.1, NEON or
+** scalar.
+** -------------------------------------------------------------------------*/
+
+#include <cstdint>
+
+class Bgr24Converter
+{
+public:
+	enum Kernel
+	{
+		kScalar,
+		kSSE41,
+		kAVX2,
+		kAVX512,
+		kNEON
+	};
+
+	// kernel in use, the best one supported unless another was forced
+	static Kernel kernel();
+	static const char* kernelName(Kernel kernel);
+	static bool isSupported(Kernel kernel);
+	// false if the cpu does not support it
+	static bool setKernel(Kernel kernel);
+	// back to the best supported kernel
+	static void resetKernel();
+
+	// Any stride, odd width and height allowed.
+	static void toI420(const uint8_t* src, int src_stride,
+	                   uint8_t* dst_y, int stride_y,
+	                   uint8_t* dst_u, int stride_u,
+	                   uint8_t* dst_v, int stride_v,
+	                   int width, int height);
+
+	static void toNV12(const uint8_t* src, int src_stride,
+	                   uint8_t* dst_y, int stride_y,
+	                   uint8_t* dst_uv, int stride_uv,
+	                   int width, int height);
+};
@@ -31,6 +31,7 @@
 #include <list>
 #include <map>
 #include "CustomOpenCVCapturer.h"
+#include "FileVideoCapturer.h"
 
 
 class CapturerFactory {
@@ -103,7 +104,7 @@ public:
 		std::unique_ptr<cricket::VideoCapturer> capturer;
 		if (videourl == "VideoSender")
 		{
-			capturer.reset(new CustomOpenCVCapturer(i_stack));
+			capturer.reset(new CustomOpenCVCapturer(i_stack, videourl));
 		}
 
 		return capturer;
@@ -130,6 +131,11 @@ public:
 			capturer.reset(new WindowCapturer(videourl, opts));
 #endif	
 		}
+		else if ((videourl.find("file://") == 0) && (std::regex_match("file://", publishFilter)))
+		{
+			// Y4M or raw I420 (opts width, height), opts fps (0: as fast as possible) and loop
+			capturer = FileVideoCapturer::Create(videourl, opts);
+		}
 		else if (std::regex_match("videocap://", publishFilter)) {
 			cricket::WebRtcVideoDeviceCapturerFactory factory;
 			cricket::Device device = cricket::Device(videourl, 0);
@@ -1,7 +1,10 @@
 //@HIPE_LICENSE@
 #pragma once
 #include <queue>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <memory>
 #pragma warning(push, 0)
 #include <boost/thread.hpp>
 #pragma warning(pop)
@@ -10,16 +13,96 @@ namespace core
 {
 	namespace queue
 	{
+		// How push(data, stop) makes room, and how long an item may wait.
+		struct QueuePolicy
+		{
+			enum Mode
+			{
+				LatestOnly, // the items waiting are replaced by the new one
+				FifoBlock,  // the producer waits while maxDepth items are queued
+				FifoFail    // the new item is rejected while maxDepth items are queued
+			};
+
+			Mode    mode = LatestOnly;
+			size_t  maxDepth = 1;
+			int64_t maxAgeUs = 0; // older items are dropped unconsumed, 0 for no limit
+		};
+
 		template<typename Data>
 		class ConcurrentQueue
 		{
 		private:
-			std::queue<Data> the_queue;
+			struct Entry
+			{
+				Data    data;
+				int64_t pushedUs;
+			};
+
+			std::queue<Entry> the_queue;
 			mutable boost::mutex the_mutex;
 			boost::condition_variable the_condition_variable;
+			boost::condition_variable the_room_variable;
 			std::atomic<bool> _listerners;
+			std::atomic<int64_t> _lastPushUs;
+			std::atomic<int64_t> _lastPopUs;
+			std::atomic<int> _waiting;
+			QueuePolicy _policy;
+			std::atomic<uint64_t> _replaced;
+			std::atomic<uint64_t> _rejected;
+			std::atomic<uint64_t> _expired;
+			std::shared_ptr<void> _context;
+
+			static int64_t nowUs()
+			{
+				return std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+
+			// the_mutex must be held
+			void dropExpired()
+			{
+				if (_policy.maxAgeUs <= 0)
+					return;
+
+				int64_t oldest = nowUs() - _policy.maxAgeUs;
+				size_t expired = 0;
+				while (!the_queue.empty() && the_queue.front().pushedUs < oldest)
+				{
+					the_queue.pop();
+					expired++;
+				}
+				if (expired > 0)
+				{
+					_expired += expired;
+					the_room_variable.notify_all();
+				}
+			}
+
+			// the_mutex must be held, the queue not empty
+			void take(Data& popped_value, int64_t* pushedUs = nullptr)
+			{
+				popped_value = the_queue.front().data;
+				if (pushedUs)
+					*pushedUs = the_queue.front().pushedUs;
+				the_queue.pop();
+				the_room_variable.notify_one();
+			}
+
+			// a consumer blocked in a pop is asking for an item all along
+			struct Waiting
+			{
+				std::atomic<int>& count;
+				explicit Waiting(std::atomic<int>& c) : count(c) { count++; }
+				~Waiting() { count--; }
+			};
+
+			bool full() const
+			{
+				return _policy.mode != QueuePolicy::LatestOnly && the_queue.size() >= std::max<size_t>(_policy.maxDepth, 1);
+			}
+
 		public:
-			ConcurrentQueue() { _listerners = false; }
+			ConcurrentQueue() { _listerners = false; _lastPushUs = 0; _lastPopUs = 0; _waiting = 0; _replaced = 0; _rejected = 0; _expired = 0; }
 
 			void stopListening()
 			{
@@ -34,28 +117,95 @@ namespace core
 			void push(Data const& data)
 			{
 				boost::mutex::scoped_lock lock(the_mutex);
-				the_queue.push(data);
+				_lastPushUs = nowUs();
+				the_queue.push(Entry{ data, _lastPushUs });
+				lock.unlock();
+				the_condition_variable.notify_one();
+			}
+
+			// push following the policy, false if the item was rejected or if
+			// stop() returned true while waiting for room (FifoBlock)
+			template<typename Predicate>
+			bool push(Data const& data, Predicate stop)
+			{
+				boost::mutex::scoped_lock lock(the_mutex);
+				dropExpired();
+				if (_policy.mode == QueuePolicy::LatestOnly)
+				{
+					_replaced += the_queue.size();
+					std::queue<Entry> empty;
+					std::swap(the_queue, empty);
+				}
+				else if (_policy.mode == QueuePolicy::FifoFail && full())
+				{
+					_rejected++;
+					return false;
+				}
+				while (full())
+				{
+					if (stop())
+						return false;
+					// stop() may depend on time, look at it again from time to time
+					the_room_variable.timed_wait(lock, boost::posix_time::milliseconds(100));
+					dropExpired();
+				}
+
+				_lastPushUs = nowUs();
+				the_queue.push(Entry{ data, _lastPushUs });
 				lock.unlock();
 				the_condition_variable.notify_one();
+				return true;
+			}
+
+			void setPolicy(const QueuePolicy& policy)
+			{
+				{
+					boost::mutex::scoped_lock lock(the_mutex);
+					_policy = policy;
+					if (_policy.mode == QueuePolicy::LatestOnly)
+					{
+						while (the_queue.size() > 1)
+						{
+							the_queue.pop();
+							_replaced++;
+						}
+					}
+					dropExpired();
+				}
+				the_room_variable.notify_all();
+			}
+
+			QueuePolicy policy() const
+			{
+				boost::mutex::scoped_lock lock(the_mutex);
+				return _policy;
 			}
 
+			// items lost by the policy: replaced (LatestOnly), rejected (FifoFail), too old
+			uint64_t replacedCount() const { return _replaced; }
+			uint64_t rejectedCount() const { return _rejected; }
+			uint64_t expiredCount() const { return _expired; }
+
 			bool empty() const
 			{
 				boost::mutex::scoped_lock lock(the_mutex);
 				return the_queue.empty();
 			}
 
-			size_t size() 
+			size_t size()
 			{
 				boost::mutex::scoped_lock lock(the_mutex);
 				return the_queue.size();
 			}
 
-			void clear()
+			// returns the number of discarded items
+			size_t clear()
 			{
 				boost::mutex::scoped_lock lock(the_mutex);
-				std::queue<Data> empty;
+				std::queue<Entry> empty;
 				std::swap(the_queue, empty);
+				the_room_variable.notify_all();
+				return empty.size();
 			}
 
 			bool pop(Data& popped_value)
@@ -65,59 +215,118 @@ namespace core
 
 			bool try_pop(Data& popped_value)
 			{
+				_lastPopUs = nowUs();
 				boost::mutex::scoped_lock lock(the_mutex);
+				dropExpired();
 				if (the_queue.empty())
 				{
 					return false;
 				}
 
-				popped_value = the_queue.front();
-				the_queue.pop();
+				take(popped_value);
 				return true;
 			}
 
 			void wait_and_pop(Data& popped_value)
 			{
+				Waiting waiting(_waiting);
+				_lastPopUs = nowUs();
 				boost::mutex::scoped_lock lock(the_mutex);
+				dropExpired();
 				while (the_queue.empty())
 				{
 					the_condition_variable.wait(lock);
-					
+					dropExpired();
 				}
 
-				popped_value = the_queue.front();
-				the_queue.pop();
+				take(popped_value);
+			}
+
+			// blocks until an item is available or stop() returns true,
+			// wake() makes the waiters evaluate stop() again. pushedUs, if
+			// any, receives the steady clock time the item was pushed.
+			template<typename Predicate>
+			bool wait_and_pop(Data& popped_value, Predicate stop, int64_t* pushedUs = nullptr)
+			{
+				Waiting waiting(_waiting);
+				_lastPopUs = nowUs();
+				boost::mutex::scoped_lock lock(the_mutex);
+				dropExpired();
+				while (the_queue.empty() && !stop())
+				{
+					the_condition_variable.wait(lock);
+					dropExpired();
+				}
+				if (the_queue.empty())
+				{
+					return false;
+				}
+
+				take(popped_value, pushedUs);
+				return true;
+			}
+
+			void wake()
+			{
+				// taking the lock orders the caller's state change before a waiter's check
+				{
+					boost::mutex::scoped_lock lock(the_mutex);
+				}
+				the_condition_variable.notify_all();
+				the_room_variable.notify_all();
 			}
 
 			bool waituntil_and_pop(Data& popped_value)
 			{
+				Waiting waiting(_waiting);
+				_lastPopUs = nowUs();
 				boost::mutex::scoped_lock lock(the_mutex);
+				dropExpired();
 				while (the_queue.empty())
 				{
 					the_condition_variable.timed_wait(lock, boost::posix_time::milliseconds(1000));
-					if (!hasListener()) 
+					if (!hasListener())
 						return false;
+					dropExpired();
 				}
 
-				popped_value = the_queue.front();
-				the_queue.pop();
+				take(popped_value);
 				return true;
 			}
 
 			bool trypop_until(Data& popped_value, int ms)
 			{
+				Waiting waiting(_waiting);
+				_lastPopUs = nowUs();
 				boost::mutex::scoped_lock lock(the_mutex);
-				the_condition_variable.timed_wait(lock, boost::posix_time::milliseconds(ms));
+				dropExpired();
+				// a FIFO backlog is drained without waiting
+				if (the_queue.empty())
+				{
+					the_condition_variable.timed_wait(lock, boost::posix_time::milliseconds(ms));
+					dropExpired();
+				}
 				if (the_queue.empty())
 				{
 					return false;
 				}
 
-				popped_value = the_queue.front();
-				the_queue.pop();
+				take(popped_value);
 				return true;
 			}
-			
+
+			// steady clock time of the last push, in microseconds
+			int64_t lastPushTimeUs() const { return _lastPushUs; }
+
+			// steady clock time a consumer last asked for an item, now while one
+			// is waiting, 0 if never
+			int64_t lastPopTimeUs() const { return _waiting > 0 ? nowUs() : _lastPopUs.load(); }
+
+			// objects the owner attaches to the queue before sharing it, not
+			// changed afterwards: those who get the queue get them too
+			void setContext(std::shared_ptr<void> context) { _context = context; }
+			std::shared_ptr<void> context() const { return _context; }
+
 			void readyToListen() { _listerners = true; }
 
 			bool hasListener() { return _listerners; }
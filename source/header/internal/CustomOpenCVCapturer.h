@@ -4,15 +4,20 @@
 #include "renderer.h"
 #include "session.h"
 #include "ConcurrentQueue.h"
+#include "LatencyHistogram.h"
+#include "StreamStats.h"
+#include "StreamContext.h"
 #include <chrono>
 #include <thread>
 #include <media/base/videocapturer.h>
+#include <api/video/i420_buffer.h>
 
 class CustomOpenCVCapturer :
         public cricket::VideoCapturer
 {
 public:
-    CustomOpenCVCapturer(std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat> > i_stack);
+    CustomOpenCVCapturer(std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat> > i_stack,
+                         const std::string& streamLabel = "VideoSender");
     virtual ~CustomOpenCVCapturer();
  
     // cricket::VideoCapturer implementation.
@@ -25,6 +30,13 @@ public:
  
     void PushFrame();
 
+    // Gray, BGR or BGRA frame to I420, null if the format is not supported.
+    static rtc::scoped_refptr<webrtc::I420Buffer> ConvertToI420(const cv::Mat& popped);
+
+    // Same for the crop rectangle, scaled to width x height with libyuv's box filter.
+    static rtc::scoped_refptr<webrtc::I420Buffer> ConvertToI420(const cv::Mat& popped, const cv::Rect& crop,
+                                                                int width, int height);
+
 private:
 	std::unique_ptr<std::thread> renderer_task{};
 
@@ -32,13 +44,15 @@ private:
 
     std::chrono::system_clock::time_point start;
     std::chrono::system_clock::time_point end;
-    std::chrono::system_clock::time_point frame_timer;
-    int frame_counter;
 	std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat> > stack;
+	std::shared_ptr<LatencyHistogram> queue_wait;
+	std::shared_ptr<LatencyHistogram> conversion;
+	std::shared_ptr<StreamStats> stats;
 public:
 	void setStack(std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> concurrent_queue)
 	{
 		stack = concurrent_queue;
+		stats = StreamContext::of(concurrent_queue.get())->stats;
 	}
 };
 
@@ -0,0 +1,70 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** FileVideoCapturer.h
+**
+** file:// source: a Y4M (4:2:0) or raw I420 file mapped in memory, its
+** frames sent without copy, at the file frame rate or as fast as possible.
+** For load tests and benchmarks without a camera. POSIX only.
+** -------------------------------------------------------------------------*/
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <media/base/videocapturer.h>
+#include <api/video/video_frame_buffer.h>
+
+class FileVideoCapturer :
+        public cricket::VideoCapturer
+{
+public:
+    // file:///path/clip.y4m, or a raw I420 file with opts width and height.
+    // opts fps overrides the frame rate (30 for raw files), 0 sends as fast as the
+    // encoder takes them. The file is sent in a loop unless opts loop is 0.
+    // Null if the file cannot be mapped or its format is not supported.
+    static std::unique_ptr<FileVideoCapturer> Create(const std::string& url,
+                                                     const std::map<std::string, std::string>& opts);
+    virtual ~FileVideoCapturer();
+
+    // cricket::VideoCapturer implementation.
+    virtual cricket::CaptureState Start(const cricket::VideoFormat& capture_format) override;
+    virtual void Stop() override;
+    virtual bool IsRunning() override;
+    virtual bool GetPreferredFourccs(std::vector<uint32_t>* fourccs) override;
+    virtual bool GetBestCaptureFormat(const cricket::VideoFormat& desired, cricket::VideoFormat* best_format) override;
+    virtual bool IsScreencast() const override;
+
+private:
+    struct Mapping;
+
+    FileVideoCapturer(std::shared_ptr<Mapping> mapping, std::vector<size_t> frames,
+                      int width, int height, double fps, bool loop);
+
+    void PushFrames();
+
+    // planes of the frame in the mapping, which the buffer keeps alive
+    rtc::scoped_refptr<webrtc::I420BufferInterface> WrapFrame(size_t index) const;
+
+    std::shared_ptr<Mapping> mapping;
+    std::vector<size_t>      frames; // offset of each frame in the mapping
+    int                      width;
+    int                      height;
+    double                   fps;
+    bool                     loop;
+
+    std::unique_ptr<std::thread> sender_task{};
+    std::atomic<bool>            now_sending;
+    // Stop() interrupts the wait for the next frame time
+    std::mutex                   wake_mutex;
+    std::condition_variable      wake;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** FrameQueuePolicy.h
+**
+** Glue between the public WebRTCQueuePolicy / WebRTCStreamStats and the
+** frame queue of a stream.
+** -------------------------------------------------------------------------*/
+
+#include <opencv2/core/mat.hpp>
+
+#include "WebRTCQueuePolicy.h"
+#include "WebRTCStats.h"
+#include "internal/ConcurrentQueue.h"
+
+// false for an unknown mode
+inline bool toQueuePolicy(const WebRTCQueuePolicy& policy, core::queue::QueuePolicy& result)
+{
+	switch (policy.mode)
+	{
+	case WEBRTC_QUEUE_LATEST_ONLY: result.mode = core::queue::QueuePolicy::LatestOnly; break;
+	case WEBRTC_QUEUE_FIFO_BLOCK: result.mode = core::queue::QueuePolicy::FifoBlock; break;
+	case WEBRTC_QUEUE_FIFO_FAIL: result.mode = core::queue::QueuePolicy::FifoFail; break;
+	default: return false;
+	}
+	result.maxDepth = policy.max_depth > 1 ? static_cast<size_t>(policy.max_depth) : 1;
+	result.maxAgeUs = policy.max_age_ms > 0 ? static_cast<int64_t>(policy.max_age_ms) * 1000 : 0;
+	return true;
+}
+
+// drop counters kept by the queue itself
+inline void addQueueStats(WebRTCStreamStats& stats, core::queue::ConcurrentQueue<cv::Mat>& queue)
+{
+	stats.rejected_frames = queue.rejectedCount();
+	stats.expired_frames = queue.expiredCount();
+	stats.dropped_frames += queue.replacedCount() + stats.rejected_frames + stats.expired_frames;
+	stats.queue_depth = static_cast<int>(queue.size());
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** FrameSequence.h
+**
+** Latest decoded frame of a stream with its sequence number, for readers
+** waiting for a frame newer than the one they processed, and broadcast of
+** the frames to registered readers: each one has its own queue of the shared
+** frames, with its own policy. In the StreamContext of the frame queue, so
+** that the renderer publishes where the WebRTCCapturer owning the queue reads.
+** -------------------------------------------------------------------------*/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <opencv2/core/mat.hpp>
+
+#include "WebRTCStats.h"
+#include "internal/ConcurrentQueue.h"
+
+class FrameSequence
+{
+public:
+	struct Frame
+	{
+		cv::Mat  image;
+		uint64_t sequence = 0;     // 1 for the first frame
+		int64_t  timestampUs = 0;  // steady clock, when it was decoded
+		uint32_t rtpTimestamp = 0;
+	};
+
+	FrameSequence();
+
+	// Returns the sequence number given to the frame. Waits for room in the
+	// readers in FifoBlock mode, unless they did not read for idleUs.
+	uint64_t publish(const cv::Mat& image, int64_t timestampUs, uint32_t rtpTimestamp, int64_t idleUs);
+
+	// Blocks until a frame with a sequence above lastSequence exists, false after timeoutMs.
+	bool waitNewer(uint64_t lastSequence, int timeoutMs, Frame& frame);
+
+	// steady clock time a reader last asked for a frame, now while one is waiting, 0 if never
+	int64_t lastWaitTimeUs() const;
+
+	// Readers get every frame published after addReader, following their policy.
+	// Ids start at 1.
+	int addReader(const core::queue::QueuePolicy& policy);
+	// a read waiting on this reader returns false
+	void removeReader(int reader);
+	// false after timeoutMs or for an unknown reader
+	bool read(int reader, int timeoutMs, Frame& frame);
+	bool readerStats(int reader, WebRTCReaderStats& stats) const;
+
+private:
+	struct Reader
+	{
+		core::queue::ConcurrentQueue<Frame> queue;
+		std::atomic<bool>                   removed{ false };
+		std::atomic<uint64_t>               delivered{ 0 };
+	};
+
+	std::shared_ptr<Reader> reader(int id) const;
+
+	mutable std::mutex      m_mutex;
+	std::condition_variable m_published;
+	Frame                   m_latest;
+	std::atomic<int>        m_waiting;
+	std::atomic<int64_t>    m_lastWaitUs;
+
+	mutable std::mutex                     m_readersMutex;
+	std::map<int, std::shared_ptr<Reader>> m_readers;
+	int                                    m_nextReader;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** FrameTrace.h
+**
+** Spans of the frame pipeline stages, recorded in a lock-free ring per thread
+** and exported as Chrome trace event JSON (chrome://tracing, Perfetto).
+** Always compiled, recording costs one relaxed load while disabled.
+** -------------------------------------------------------------------------*/
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+class FrameTrace
+{
+public:
+	static void setEnabled(bool enabled);
+
+	static bool enabled()
+	{
+		return s_enabled.load(std::memory_order_relaxed);
+	}
+
+	static int64_t nowUs();
+
+	// name must be a string literal, it is stored as a pointer
+	static void record(const char* name, int64_t beginUs, int64_t endUs, int64_t frameId = -1);
+
+	// {"traceEvents":[...]} of the events still in the rings
+	static std::string dumpChromeTrace();
+	static bool dumpChromeTrace(const std::string& path);
+
+	static void clear();
+
+private:
+	static std::atomic<bool> s_enabled;
+};
+
+// Scoped span, nothing is recorded when tracing was disabled at construction.
+class FrameTraceSpan
+{
+public:
+	explicit FrameTraceSpan(const char* name, int64_t frameId = -1)
+		: m_name(name), m_frameId(frameId), m_begin(FrameTrace::enabled() ? FrameTrace::nowUs() : -1)
+	{
+	}
+
+	~FrameTraceSpan()
+	{
+		if (m_begin >= 0)
+			FrameTrace::record(m_name, m_begin, FrameTrace::nowUs(), m_frameId);
+	}
+
+	void setFrameId(int64_t frameId) { m_frameId = frameId; }
+
+private:
+	const char* m_name;
+	int64_t     m_frameId;
+	int64_t     m_begin;
+};
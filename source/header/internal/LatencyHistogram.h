@@ -0,0 +1,106 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** LatencyHistogram.h
+**
+** Log-linear latency histograms (HDR style, 16 sub-buckets per power of two,
+** about 6% precision) recorded with relaxed atomics, and the registry that
+** names them by scope ("stream:<label>", "peer:<id>", ...) and stage.
+** -------------------------------------------------------------------------*/
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "jsoncpp/json.h"
+
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	// lock-free, values in microseconds
+	void record(int64_t us);
+	void reset();
+
+	uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+	int64_t percentile(double p) const;
+
+	// {"count", "min", "mean", "p50", "p90", "p99", "p999", "max"} in us
+	Json::Value toJson() const;
+
+	static int64_t nowUs();
+
+private:
+	static const int kSubBucketBits = 4;
+	static const int kSubBuckets = 1 << kSubBucketBits;
+	static const int kBucketCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+	static int bucketIndex(uint64_t value);
+	static uint64_t bucketUpperBound(int index);
+
+	std::atomic<uint64_t> m_buckets[kBucketCount];
+	std::atomic<uint64_t> m_count;
+	std::atomic<uint64_t> m_sum;
+	std::atomic<uint64_t> m_min;
+	std::atomic<uint64_t> m_max;
+};
+
+// Measures the scope lifetime into a histogram, if any.
+class ScopedLatency
+{
+public:
+	explicit ScopedLatency(LatencyHistogram* histogram)
+		: m_histogram(histogram), m_begin(histogram ? LatencyHistogram::nowUs() : 0)
+	{
+	}
+
+	~ScopedLatency()
+	{
+		if (m_histogram)
+			m_histogram->record(LatencyHistogram::nowUs() - m_begin);
+	}
+
+private:
+	LatencyHistogram* m_histogram;
+	int64_t           m_begin;
+};
+
+class LatencyRegistry
+{
+public:
+	static LatencyRegistry& instance();
+
+	// Look-up takes a lock: keep the returned histogram, record() does not.
+	std::shared_ptr<LatencyHistogram> get(const std::string& scope, const std::string& stage);
+
+	// clear the counts, and forget the histograms nobody records into anymore
+	void reset();
+
+	// forget a scope that is gone (a peer that hung up), holders keep their histograms
+	void remove(const std::string& scope);
+
+	// {"<scope>": {"<stage>": {...}}}
+	Json::Value toJson();
+	std::string dump();
+
+private:
+	std::mutex m_mutex;
+	std::map<std::string, std::map<std::string, std::shared_ptr<LatencyHistogram>>> m_histograms;
+};
+
+// stage names
+extern const char kLatencyQueueWait[];
+extern const char kLatencyConversion[];
+extern const char kLatencyEncode[];
+extern const char kLatencyNetworkRtt[];
+extern const char kLatencyDecode[];
+extern const char kLatencyRendererConversion[];
+extern const char kLatencyCaptureWait[];
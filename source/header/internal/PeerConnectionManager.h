@@ -18,7 +18,15 @@
 #include <thread>
 #include <opencv2/core/mat.hpp>
 #include <internal/ConcurrentQueue.h>
+#include <internal/SharedPortMux.h>
+#include <internal/TeardownExecutor.h>
+#include <internal/AsyncLog.h>
+#include <internal/LatencyHistogram.h>
+#include <internal/StreamRecorder.h>
 #include "api/peerconnectioninterface.h"
+#include "api/stats/rtcstats_objects.h"
+#include "p2p/client/basicportallocator.h"
+#include "rtc_base/network.h"
 
 #include "modules/audio_device/include/audio_device.h"
 
@@ -28,6 +36,15 @@
 
 class PeerConnectionManager {
 public:
+	// a shared video track and the number of PeerConnections it is added to
+	struct StreamEntry {
+		StreamEntry() : subscribers(0) {}
+		explicit StreamEntry(rtc::scoped_refptr<webrtc::VideoTrackInterface> i_track) : track(i_track), subscribers(0) {}
+
+		rtc::scoped_refptr<webrtc::VideoTrackInterface> track;
+		int                                             subscribers;
+	};
+
 	class VideoSink : public rtc::VideoSinkInterface<webrtc::VideoFrame> {
 	public:
 		VideoSink(webrtc::VideoTrackInterface* track) : m_track(track) {
@@ -42,7 +59,7 @@ public:
 		// VideoSinkInterface implementation
 		virtual void OnFrame(const webrtc::VideoFrame& video_frame) {
 			rtc::scoped_refptr<webrtc::I420BufferInterface> buffer(video_frame.video_frame_buffer()->ToI420());
-			RTC_LOG(LS_VERBOSE) << __FUNCTION__ << " frame:" << buffer->width() << "x" << buffer->height();
+			CLOG(kLogMedia, LS_VERBOSE) << __FUNCTION__ << " frame:" << buffer->width() << "x" << buffer->height();
 			
 		}
 
@@ -58,16 +75,19 @@ public:
 		}
 		virtual void OnSuccess()
 		{
+			if (!AsyncLog::isEnabled(kLogSignaling, rtc::LS_VERBOSE))
+				return;
+
 			std::string sdp;
 			if (m_pc->local_description())
 			{
 				m_pc->local_description()->ToString(&sdp);
-				RTC_LOG(INFO) << __FUNCTION__ << " Local SDP:" << sdp;
+				CLOG(kLogSignaling, LS_VERBOSE) << __FUNCTION__ << " Local SDP:" << sdp;
 			}
 			if (m_pc->remote_description())
 			{
 				m_pc->remote_description()->ToString(&sdp);
-				RTC_LOG(INFO) << __FUNCTION__ << " Remote SDP:" << sdp;
+				CLOG(kLogSignaling, LS_VERBOSE) << __FUNCTION__ << " Remote SDP:" << sdp;
 			}
 		}
 		virtual void OnFailure(const std::string& error)
@@ -89,9 +109,12 @@ public:
 		}
 		virtual void OnSuccess(webrtc::SessionDescriptionInterface* desc)
 		{
-			std::string sdp;
-			desc->ToString(&sdp);
-			RTC_LOG(INFO) << __FUNCTION__ << " type:" << desc->type() << " sdp:" << sdp;
+			if (AsyncLog::isEnabled(kLogSignaling, rtc::LS_VERBOSE))
+			{
+				std::string sdp;
+				desc->ToString(&sdp);
+				CLOG(kLogSignaling, LS_VERBOSE) << __FUNCTION__ << " type:" << desc->type() << " sdp:" << sdp;
+			}
 			m_pc->SetLocalDescription(SetSessionDescriptionObserver::Create(m_pc), desc);
 
 			if (funcOnSucess)
@@ -131,6 +154,46 @@ public:
 		Json::Value m_report;
 	};
 
+	// round trip time of the nominated candidate pair, into a latency histogram
+	class RoundTripTimeCallback : public webrtc::RTCStatsCollectorCallback {
+	public:
+		RoundTripTimeCallback(std::shared_ptr<LatencyHistogram> histogram) : m_histogram(histogram) {}
+
+	protected:
+		virtual void OnStatsDelivered(const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report) {
+			for (const webrtc::RTCStats& stats : *report) {
+				if (stats.type() != webrtc::RTCIceCandidatePairStats::kType)
+					continue;
+				const webrtc::RTCIceCandidatePairStats& pair = stats.cast_to<webrtc::RTCIceCandidatePairStats>();
+				if (pair.nominated.is_defined() && *pair.nominated && pair.current_round_trip_time.is_defined()) {
+					m_histogram->record(static_cast<int64_t>(*pair.current_round_trip_time * 1000000));
+				}
+			}
+		}
+
+		std::shared_ptr<LatencyHistogram> m_histogram;
+	};
+
+	// encoder target bitrate from the legacy bandwidth estimation report
+	class TargetBitrateObserver : public webrtc::StatsObserver {
+	public:
+		TargetBitrateObserver(std::shared_ptr<std::atomic<int>> bitrate) : m_bitrate(bitrate) {}
+
+		virtual void OnComplete(const webrtc::StatsReports& reports) {
+			for (const webrtc::StatsReport* report : reports) {
+				if (report->type() != webrtc::StatsReport::kStatsReportTypeBwe)
+					continue;
+				const webrtc::StatsReport::Value* value = report->FindValue(webrtc::StatsReport::kStatsValueNameTargetEncBitrate);
+				if (value) {
+					*m_bitrate = value->int_val();
+				}
+			}
+		}
+
+	protected:
+		std::shared_ptr<std::atomic<int>> m_bitrate;
+	};
+
 	class DataChannelObserver : public webrtc::DataChannelObserver {
 	public:
 		DataChannelObserver(rtc::scoped_refptr<webrtc::DataChannelInterface> dataChannel) : m_dataChannel(dataChannel) {
@@ -159,15 +222,18 @@ public:
 
 	class PeerConnectionObserver : public webrtc::PeerConnectionObserver {
 	public:
-		PeerConnectionObserver(PeerConnectionManager* peerConnectionManager, const std::string& peerid, const webrtc::PeerConnectionInterface::RTCConfiguration & config)
+		PeerConnectionObserver(PeerConnectionManager* peerConnectionManager, const std::string& peerid, const webrtc::PeerConnectionInterface::RTCConfiguration & config,
+			std::unique_ptr<cricket::PortAllocator> allocator = nullptr, std::unique_ptr<rtc::PacketSocketFactory> socketFactory = nullptr)
 			: m_peerConnectionManager(peerConnectionManager)
 			, m_peerid(peerid)
+			, m_socketFactory(std::move(socketFactory))
 			, m_localChannel(NULL)
 			, m_remoteChannel(NULL)
-			, iceCandidateList_(Json::arrayValue) {
+			, iceCandidateList_(Json::arrayValue)
+			, m_targetBitrate(std::make_shared<std::atomic<int>>(0)) {
 			RTC_LOG(INFO) << __FUNCTION__ << "CreatePeerConnection peerid:" << peerid;
 			m_pc = m_peerConnectionManager->peer_connection_factory_->CreatePeerConnection(config,
-				NULL,
+				std::move(allocator),
 				NULL,
 				this);
 
@@ -183,6 +249,7 @@ public:
 		}
 
 		void SetOnIceCandidate(std::function<void(const webrtc::IceCandidateInterface*)> funcOnIceCandidate);;
+		void SetOnIceGatheringComplete(std::function<void()> funcOnIceGatheringComplete);
 
 		virtual ~PeerConnectionObserver() {
 			RTC_LOG(INFO) << __FUNCTION__;
@@ -210,6 +277,9 @@ public:
 		};
 
 		rtc::scoped_refptr<webrtc::PeerConnectionInterface> getPeerConnection() { return m_pc; };
+		const std::string& getPeerId() const { return m_peerid; }
+		// last sampled encoder target bitrate (bps), shared with the pending stats requests
+		std::shared_ptr<std::atomic<int>> getTargetBitrate() { return m_targetBitrate; }
 
 		// PeerConnectionObserver interface
 		virtual void OnAddStream(rtc::scoped_refptr<webrtc::MediaStreamInterface> stream) {
@@ -247,24 +317,30 @@ public:
 			{
 				iceCandidateList_.clear();
 				if (m_pc.get()) {
-					std::thread([this]() {
-						m_peerConnectionManager->hangUp(m_peerid);
-					}).detach();
+					// only unlinks the peer, Close() is run by the teardown executor
+					m_peerConnectionManager->hangUp(m_peerid);
 				}
 			}
 		}
 
 		virtual void OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState state) {
+			if ((state == webrtc::PeerConnectionInterface::kIceGatheringComplete) && funcOnIceGatheringComplete)
+			{
+				funcOnIceGatheringComplete();
+			}
 		}
 
 
 	private:
 		PeerConnectionManager* m_peerConnectionManager;
 		const std::string m_peerid;
+		// used by the port allocator of m_pc, must outlive it
+		std::unique_ptr<rtc::PacketSocketFactory> m_socketFactory;
 		rtc::scoped_refptr<webrtc::PeerConnectionInterface> m_pc;
 		DataChannelObserver*    m_localChannel;
 		DataChannelObserver*    m_remoteChannel;
 		Json::Value iceCandidateList_;
+		std::shared_ptr<std::atomic<int>> m_targetBitrate;
 		rtc::scoped_refptr<PeerConnectionStatsCollectorCallback> m_statsCallback;
 		std::unique_ptr<VideoSink>                               m_videosink;
 
@@ -277,6 +353,7 @@ public:
 	private:
 		std::function<void(PeerConnectionObserver *, rtc::scoped_refptr<webrtc::MediaStreamInterface>)> funcOnAddStream;
 		std::function<void(const webrtc::IceCandidateInterface*)> funcOnIceCandidate;
+		std::function<void()> funcOnIceGatheringComplete;
 
 	public:
 		void setFuncOnAddStream(
@@ -291,6 +368,7 @@ public:
 	virtual ~PeerConnectionManager();
 
 	bool InitializePeerConnection();
+	bool setSharedMediaPort(int udpPort, int tcpPort);
 
 	const Json::Value getIceCandidateList(const std::string &peerid);
 	const Json::Value addIceCandidate(const std::string &peerid, const Json::Value& jmessage);
@@ -313,6 +391,17 @@ public:
 	void              setAnswer(const std::string &peerid, const Json::Value& jmessage);
 	void		      startOpenCVStreaming(const std::string& peer_id, std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> i_stack);
 	void			  stopOpenCVStreaming(const std::string& peer_id);
+	// query the round trip time and target bitrate of every peer, signaling thread only
+	void              samplePeerStats();
+	// peers hung up whose PeerConnection is still being closed
+	size_t            pendingTeardowns();
+	int               getPeerCount();
+	// called with the number of peers when it changes, on the thread adding or removing the peer
+	void              setOnPeerCountChanged(std::function<void(int)> callback);
+	// sum of the last sampled target bitrates (bps)
+	int               getTargetBitrate();
+	// recorder of the encoded frames our decoders receive, see StreamRecorder
+	std::shared_ptr<RecorderTap> encodedRecorder() { return m_encodedRecorder; }
 
 
 protected:
@@ -324,21 +413,33 @@ protected:
 	rtc::scoped_refptr<webrtc::VideoTrackInterface> CreateVideoTrack(const std::string& videourl, const std::map<std::string, std::string>& opts, std::shared_ptr<core::queue::
 	                                                                 ConcurrentQueue<cv::Mat>> i_stack = std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>>());
 	
-	bool                                    streamStillUsed(const std::string & streamLabel);
+	void                                    releaseStream(const std::string & streamLabel);
+	void                                    peerCountChanged();
 	
 	rtc::scoped_refptr<webrtc::PeerConnectionInterface> getPeerConnection(const std::string& peerid);
+	std::function<void(webrtc::SessionDescriptionInterface*)> registerLocalDescription(const std::string& peerid,
+	                                                                   std::function<void(webrtc::SessionDescriptionInterface*)> i_funcOnSucess);
 public:
 	PeerConnectionManager::PeerConnectionObserver* getPeerConnectionObserver(const std::string& peerid);
 
 protected:
+	std::unique_ptr<rtc::Thread>                                              m_networkThread;
 	rtc::scoped_refptr<webrtc::AudioDeviceModule>                             audioDeviceModule_;
 	rtc::scoped_refptr<webrtc::AudioDecoderFactory>                           audioDecoderfactory_;
+	// before the factory, whose decoders write to it
+	std::shared_ptr<RecorderTap>                                              m_encodedRecorder;
 	rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface>                peer_connection_factory_;
 	std::mutex                                                                m_peerMapMutex;
 	std::map<std::string, PeerConnectionManager::PeerConnectionObserver* >    peer_connectionobs_map_;
-	std::map<std::string, rtc::scoped_refptr<webrtc::VideoTrackInterface>  >  stream_map_;
+	std::map<std::string, StreamEntry>                                        stream_map_;
 	std::mutex                                                                m_streamMapMutex;
 	std::list<std::string>                                                   iceServerList_;
 	std::map<std::string, std::string>                                         m_videoaudiomap;
 	const std::regex                                                          m_publishFilter;
+	std::unique_ptr<rtc::BasicNetworkManager>                                 m_networkManager;
+	std::unique_ptr<SharedPortMux>                                            m_portMux;
+	std::unique_ptr<TeardownExecutor>                                         m_teardown;
+	std::mutex                                                                m_peerCountMutex;
+	std::function<void(int)>                                                  m_onPeerCountChanged;
+	int                                                                       m_notifiedPeerCount = 0;
 };
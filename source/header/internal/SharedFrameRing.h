@@ -0,0 +1,91 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** SharedFrameRing.h
+**
+** Mapping of a WebRTCSharedRing (see WebRTCSharedRing.h for the layout and
+** the protocol), writer and reader side, one writer and many readers.
+** Linux only: create and open return null elsewhere.
+** -------------------------------------------------------------------------*/
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+
+#include "WebRTCSharedRing.h"
+
+class SharedFrameRing : public std::enable_shared_from_this<SharedFrameRing>
+{
+public:
+	// The creator unlinks the name when the ring is destroyed.
+	static std::shared_ptr<SharedFrameRing> create(const std::string& name, int slots, size_t slotBytes);
+	static std::shared_ptr<SharedFrameRing> open(const std::string& name);
+
+	~SharedFrameRing();
+
+	int slotCount() const;
+	size_t slotBytes() const;
+
+	// pixels of a frame, 0 if the format or the geometry is invalid
+	static size_t frameBytes(uint32_t format, int width, int height, int channels, int stride);
+
+	// writer: free slot, -1 if every slot is busy once the slots of crashed
+	// readers are taken back
+	int acquireWrite();
+	uint8_t* pixels(int slot);
+	bool publish(int slot, int width, int height, int channels, int stride, int64_t timestampUs,
+	             uint32_t format = WEBRTC_RING_PACKED);
+
+	// reader: latest slot if newer than the cursor lastPublished, held (shared with
+	// the other readers) until release, -1 after timeoutMs or when the reader
+	// table is full
+	int acquireRead(uint32_t& lastPublished, int timeoutMs);
+	// copy of the metadata of a held slot, false when the other process wrote a
+	// frame that does not fit in the slot: release it and ignore the frame
+	bool frameInfo(int slot, WebRTCSharedRingSlot& info) const;
+	void release(int slot);
+
+	// Latest frame as a Mat over the shared pixels: the slot is released, and the
+	// mapping kept, until the last copy of the Mat is gone. Empty after timeoutMs,
+	// and for an I420 frame (skipped).
+	cv::Mat readLatest(uint32_t& lastPublished, int timeoutMs);
+
+private:
+	SharedFrameRing(const std::string& name, void* base, size_t size, bool owner);
+
+	WebRTCSharedRingHeader* header() const;
+	WebRTCSharedRingSlot* slotAt(int slot) const;
+
+	// reader side, with m_holdsMutex held
+	bool lease();
+	bool hold(int slot);
+	void unhold(int slot);
+
+	// writer side: frees the slots held by the readers whose process is gone
+	void reclaimDeadReaders();
+
+	std::string m_name;
+	void*       m_base;
+	size_t      m_size;
+	bool        m_owner;
+
+	// geometry checked by open, not read again from the shared header
+	int    m_slotCount;
+	size_t m_slotBytes;
+	size_t m_slotStride;
+	size_t m_firstSlot;
+
+	// entry in the reader table, -1 until the first read; the slot state
+	// counts this reader once whatever the number of holds
+	std::mutex       m_holdsMutex;
+	int              m_reader;
+	std::vector<int> m_holds;
+};
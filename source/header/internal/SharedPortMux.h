@@ -0,0 +1,113 @@
+#pragma once
+#define _WINSOCKAPI_
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** SharedPortMux.h
+**
+** Serve every PeerConnection from one UDP port (and optionally one TCP port).
+** Incoming packets are demultiplexed on the local ICE ufrag carried in the
+** STUN USERNAME attribute, then on the remote address once ICE is checking.
+** -------------------------------------------------------------------------*/
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+
+#include "p2p/base/basicpacketsocketfactory.h"
+#include "rtc_base/asyncpacketsocket.h"
+#include "rtc_base/asynctcpsocket.h"
+#include "rtc_base/asyncudpsocket.h"
+#include "rtc_base/thread.h"
+#include "api/jsep.h"
+
+class SharedPortMux : public sigslot::has_slots<>
+{
+public:
+	class MuxedUdpSocket;
+	class MuxedTcpServerSocket;
+
+	// Socket factory handed to the port allocator of one PeerConnection.
+	class PeerSocketFactory : public rtc::BasicPacketSocketFactory
+	{
+	public:
+		PeerSocketFactory(SharedPortMux* mux, const std::string& peerid);
+
+		rtc::AsyncPacketSocket* CreateUdpSocket(const rtc::SocketAddress& local_address,
+		                                        uint16_t min_port, uint16_t max_port) override;
+		rtc::AsyncPacketSocket* CreateServerTcpSocket(const rtc::SocketAddress& local_address,
+		                                              uint16_t min_port, uint16_t max_port, int opts) override;
+
+	private:
+		SharedPortMux* m_mux;
+		const std::string m_peerid;
+	};
+
+	SharedPortMux(rtc::Thread* network_thread, int udp_port, int tcp_port);
+	virtual ~SharedPortMux();
+
+	int udpPort() const { return m_udpPort; }
+	int tcpPort() const { return m_tcpPort; }
+
+	std::unique_ptr<rtc::PacketSocketFactory> CreateSocketFactory(const std::string& peerid);
+
+	// bind the local ICE ufrag(s) of a session description to a peer
+	void registerSessionDescription(const std::string& peerid, const webrtc::SessionDescriptionInterface* desc);
+	void unregisterPeer(const std::string& peerid);
+
+	// Extract the local ufrag from a STUN USERNAME ("local:remote"), empty if not STUN.
+	static std::string GetStunLocalUfrag(const char* data, size_t size);
+
+protected:
+	struct UdpEndpoint
+	{
+		std::unique_ptr<rtc::AsyncPacketSocket> socket;
+		std::map<std::string, MuxedUdpSocket*> peers;                  // peerid -> virtual socket
+		std::map<rtc::SocketAddress, MuxedUdpSocket*> remotes;         // learned remote -> virtual socket
+		MuxedUdpSocket* sending;
+	};
+
+	struct TcpEndpoint
+	{
+		std::unique_ptr<rtc::AsyncSocket> listener;
+		std::map<std::string, MuxedTcpServerSocket*> peers;            // peerid -> virtual server socket
+	};
+
+	// called on the network thread
+	MuxedUdpSocket* CreateUdpSocket(const std::string& peerid, const rtc::SocketAddress& local_address);
+	MuxedTcpServerSocket* CreateTcpServerSocket(const std::string& peerid, const rtc::SocketAddress& local_address);
+	void releaseUdpSocket(MuxedUdpSocket* socket);
+	void releaseTcpServerSocket(MuxedTcpServerSocket* socket);
+	int sendUdp(MuxedUdpSocket* socket, const void* data, size_t size, const rtc::SocketAddress& addr,
+	            const rtc::PacketOptions& options);
+
+	UdpEndpoint* getUdpEndpoint(const rtc::IPAddress& ip);
+	TcpEndpoint* getTcpEndpoint(const rtc::IPAddress& ip);
+	std::string getPeerFromUfrag(const std::string& ufrag);
+
+	void OnUdpReadPacket(rtc::AsyncPacketSocket* socket, const char* data, size_t size,
+	                     const rtc::SocketAddress& remote_addr, const rtc::PacketTime& packet_time);
+	void OnUdpSentPacket(rtc::AsyncPacketSocket* socket, const rtc::SentPacket& sent_packet);
+	void OnUdpReadyToSend(rtc::AsyncPacketSocket* socket);
+	void OnTcpAccept(rtc::AsyncSocket* listener);
+	void OnTcpPendingPacket(rtc::AsyncPacketSocket* socket, const char* data, size_t size,
+	                        const rtc::SocketAddress& remote_addr, const rtc::PacketTime& packet_time);
+	void OnTcpPendingClose(rtc::AsyncPacketSocket* socket, int error);
+
+	rtc::Thread*                                              m_networkThread;
+	const int                                                 m_udpPort;
+	const int                                                 m_tcpPort;
+
+	// network thread only
+	std::map<rtc::IPAddress, std::unique_ptr<UdpEndpoint>>   m_udpEndpoints;
+	std::map<rtc::IPAddress, std::unique_ptr<TcpEndpoint>>   m_tcpEndpoints;
+	std::map<rtc::AsyncPacketSocket*, std::unique_ptr<rtc::AsyncPacketSocket>> m_pendingTcp;
+
+	// shared with the signaling thread
+	std::mutex                                                m_ufragMutex;
+	std::map<std::string, std::string>                        m_ufragToPeer;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** SharedRingPublisher.h
+**
+** Decoded frames of a stream written to a SharedFrameRing for other
+** processes, in I420 or BGR. In the StreamContext of the frame queue, so
+** that the renderer publishes where the WebRTCCapturer owning the queue
+** opened the ring.
+** -------------------------------------------------------------------------*/
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "internal/SharedFrameRing.h"
+
+class SharedRingPublisher
+{
+public:
+	SharedRingPublisher();
+
+	// Replaces the ring being written. format is WEBRTC_RING_I420 or WEBRTC_RING_PACKED
+	// (BGR), slots are sized for maxWidth x maxHeight.
+	bool open(const std::string& name, int slots, int maxWidth, int maxHeight, uint32_t format);
+	void close();
+
+	// cheap, for the renderer to skip the I420 frame when no ring is open
+	bool isOpen() const { return m_open; }
+
+	// false if no slot is free or the frame does not fit (counted as dropped)
+	bool publish(const uint8_t* y, int strideY, const uint8_t* u, int strideU,
+	             const uint8_t* v, int strideV, int width, int height, int64_t timestampUs);
+
+	uint64_t publishedCount() const { return m_published; }
+	uint64_t droppedCount() const { return m_dropped; }
+
+private:
+	std::mutex                       m_mutex;
+	std::shared_ptr<SharedFrameRing> m_ring;
+	uint32_t                         m_format;
+	std::atomic<bool>                m_open;
+	std::atomic<uint64_t>            m_published;
+	std::atomic<uint64_t>            m_dropped;
+};
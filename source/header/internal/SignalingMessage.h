@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+#include "jsoncpp/json.h"
+
+/* ---------------------------------------------------------------------------
+**  Compact JSON encoding of the signaling messages.
+**  Reader and writer are kept per thread instead of being built per message.
+** -------------------------------------------------------------------------*/
+
+// Single line JSON, no indentation.
+std::string writeSignalingMessage(const Json::Value& message);
+
+bool readSignalingMessage(const std::string& payload, Json::Value& message);
+
+// {"candidate":{...}} for one candidate, {"candidates":[...]} for a batch, sent
+// only to the clients that connect with ?candidates=batch (any client may send it).
+Json::Value makeIceCandidatesMessage(const Json::Value& candidates);
@@ -0,0 +1,41 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** StreamContext.h
+**
+** Objects of a stream shared by the WebRTCStreamer/WebRTCCapturer owning its
+** frame queue and the capturer or renderer working on it. The owner attaches
+** them to the queue before handing it over, whoever gets the queue gets them.
+** -------------------------------------------------------------------------*/
+
+#include <memory>
+
+#include <opencv2/core/mat.hpp>
+
+#include "internal/ConcurrentQueue.h"
+#include "internal/StreamStats.h"
+#include "internal/FrameSequence.h"
+#include "internal/SharedRingPublisher.h"
+#include "internal/StreamRecorder.h"
+
+struct StreamContext
+{
+	typedef core::queue::ConcurrentQueue<cv::Mat> FrameQueue;
+
+	// new context of the queue, for its owner
+	static std::shared_ptr<StreamContext> attach(FrameQueue& queue);
+
+	// context of the queue, one of its own if the queue is null or has none
+	static std::shared_ptr<StreamContext> of(const FrameQueue* queue);
+
+	StreamContext();
+
+	const std::shared_ptr<StreamStats>         stats;
+	const std::shared_ptr<FrameSequence>       sequence;
+	const std::shared_ptr<SharedRingPublisher> sharedRing;
+	const std::shared_ptr<RecorderTap>         recorder;
+};
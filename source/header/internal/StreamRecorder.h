@@ -0,0 +1,129 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** StreamRecorder.h
+**
+** Archive of a received stream: decoded frames to Y4M, or the encoded frames
+** given to the decoder to IVF (VP8, VP9) or an Annex-B stream (H264). The
+** frames are copied into large chunks that a writer thread hands to the disk,
+** a full backlog drops frames instead of holding the media threads.
+**
+** RecorderTap is where the renderer (decoded frames, the tap is in the
+** StreamContext of the frame queue) and the decoders of a
+** PeerConnectionManager (encoded frames) find the recorder of the stream, if any.
+** -------------------------------------------------------------------------*/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "WebRTCRecorder.h"
+
+class StreamRecorder
+{
+public:
+	enum Format
+	{
+		Y4m,
+		Encoded
+	};
+
+	static const size_t kChunkBytes = 4 << 20;
+	static const size_t kDefaultBacklogBytes = 64 << 20;
+
+	// null if the file cannot be created
+	static std::shared_ptr<StreamRecorder> create(const std::string& path, Format format,
+	                                              size_t maxBacklogBytes = kDefaultBacklogBytes);
+
+	~StreamRecorder();
+
+	Format format() const { return m_format; }
+
+	// Y4m: the first frame gives the size, frames of another size are scaled to it
+	void writeI420(const uint8_t* y, int strideY, const uint8_t* u, int strideU,
+	               const uint8_t* v, int strideV, int width, int height);
+
+	// Encoded: codec is the SDP name, the frames before the first key frame and the
+	// frames of another codec than the first one are dropped. The file is the
+	// stream of one decoder: the first writer (an id, never 0) to give an accepted
+	// frame, the frames of any other one are dropped.
+	void writeEncoded(uint64_t writer, const std::string& codec, const uint8_t* data, size_t size,
+	                  uint32_t rtpTimestamp, int width, int height, bool keyFrame);
+
+	// writes the backlog, completes the IVF header and closes the file; later frames are dropped
+	void close();
+
+	WebRTCRecorderStats stats() const;
+
+private:
+	// not initialised: every byte reserved is written by a frame
+	struct Chunk
+	{
+		explicit Chunk(size_t bytes) : data(new uint8_t[bytes]), capacity(bytes), used(0) {}
+
+		std::unique_ptr<uint8_t[]> data;
+		size_t                     capacity;
+		size_t                     used;
+	};
+
+	StreamRecorder(FILE* file, Format format, size_t maxBacklogBytes);
+
+	// size bytes at the end of the backlog, null when it is full; m_mutex held
+	uint8_t* reserve(size_t size);
+	void writeLoop();
+
+	FILE*  m_file;
+	Format m_format;
+	size_t m_maxBacklog;
+
+	mutable std::mutex                 m_mutex;
+	std::condition_variable            m_ready;
+	std::unique_ptr<Chunk>             m_current;
+	std::deque<std::unique_ptr<Chunk>> m_full;
+	std::unique_ptr<Chunk>             m_spare;
+	size_t                             m_backlog;
+	bool                               m_closing;
+	std::thread                        m_writer;
+	std::mutex                         m_closeMutex;
+
+	// stream, m_mutex held
+	int         m_width;
+	int         m_height;
+	std::string m_codec;
+	uint64_t    m_writer; // 0 until the first encoded frame
+	bool        m_waitKey; // the first frame, or a frame after a drop, must be a key frame
+	uint32_t    m_lastRtp;
+	uint64_t    m_pts;
+	uint32_t    m_ivfFrames;
+
+	std::atomic<uint64_t> m_frames;
+	std::atomic<uint64_t> m_dropped;
+	std::atomic<uint64_t> m_bytes;
+};
+
+class RecorderTap
+{
+public:
+	RecorderTap();
+
+	void set(std::shared_ptr<StreamRecorder> recorder);
+
+	// cheap, checked for each frame before get()
+	bool active() const { return m_active; }
+	std::shared_ptr<StreamRecorder> get() const;
+
+private:
+	mutable std::mutex              m_mutex;
+	std::shared_ptr<StreamRecorder> m_recorder;
+	std::atomic<bool>               m_active;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** StreamStats.h
+**
+** Frame counters of a stream, shared by whoever produces and consumes its
+** frame queue: the WebRTCStreamer/WebRTCCapturer owning the queue hands them
+** to the capturer and the renderer in its StreamContext.
+** -------------------------------------------------------------------------*/
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+#include "WebRTCStats.h"
+
+// Frames per second and average cost over one second windows.
+// Any number of writers and readers.
+class FrameRate
+{
+public:
+	FrameRate();
+
+	void tick(int64_t nowUs, int64_t costUs = 0);
+
+	double rate(int64_t nowUs) const;
+	double averageCostUs(int64_t nowUs) const;
+
+private:
+	static const int64_t kWindowUs = 1000000;
+
+	bool stale(int64_t nowUs) const;
+
+	std::mutex m_mutex; // the window being counted
+	int64_t m_windowStart;
+	int64_t m_frames;
+	int64_t m_costUs;
+	std::atomic<int64_t> m_windowEnd;
+	std::atomic<double>  m_rate;
+	std::atomic<double>  m_averageCostUs;
+};
+
+class StreamStats
+{
+public:
+	void onInput();
+	void onDropped(size_t frames);
+	void onOutput(int width, int height);
+	void onConversion(int64_t us);
+
+	// viewers and target bitrate are not known here, the caller fills them
+	WebRTCStreamStats snapshot() const;
+
+private:
+	FrameRate             m_input;
+	FrameRate             m_output;
+	FrameRate             m_conversion;
+	std::atomic<uint64_t> m_dropped{ 0 };
+	std::atomic<int>      m_width{ 0 };
+	std::atomic<int>      m_height{ 0 };
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** StripePool.h
+**
+** Small process wide thread pool splitting the work on one frame (colour
+** conversion of horizontal stripes) between its workers and the caller.
+** -------------------------------------------------------------------------*/
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class StripePool
+{
+public:
+	explicit StripePool(size_t workers);
+	~StripePool();
+
+	size_t workers() const { return m_workers.size(); }
+
+	// Run task(0) .. task(count - 1), the calling thread takes its share.
+	// Returns when all of them are done.
+	void parallelFor(int count, const std::function<void(int)>& task);
+
+	// Shared pool, null when striping is disabled (0 worker).
+	static std::shared_ptr<StripePool> shared();
+
+	// Frames of at least minPixels are split, workers 0 disables striping.
+	// Conversions running meanwhile finish on the previous pool.
+	static void configure(size_t workers, int64_t minPixels);
+	static int64_t minPixels();
+
+protected:
+	struct Job
+	{
+		const std::function<void(int)>* task;
+		int count;
+		int next;
+		int done;
+	};
+
+	void run();
+	// m_mutex must be held, false when every index is taken
+	bool take(Job* job, int& index);
+
+	std::mutex                m_mutex;
+	std::condition_variable   m_jobReady;
+	std::condition_variable   m_jobDone;
+	std::deque<Job*>          m_jobs;
+	std::vector<std::thread>  m_workers;
+	bool                      m_stop;
+};
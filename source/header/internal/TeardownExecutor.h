@@ -0,0 +1,46 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** TeardownExecutor.h
+**
+** Fixed set of worker threads closing and destroying PeerConnections, so that
+** a mass disconnect neither spawns one thread per peer nor runs Close() under
+** the peer map lock.
+** -------------------------------------------------------------------------*/
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TeardownExecutor
+{
+public:
+	explicit TeardownExecutor(size_t workers);
+	~TeardownExecutor();
+
+	void post(std::function<void()> task);
+
+	// Wait until every posted task is done. onWait is called periodically
+	// while waiting, e.g. to pump the messages of the calling thread.
+	void drain(std::function<void()> onWait);
+
+	size_t pending();
+
+protected:
+	void run();
+
+	std::mutex                           m_mutex;
+	std::condition_variable              m_taskReady;
+	std::condition_variable              m_taskDone;
+	std::deque<std::function<void()>>    m_tasks;
+	std::vector<std::thread>             m_workers;
+	size_t                               m_running;
+	bool                                 m_stop;
+};
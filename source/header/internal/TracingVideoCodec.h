@@ -0,0 +1,47 @@
+#pragma once
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** TracingVideoCodec.h
+**
+** Encoder and decoder factories wrapping the builtin ones, so that encode,
+** packetize and decode show up in the frame trace and latency histograms.
+** The decoders also hand the encoded frames to the recorder of the tap.
+** -------------------------------------------------------------------------*/
+
+#include <memory>
+#include <vector>
+
+#include "api/video_codecs/video_decoder_factory.h"
+#include "api/video_codecs/video_encoder_factory.h"
+#include "internal/StreamRecorder.h"
+
+class TracingVideoEncoderFactory : public webrtc::VideoEncoderFactory
+{
+public:
+	explicit TracingVideoEncoderFactory(std::unique_ptr<webrtc::VideoEncoderFactory> factory);
+
+	std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+	CodecInfo QueryVideoEncoder(const webrtc::SdpVideoFormat& format) const override;
+	std::unique_ptr<webrtc::VideoEncoder> CreateVideoEncoder(const webrtc::SdpVideoFormat& format) override;
+
+private:
+	std::unique_ptr<webrtc::VideoEncoderFactory> m_factory;
+};
+
+class TracingVideoDecoderFactory : public webrtc::VideoDecoderFactory
+{
+public:
+	TracingVideoDecoderFactory(std::unique_ptr<webrtc::VideoDecoderFactory> factory,
+	                           std::shared_ptr<RecorderTap> recorder = nullptr);
+
+	std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+	std::unique_ptr<webrtc::VideoDecoder> CreateVideoDecoder(const webrtc::SdpVideoFormat& format) override;
+
+private:
+	std::unique_ptr<webrtc::VideoDecoderFactory> m_factory;
+	std::shared_ptr<RecorderTap> m_recorder;
+};
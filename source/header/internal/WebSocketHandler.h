@@ -8,6 +8,11 @@
 
 std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> OnConnectHandler();
 
+// WHEP egress : POST /whep with an SDP offer, answered with the SDP of the streamed video.
+std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> OnHttpSenderHandler(std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> i_stack);
+// WHIP ingest : POST /whip with an SDP offer, received video is pushed into the stack.
+std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> OnHttpReceiverHandler(std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> stack);
+
 std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> OnCloseSenderHandler();
 std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> OnCloseReceiverHandler();
 
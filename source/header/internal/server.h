@@ -36,6 +36,8 @@ public:
 		iceServerList.push_back(std::string("stun:stun.l.google.com:19302"));
 		webrtc::AudioDeviceModule::AudioLayer audioLayer = webrtc::AudioDeviceModule::kDummyAudio;
 		peerConnectionManager = std::make_shared<PeerConnectionManager>(iceServerList, audioLayer, ".*");
+		// the count is applied on the asio thread, see peerCountChanged
+		peerConnectionManager->setOnPeerCountChanged([this](int peers) { peerCountChanged(peers); });
 		init_asio();
 		set_reuse_addr(true);
 	}
@@ -44,6 +46,7 @@ public:
 	{
 		std::lock_guard<std::mutex> lock(locker);
 
+		peerConnectionManager->setOnPeerCountChanged(nullptr);
 		peerConnectionManager.reset();
 	}
 
@@ -179,9 +182,36 @@ public:
 									});
 	}
 
+	// Dispatch periodically the rtc messages posted to the signaling thread,
+	// calls proxied from other threads (PeerConnection teardown) do not have
+	// to wait for the next websocket request. Without peers it slows down to
+	// kIdleSignalingPumpMs.
+	void startSignalingPump(long periodMs)
+	{
+		std::lock_guard<std::mutex> lock(locker);
+		signalingPumpPeriodMs = periodMs;
+		scheduleSignalingPump();
+	}
+
+	// called with the number of peers each time it changes, on the asio thread
+	void onPeerCountChanged(std::function<void(int)> handler)
+	{
+		std::lock_guard<std::mutex> lock(locker);
+		on_peer_count = handler;
+		if (on_peer_count)
+			on_peer_count(peerCount);
+	}
+
 	void stop()
 	{
 		std::lock_guard<std::mutex> lock(locker);
+		if (signalingPumpTimer)
+		{
+			// the pending timer would keep run() alive
+			signalingPumpTimer->cancel();
+			signalingPumpTimer.reset();
+			signalingPumpGeneration++;
+		}
 		websocketpp::lib::error_code ec;
 		stop_listening(ec);
 		if (ec)
@@ -211,6 +241,66 @@ public:
 protected:
 	std::shared_ptr<PeerConnectionManager> peerConnectionManager;
 	std::mutex locker;
+	timer_ptr signalingPumpTimer;
+	// a tick of an older timer, already expired when it was cancelled, does nothing
+	unsigned long signalingPumpGeneration = 0;
+	long signalingPumpPeriodMs = 0;
+	long signalingPumpElapsedMs = 0;
+	int peerCount = 0;
+	std::function<void(int)> on_peer_count;
+	static const long kPeerStatsPeriodMs = 1000;
+	static const long kIdleSignalingPumpMs = 1000;
+
+	// any thread, a pump tick included (locker held): applied on the asio thread
+	void peerCountChanged(int peers)
+	{
+		get_io_service().post([this, peers]()
+		{
+			std::lock_guard<std::mutex> lock(locker);
+			bool wasIdle = (peerCount == 0);
+			peerCount = peers;
+
+			// the new peer should not wait for the idle period
+			if (wasIdle && peers > 0 && signalingPumpTimer)
+				scheduleSignalingPump();
+			if (on_peer_count)
+				on_peer_count(peers);
+		});
+	}
+
+	// locker must be held, replaces the pending tick
+	void scheduleSignalingPump()
+	{
+		if (signalingPumpTimer)
+			signalingPumpTimer->cancel();
+		unsigned long generation = ++signalingPumpGeneration;
+
+		// a closing PeerConnection waits for its proxied calls on this thread
+		bool busy = peerCount > 0 || (peerConnectionManager && peerConnectionManager->pendingTeardowns() > 0);
+		long periodMs = busy ? signalingPumpPeriodMs : kIdleSignalingPumpMs;
+		signalingPumpTimer = set_timer(periodMs, [this, periodMs, generation](const websocketpp::lib::error_code& ec)
+		{
+			std::lock_guard<std::mutex> lock(locker);
+			if (ec || !signalingPumpTimer || generation != signalingPumpGeneration)
+			{
+				return;
+			}
+
+			rtc::Thread* thread = rtc::Thread::Current();
+			if (thread)
+			{
+				thread->ProcessMessages(0);
+			}
+
+			signalingPumpElapsedMs += periodMs;
+			if (peerConnectionManager && signalingPumpElapsedMs >= kPeerStatsPeriodMs)
+			{
+				signalingPumpElapsedMs = 0;
+				peerConnectionManager->samplePeerStats();
+			}
+			scheduleSignalingPump();
+		});
+	}
 };
 
 RTCWebScoketServer* RTCWebScoketServerInit(std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> con_callback,
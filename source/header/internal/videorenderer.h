@@ -7,21 +7,33 @@
 #include "api/video/video_frame.h"
 #include "api/mediastreaminterface.h"
 #include "PeerConnectionManager.h"
+#include "LatencyHistogram.h"
+#include "StreamStats.h"
+#include "FrameSequence.h"
+#include "SharedRingPublisher.h"
+#include "StreamRecorder.h"
+#include "StreamContext.h"
 
 class VideoRenderer : public PeerConnectionManager::VideoSink {
   public:
     explicit VideoRenderer(int width, int height,
         rtc::scoped_refptr<webrtc::VideoTrackInterface> track_to_render,
-		std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> i_stack);
+		std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> i_stack,
+        const std::string& peerid = "");
     virtual ~VideoRenderer();
 
     void OnFrame(const webrtc::VideoFrame& frame) override;
 
   protected:
     void SetSize(int width, int height);
-    std::unique_ptr<uint8_t[]> image;
    /* rtc::scoped_refptr<webrtc::VideoTrackInterface> rendered_track;*/
 	std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> stack;
+    std::shared_ptr<LatencyHistogram> conversion;
+    std::shared_ptr<StreamContext> context;
+    std::shared_ptr<StreamStats> stats;
+    std::shared_ptr<FrameSequence> sequence;
+    std::shared_ptr<SharedRingPublisher> shared_ring;
+    std::shared_ptr<RecorderTap> recorder;
 
     int width;
     int height;
@@ -3,19 +3,64 @@
 #include "internal/WebSocketHandler.h"
 #include "internal/server.h"
 #include "internal/ConcurrentQueue.h"
+#include "internal/FrameTrace.h"
+#include "internal/LatencyHistogram.h"
+#include "internal/StreamStats.h"
+#include "internal/FrameQueuePolicy.h"
+#include "internal/FrameSequence.h"
+#include "internal/SharedRingPublisher.h"
+#include "internal/StreamRecorder.h"
+#include "internal/StreamContext.h"
 
 
 
-WebRTCCapturer::WebRTCCapturer(int i_port, const char *workdir) : port(i_port)
+namespace
+{
+	void fillFrameInfo(const FrameSequence::Frame& frame, WebRTCFrameInfo* info)
+	{
+		if (!info)
+			return;
+
+		info->sequence = frame.sequence;
+		info->timestamp_us = frame.timestampUs;
+		info->rtp_timestamp = frame.rtpTimestamp;
+		info->width = frame.image.cols;
+		info->height = frame.image.rows;
+	}
+
+	// BGRA rows of width * 4 bytes, -1 if data is too small
+	int copyFrame(const cv::Mat& frame, uint8_t* data, int size)
+	{
+		if (!data || size < 0 || static_cast<size_t>(size) < frame.total() * frame.elemSize())
+			return -1;
+
+		cv::Mat packed(frame.rows, frame.cols, frame.type(), data);
+		frame.copyTo(packed);
+		return 1;
+	}
+}
+
+WebRTCCapturer::WebRTCCapturer(int i_port, const char *workdir) : port(i_port), peers(nullptr), media_udp_port(0), media_tcp_port(0), subscribers(0), delivery_generation(0)
 {
 	working_dir = strdup(workdir);
 	stack = std::make_shared < core::queue::ConcurrentQueue<cv::Mat> >();
+	capture_wait = LatencyRegistry::instance().get("capturer:" + std::to_string(port), kLatencyCaptureWait);
+	// the renderers of the server find them with the queue
+	std::shared_ptr<StreamContext> context = StreamContext::attach(*static_cast<core::queue::ConcurrentQueue<cv::Mat> *>(stack.get()));
+	stats = context->stats;
+	sequence = context->sequence;
+	shared_ring = context->sharedRing;
+	recorder_tap = context->recorder;
 	ws = nullptr;
 }
 
 WebRTCCapturer::~WebRTCCapturer()
 {
+	stopDelivery();
 	stopWebRTCServer();
+	// a renderer still alive must not keep the ring
+	closeSharedRing();
+	stopRecording();
 	free(working_dir);
 	working_dir = nullptr;
 }
@@ -39,14 +84,29 @@ int WebRTCCapturer::startWebRTCServer()
 			base_cert << this->working_dir;
 
 			_ws = RTCWebScoketServerInit(
-				// on http = on connection
-				OnConnectHandler(),
+				// on http = on connection + WHIP
+				OnHttpReceiverHandler(l_stack),
 				OnOpenReceiverHandler( l_stack),
 				OnCloseReceiverHandler(),
 				// on message
 				OnMessageReceiverHandler(),
 				base_cert.str());
+
+			if (media_udp_port > 0)
+				_ws->peer_connection_manager()->setSharedMediaPort(media_udp_port, media_tcp_port);
 			ws = _ws;
+			{
+				std::lock_guard<std::mutex> statsLock(stats_guard);
+				peers = _ws->peer_connection_manager().get();
+			}
+			_ws->onPeerCountChanged([this](int count) { subscribersChanged(count); });
+			{
+				// our decoders tap the encoded frames of a recording started before the server
+				std::lock_guard<std::mutex> recorderLock(recorder_guard);
+				std::shared_ptr<StreamRecorder> current = std::static_pointer_cast<StreamRecorder>(recorder);
+				if (current && current->format() == StreamRecorder::Encoded)
+					_ws->peer_connection_manager()->encodedRecorder()->set(current);
+			}
 
 			// Listen on port 9001
 			_ws->listen(port);
@@ -65,10 +125,15 @@ int WebRTCCapturer::startWebRTCServer()
 				std::lock_guard<std::mutex> lock(safe_quard);
 				_ws->stop();
 
+				{
+					std::lock_guard<std::mutex> statsLock(stats_guard);
+					peers = nullptr;
+				}
 				delete _ws;
 				_ws = nullptr;
 				ws = nullptr;
 			}
+			subscribersChanged(0);
 
 		} catch(websocketpp::exception const &e) {
 			std::cout << "Fail to init connection" << std::endl;
@@ -103,8 +168,17 @@ int WebRTCCapturer::stopWebRTCServer()
 	return 0;
 }
 
+void WebRTCCapturer::setMediaPort(int udp_port, int tcp_port)
+{
+	std::lock_guard<std::mutex> lock(safe_quard);
+	media_udp_port = udp_port;
+	media_tcp_port = tcp_port;
+}
+
 cv::Mat WebRTCCapturer::Capture()
 {
+	FrameTraceSpan span("Capture");
+	ScopedLatency latency(static_cast<LatencyHistogram *>(capture_wait.get()));
 	cv::Mat ret;
 	cv::Mat result;
 	int retry = 3;
@@ -130,7 +204,440 @@ cv::Mat WebRTCCapturer::Capture()
 			if (!ret.empty() && (ret.size().height > 0 && ret.size().width > 0))
 				break;
 		}
-		result = ret.clone();
+		// the renderer allocates a Mat per frame, nobody else holds it
+		result = ret;
+	}
+	if (!result.empty())
+		static_cast<StreamStats *>(stats.get())->onOutput(result.cols, result.rows);
+	return result;
+}
+
+cv::Mat WebRTCCapturer::CaptureNext(uint64_t lastSequence, int timeoutMs, WebRTCFrameInfo* info)
+{
+	FrameTraceSpan span("CaptureNext");
+	ScopedLatency latency(static_cast<LatencyHistogram *>(capture_wait.get()));
+
+	FrameSequence::Frame frame;
+	if (!static_cast<FrameSequence *>(sequence.get())->waitNewer(lastSequence, timeoutMs, frame))
+		return cv::Mat();
+
+	static_cast<StreamStats *>(stats.get())->onOutput(frame.image.cols, frame.image.rows);
+	fillFrameInfo(frame, info);
+	return frame.image;
+}
+
+int WebRTCCapturer::addReader(const WebRTCQueuePolicy& policy)
+{
+	core::queue::QueuePolicy queuePolicy;
+	if (!toQueuePolicy(policy, queuePolicy))
+		return -1;
+
+	return static_cast<FrameSequence *>(sequence.get())->addReader(queuePolicy);
+}
+
+void WebRTCCapturer::removeReader(int reader)
+{
+	static_cast<FrameSequence *>(sequence.get())->removeReader(reader);
+}
+
+cv::Mat WebRTCCapturer::Read(int reader, int timeoutMs, WebRTCFrameInfo* info)
+{
+	FrameTraceSpan span("Read");
+	FrameSequence::Frame frame;
+	if (!static_cast<FrameSequence *>(sequence.get())->read(reader, timeoutMs, frame))
+		return cv::Mat();
+
+	fillFrameInfo(frame, info);
+	return frame.image;
+}
+
+bool WebRTCCapturer::getReaderStats(int reader, WebRTCReaderStats* stats)
+{
+	return stats && static_cast<FrameSequence *>(sequence.get())->readerStats(reader, *stats);
+}
+
+void WebRTCCapturer::setOnFrame(std::function<void(const cv::Mat&)> callback)
+{
+	if (!callback)
+	{
+		stopDelivery();
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(delivery_guard);
+	on_frame = callback;
+	if (!delivery_task)
+	{
+		int generation = ++delivery_generation;
+		delivery_task = std::make_shared<std::thread>([this, generation]()
+		{
+			deliverFrames(generation);
+		});
+	}
+}
+
+void WebRTCCapturer::stopDelivery()
+{
+	std::shared_ptr<std::thread> task;
+	std::shared_ptr<std::thread> stopped;
+	{
+		std::lock_guard<std::mutex> lock(delivery_guard);
+		delivery_generation++;
+		on_frame = nullptr;
+		task.swap(delivery_task);
+		// stopped from the callback itself: the loop ends when it returns, the
+		// thread still uses this and is kept to be joined
+		if (task && task->get_id() == std::this_thread::get_id())
+		{
+			stopped.swap(stopped_delivery_task);
+			stopped_delivery_task.swap(task);
+		}
+		else if (stopped_delivery_task && stopped_delivery_task->get_id() != std::this_thread::get_id())
+		{
+			stopped.swap(stopped_delivery_task);
+		}
+	}
+	if (!task && !stopped)
+		return;
+
+	static_cast<core::queue::ConcurrentQueue<cv::Mat> *>(stack.get())->wake();
+	if (task && task->joinable())
+		task->join();
+	if (stopped && stopped->joinable())
+		stopped->join();
+}
+
+void WebRTCCapturer::deliverFrames(int generation)
+{
+	core::queue::ConcurrentQueue<cv::Mat>* l_stack = static_cast<core::queue::ConcurrentQueue<cv::Mat> *>(stack.get());
+	StreamStats* l_stats = static_cast<StreamStats *>(stats.get());
+	cv::Mat frame;
+
+	// no timeout: parked until the renderer publishes a frame or the delivery stops
+	while (l_stack->wait_and_pop(frame, [this, generation]() { return delivery_generation != generation; }))
+	{
+		std::function<void(const cv::Mat&)> callback;
+		{
+			std::lock_guard<std::mutex> lock(delivery_guard);
+			if (delivery_generation == generation)
+				callback = on_frame;
+		}
+		// stopped or replaced by a newer delivery thread
+		if (!callback)
+			break;
+		if (frame.empty())
+			continue;
+
+		FrameTraceSpan span("Deliver");
+		l_stats->onOutput(frame.cols, frame.rows);
+		callback(frame);
+		frame.release();
+	}
+}
+
+bool WebRTCCapturer::setQueuePolicy(const WebRTCQueuePolicy& policy)
+{
+	core::queue::QueuePolicy queuePolicy;
+	if (!toQueuePolicy(policy, queuePolicy))
+		return false;
+
+	static_cast<core::queue::ConcurrentQueue<cv::Mat> *>(stack.get())->setPolicy(queuePolicy);
+	return true;
+}
+
+bool WebRTCCapturer::publishSharedRing(const std::string& name, int slots, int maxWidth, int maxHeight,
+                                       WebRTCSharedRingFormat format)
+{
+	return static_cast<SharedRingPublisher *>(shared_ring.get())->open(name, slots, maxWidth, maxHeight, format);
+}
+
+void WebRTCCapturer::closeSharedRing()
+{
+	static_cast<SharedRingPublisher *>(shared_ring.get())->close();
+}
+
+bool WebRTCCapturer::startRecording(const std::string& path, WebRTCRecordFormat format)
+{
+	if (format != WEBRTC_RECORD_Y4M && format != WEBRTC_RECORD_ENCODED)
+		return false;
+
+	// the previous file is complete before a new one, maybe the same, is created
+	stopRecording();
+	std::shared_ptr<StreamRecorder> created = StreamRecorder::create(path,
+		format == WEBRTC_RECORD_ENCODED ? StreamRecorder::Encoded : StreamRecorder::Y4m);
+	if (!created)
+		return false;
+
+	std::lock_guard<std::mutex> lock(recorder_guard);
+	recorder = created;
+	if (created->format() == StreamRecorder::Y4m)
+	{
+		static_cast<RecorderTap *>(recorder_tap.get())->set(created);
+		return true;
+	}
+
+	std::lock_guard<std::mutex> statsLock(stats_guard);
+	PeerConnectionManager* manager = static_cast<PeerConnectionManager *>(peers);
+	if (manager)
+		manager->encodedRecorder()->set(created);
+	return true;
+}
+
+void WebRTCCapturer::stopRecording()
+{
+	std::shared_ptr<StreamRecorder> stopped;
+	{
+		std::lock_guard<std::mutex> lock(recorder_guard);
+		stopped = std::static_pointer_cast<StreamRecorder>(recorder);
+		recorder.reset();
+		static_cast<RecorderTap *>(recorder_tap.get())->set(nullptr);
+
+		std::lock_guard<std::mutex> statsLock(stats_guard);
+		PeerConnectionManager* manager = static_cast<PeerConnectionManager *>(peers);
+		if (manager)
+			manager->encodedRecorder()->set(nullptr);
+	}
+	// here and not on a media thread that would release it last
+	if (stopped)
+		stopped->close();
+}
+
+bool WebRTCCapturer::getRecorderStats(WebRTCRecorderStats* stats)
+{
+	std::lock_guard<std::mutex> lock(recorder_guard);
+	std::shared_ptr<StreamRecorder> current = std::static_pointer_cast<StreamRecorder>(recorder);
+	if (!current || !stats)
+		return false;
+
+	*stats = current->stats();
+	return true;
+}
+
+WebRTCStreamStats WebRTCCapturer::getStats()
+{
+	WebRTCStreamStats result = static_cast<StreamStats *>(stats.get())->snapshot();
+	addQueueStats(result, *static_cast<core::queue::ConcurrentQueue<cv::Mat> *>(stack.get()));
+	SharedRingPublisher* publisher = static_cast<SharedRingPublisher *>(shared_ring.get());
+	result.ring_frames = publisher->publishedCount();
+	result.ring_dropped = publisher->droppedCount();
+
+	std::lock_guard<std::mutex> lock(stats_guard);
+	PeerConnectionManager* manager = static_cast<PeerConnectionManager *>(peers);
+	if (manager)
+	{
+		result.viewers = manager->getPeerCount();
+		result.target_bitrate_bps = manager->getTargetBitrate();
 	}
 	return result;
 }
+
+bool WebRTCCapturer::hasSubscribers() const
+{
+	return subscribers.load() > 0;
+}
+
+void WebRTCCapturer::setOnSubscribersChanged(std::function<void(bool)> callback)
+{
+	std::lock_guard<std::mutex> lock(subscribers_guard);
+	on_subscribers = callback;
+}
+
+void WebRTCCapturer::subscribersChanged(int count)
+{
+	bool had = subscribers.exchange(count) > 0;
+	if (had == (count > 0))
+		return;
+
+	std::lock_guard<std::mutex> lock(subscribers_guard);
+	if (on_subscribers)
+		on_subscribers(count > 0);
+}
+
+cWebCapturer newWebRTCCapturer(int port, const char * workdir)
+{
+	return new WebRTCCapturer(port, workdir);
+}
+
+void deleteWebRTCCapturer(cWebCapturer * ctx)
+{
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(*ctx);
+
+	This->stopWebRTCServer();
+
+	delete This;
+
+	*ctx = nullptr;
+}
+
+void startCapturerServer(cWebCapturer ctx)
+{
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	This->startWebRTCServer();
+}
+
+void stopCapturerServer(cWebCapturer ctx)
+{
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	This->stopWebRTCServer();
+}
+
+int hasCapturerSubscribers(cWebCapturer ctx)
+{
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	return This->hasSubscribers() ? 1 : 0;
+}
+
+void setCapturerSubscribersCallback(cWebCapturer ctx, WebRTCSubscribersCallback callback, void* user_data)
+{
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	if (!callback)
+	{
+		This->setOnSubscribersChanged(nullptr);
+		return;
+	}
+	This->setOnSubscribersChanged([callback, user_data](bool hasSubscribers)
+	{
+		callback(user_data, hasSubscribers ? 1 : 0);
+	});
+}
+
+int getCapturerStats(cWebCapturer ctx, WebRTCStreamStats* stats)
+{
+	if (!ctx || !stats)
+		return -1;
+
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	*stats = This->getStats();
+	return 0;
+}
+
+int setCapturerQueuePolicy(cWebCapturer ctx, const WebRTCQueuePolicy* policy)
+{
+	if (!ctx || !policy)
+		return -1;
+
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	return This->setQueuePolicy(*policy) ? 0 : -1;
+}
+
+void setCapturerFrameCallback(cWebCapturer ctx, WebRTCFrameCallback callback, void* user_data)
+{
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	if (!callback)
+	{
+		This->setOnFrame(nullptr);
+		return;
+	}
+	This->setOnFrame([callback, user_data](const cv::Mat& frame)
+	{
+		callback(user_data, frame.ptr(), frame.cols, frame.rows, static_cast<int>(frame.step));
+	});
+}
+
+int captureNextFrame(cWebCapturer ctx, uint64_t last_sequence, int timeout_ms,
+                     uint8_t* data, int size, WebRTCFrameInfo* info)
+{
+	if (!ctx || !info)
+		return -1;
+
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	cv::Mat frame = This->CaptureNext(last_sequence, timeout_ms, info);
+	if (frame.empty())
+		return 0;
+
+	return copyFrame(frame, data, size);
+}
+
+int addCapturerReader(cWebCapturer ctx, const WebRTCQueuePolicy* policy)
+{
+	if (!ctx || !policy)
+		return -1;
+
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	return This->addReader(*policy);
+}
+
+void removeCapturerReader(cWebCapturer ctx, int reader)
+{
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	This->removeReader(reader);
+}
+
+int readCapturerFrame(cWebCapturer ctx, int reader, int timeout_ms,
+                      uint8_t* data, int size, WebRTCFrameInfo* info)
+{
+	if (!ctx || !info)
+		return -1;
+
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	cv::Mat frame = This->Read(reader, timeout_ms, info);
+	if (frame.empty())
+		return 0;
+
+	return copyFrame(frame, data, size);
+}
+
+int getCapturerReaderStats(cWebCapturer ctx, int reader, WebRTCReaderStats* stats)
+{
+	if (!ctx || !stats)
+		return -1;
+
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	return This->getReaderStats(reader, stats) ? 0 : -1;
+}
+
+int publishCapturerSharedRing(cWebCapturer ctx, const char* name, int slots, int max_width, int max_height, int format)
+{
+	if (!ctx || !name)
+		return -1;
+
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	return This->publishSharedRing(name, slots, max_width, max_height, static_cast<WebRTCSharedRingFormat>(format)) ? 0 : -1;
+}
+
+void closeCapturerSharedRing(cWebCapturer ctx)
+{
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	This->closeSharedRing();
+}
+
+int startCapturerRecording(cWebCapturer ctx, const char* path, int format)
+{
+	if (!ctx || !path)
+		return -1;
+
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	return This->startRecording(path, static_cast<WebRTCRecordFormat>(format)) ? 0 : -1;
+}
+
+void stopCapturerRecording(cWebCapturer ctx)
+{
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	This->stopRecording();
+}
+
+int getCapturerRecorderStats(cWebCapturer ctx, WebRTCRecorderStats* stats)
+{
+	if (!ctx || !stats)
+		return -1;
+
+	WebRTCCapturer*  This = static_cast<WebRTCCapturer*>(ctx);
+
+	return This->getRecorderStats(stats) ? 0 : -1;
+}
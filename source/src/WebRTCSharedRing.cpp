@@ -0,0 +1,96 @@
+#include "WebRTCSharedRing.h"
+#include "internal/SharedFrameRing.h"
+
+namespace
+{
+	SharedFrameRing* ringOf(cWebSharedRing ring)
+	{
+		return ring ? static_cast<std::shared_ptr<SharedFrameRing> *>(ring)->get() : nullptr;
+	}
+}
+
+cWebSharedRing openSharedRing(const char * name)
+{
+	if (!name)
+		return nullptr;
+
+	std::shared_ptr<SharedFrameRing> ring = SharedFrameRing::open(name);
+	if (!ring)
+		return nullptr;
+
+	return new std::shared_ptr<SharedFrameRing>(ring);
+}
+
+void closeSharedRing(cWebSharedRing * ring)
+{
+	if (!ring || !*ring)
+		return;
+
+	delete static_cast<std::shared_ptr<SharedFrameRing> *>(*ring);
+
+	*ring = nullptr;
+}
+
+uint8_t* acquireSharedRingSlot(cWebSharedRing ring, int* slot, int* capacity)
+{
+	SharedFrameRing* This = ringOf(ring);
+	if (!This || !slot)
+		return nullptr;
+
+	*slot = This->acquireWrite();
+	if (*slot < 0)
+		return nullptr;
+
+	if (capacity)
+		*capacity = static_cast<int>(This->slotBytes());
+	return This->pixels(*slot);
+}
+
+int publishSharedRingSlot(cWebSharedRing ring, int slot, int width, int height, int channels, int stride, int64_t timestamp_us)
+{
+	SharedFrameRing* This = ringOf(ring);
+	if (!This)
+		return -1;
+
+	return This->publish(slot, width, height, channels, stride, timestamp_us) ? 0 : -1;
+}
+
+int publishSharedRingI420Slot(cWebSharedRing ring, int slot, int width, int height, int stride, int64_t timestamp_us)
+{
+	SharedFrameRing* This = ringOf(ring);
+	if (!This)
+		return -1;
+
+	return This->publish(slot, width, height, 1, stride, timestamp_us, WEBRTC_RING_I420) ? 0 : -1;
+}
+
+const uint8_t* readSharedRingSlot(cWebSharedRing ring, uint32_t* last_published, int timeout_ms,
+                                  int* slot, WebRTCSharedRingSlot* info)
+{
+	SharedFrameRing* This = ringOf(ring);
+	if (!This || !last_published || !slot)
+		return nullptr;
+
+	*slot = This->acquireRead(*last_published, timeout_ms);
+	if (*slot < 0)
+		return nullptr;
+
+	// the frame of a writer that overflows its slot is skipped
+	WebRTCSharedRingSlot checked;
+	if (!This->frameInfo(*slot, checked))
+	{
+		This->release(*slot);
+		*slot = -1;
+		return nullptr;
+	}
+	if (info)
+		*info = checked;
+	return This->pixels(*slot);
+}
+
+void releaseSharedRingSlot(cWebSharedRing ring, int slot)
+{
+	SharedFrameRing* This = ringOf(ring);
+	if (This)
+		This->release(slot);
+}
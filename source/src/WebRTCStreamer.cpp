@@ -15,6 +15,16 @@
 #include "internal/CustomOpenCVCapturer.h"
 #include "internal/server.h"
 #include "internal/ConcurrentQueue.h"
+#include "internal/FrameTrace.h"
+#include "internal/AsyncLog.h"
+#include "internal/LatencyHistogram.h"
+#include "internal/StreamStats.h"
+#include "internal/StreamContext.h"
+#include "internal/FrameQueuePolicy.h"
+#include "internal/StripePool.h"
+#include "internal/SharedFrameRing.h"
+#include <algorithm>
+#include <string.h>
 #include <api/audio_codecs/builtin_audio_decoder_factory.h>
 #include <rtc_base/logging.h>
 
@@ -25,7 +35,7 @@ std::string GetCurrentWorkingDir(void) {
 	return current_working_dir;
 }
 
-WebRTCStreamer::WebRTCStreamer(int i_port, const char * work_dir) : port(i_port)
+WebRTCStreamer::WebRTCStreamer(int i_port, const char * work_dir) : port(i_port), peers(nullptr), media_udp_port(0), media_tcp_port(0), subscribers(0), ring_running(false)
 {
 	working_dir = strdup(work_dir);
 	
@@ -37,6 +47,8 @@ WebRTCStreamer::WebRTCStreamer(int i_port, const char * work_dir) : port(i_port)
 		core::queue::ConcurrentQueue<cv::Mat> * l_stack = static_cast<core::queue::ConcurrentQueue<cv::Mat> *>(ptr);
 		delete l_stack;
 	});
+	// the capturers of the server find them with the queue
+	stats = StreamContext::attach(*l_stack)->stats;
 
 	
 }
@@ -59,8 +71,8 @@ int WebRTCStreamer::startWebRTCServer()
 			std::stringstream base_cert;
 			base_cert << this->working_dir;
 			
-			_ws = RTCWebScoketServerInit(// on http = on connection
-				OnConnectHandler(),
+			_ws = RTCWebScoketServerInit(// on http = on connection + WHEP
+				OnHttpSenderHandler(l_stack),
 				OnOpenSenderHandler(),
 				//on_close
 				OnCloseSenderHandler(),
@@ -68,8 +80,15 @@ int WebRTCStreamer::startWebRTCServer()
 				OnMessageSenderHandler(l_stack),
 				base_cert.str());
 
+			if (media_udp_port > 0)
+				_ws->peer_connection_manager()->setSharedMediaPort(media_udp_port, media_tcp_port);
 		
 			ws = _ws;
+			{
+				std::lock_guard<std::mutex> statsLock(stats_guard);
+				peers = _ws->peer_connection_manager().get();
+			}
+			_ws->onPeerCountChanged([this](int count) { subscribersChanged(count); });
 
 
 			// Listen on port 9001
@@ -91,10 +110,15 @@ int WebRTCStreamer::startWebRTCServer()
 				std::lock_guard<std::mutex> lock(safe_quard);
 				_ws->stop();
 
+				{
+					std::lock_guard<std::mutex> statsLock(stats_guard);
+					peers = nullptr;
+				}
 				delete _ws;
 				_ws = nullptr;
 				ws = nullptr;
 			}
+			subscribersChanged(0);
 
 		} catch(websocketpp::exception const &e) {
 			std::cout << "Fail to init connection" << std::endl;
@@ -113,6 +137,7 @@ int WebRTCStreamer::startWebRTCServer()
 
 WebRTCStreamer::~WebRTCStreamer()
 {
+	closeSharedRing();
 	free(working_dir);
 	working_dir = nullptr;
 	stopWebRTCServer();
@@ -141,20 +166,131 @@ int WebRTCStreamer::stopWebRTCServer()
 	return 0;
 }
 
-void WebRTCStreamer::Send(const cv::Mat& mat)
+void WebRTCStreamer::setMediaPort(int udp_port, int tcp_port)
 {
 	std::lock_guard<std::mutex> lock(safe_quard);
+	media_udp_port = udp_port;
+	media_tcp_port = tcp_port;
+}
+
+bool WebRTCStreamer::Send(const cv::Mat& mat)
+{
+	return enqueue(mat, false);
+}
+
+bool WebRTCStreamer::SendShared(const cv::Mat& mat)
+{
+	return enqueue(mat, true);
+}
+
+bool WebRTCStreamer::enqueue(const cv::Mat& mat, bool shared)
+{
+	// nobody watches: no copy, no wake up of the capturer
+	if (subscribers.load(std::memory_order_relaxed) == 0)
+		return false;
+
+	FrameTraceSpan span("Send");
+	// shared pixels allocated by OpenCV are queued as they are, ROI and row
+	// padding included: the capturer reads them through the Mat step. Pixels
+	// wrapped from the caller memory (sendNewFrame) may be gone once we return.
+	cv::Mat toSend = (shared && mat.u) ? mat : mat.clone();
+
+	// the queue lives as long as the streamer: no safe_quard, a FIFO_BLOCK wait must not hold it
 	core::queue::ConcurrentQueue<cv::Mat>* l_stack = static_cast<core::queue::ConcurrentQueue<cv::Mat> *>(stack.get());
-	
-	cv::Mat toSend;
+	static_cast<StreamStats *>(stats.get())->onInput();
 
-	
-	mat.copyTo(toSend);
+	// the wait for room ends with the last viewer, subscribersChanged(0) clears the queue
+	return l_stack->push(toSend, [this]() { return subscribers.load() == 0; });
+}
 
-	
-	l_stack->clear();
+bool WebRTCStreamer::setQueuePolicy(const WebRTCQueuePolicy& policy)
+{
+	core::queue::QueuePolicy queuePolicy;
+	if (!toQueuePolicy(policy, queuePolicy))
+		return false;
+
+	static_cast<core::queue::ConcurrentQueue<cv::Mat> *>(stack.get())->setPolicy(queuePolicy);
+	return true;
+}
+
+WebRTCStreamStats WebRTCStreamer::getStats()
+{
+	WebRTCStreamStats result = static_cast<StreamStats *>(stats.get())->snapshot();
+	addQueueStats(result, *static_cast<core::queue::ConcurrentQueue<cv::Mat> *>(stack.get()));
+
+	std::lock_guard<std::mutex> lock(stats_guard);
+	PeerConnectionManager* manager = static_cast<PeerConnectionManager *>(peers);
+	if (manager)
+	{
+		result.viewers = manager->getPeerCount();
+		result.target_bitrate_bps = manager->getTargetBitrate();
+	}
+	return result;
+}
+
+bool WebRTCStreamer::hasSubscribers() const
+{
+	return subscribers.load() > 0;
+}
 
-	l_stack->push(toSend);
+void WebRTCStreamer::setOnSubscribersChanged(std::function<void(bool)> callback)
+{
+	std::lock_guard<std::mutex> lock(subscribers_guard);
+	on_subscribers = callback;
+}
+
+bool WebRTCStreamer::openSharedRing(const std::string& name, int slots, size_t slotBytes)
+{
+	closeSharedRing();
+
+	std::shared_ptr<SharedFrameRing> created = SharedFrameRing::create(name, slots, slotBytes);
+	if (!created)
+		return false;
+
+	std::lock_guard<std::mutex> lock(ring_guard);
+	ring = created;
+	ring_running = true;
+	ring_task = std::make_shared<std::thread>([this] { ingestRing(); });
+	return true;
+}
+
+void WebRTCStreamer::closeSharedRing()
+{
+	std::lock_guard<std::mutex> lock(ring_guard);
+	ring_running = false;
+	if (ring_task && ring_task->joinable())
+		ring_task->join();
+	ring_task.reset();
+	// the frames still queued keep the mapping alive
+	ring.reset();
+}
+
+void WebRTCStreamer::ingestRing()
+{
+	std::shared_ptr<SharedFrameRing> l_ring = std::static_pointer_cast<SharedFrameRing>(ring);
+	uint32_t lastPublished = 0;
+	while (ring_running)
+	{
+		// a Mat over the slot, released once the capturer converted it or when not queued
+		cv::Mat frame = l_ring->readLatest(lastPublished, 100);
+		if (!frame.empty())
+			SendShared(frame);
+	}
+}
+
+void WebRTCStreamer::subscribersChanged(int count)
+{
+	bool had = subscribers.exchange(count) > 0;
+	if (had == (count > 0))
+		return;
+
+	// the next viewer must not start with a stale frame
+	if (count == 0)
+		static_cast<core::queue::ConcurrentQueue<cv::Mat> *>(stack.get())->clear();
+
+	std::lock_guard<std::mutex> lock(subscribers_guard);
+	if (on_subscribers)
+		on_subscribers(count > 0);
 }
 
 cWebStreamer newWebRTCStreamer(int port, const char * working_dir)
@@ -162,19 +298,24 @@ cWebStreamer newWebRTCStreamer(int port, const char * working_dir)
 	return new WebRTCStreamer(port, working_dir);
 }
 
-void sendNewFrame(cWebStreamer ctx, uint8_t* data, int width, int height, int channel)
+int sendNewFrame(cWebStreamer ctx, uint8_t* data, int width, int height, int channel)
+{
+	return sendNewFrameWithStride(ctx, data, width, height, channel, width * channel);
+}
+
+int sendNewFrameWithStride(cWebStreamer ctx, uint8_t* data, int width, int height, int channel, int stride)
 {
 	cv::Mat mat;
 	if (channel == 1)
-		mat = cv::Mat(height, width, CV_8UC1, data);
+		mat = cv::Mat(height, width, CV_8UC1, data, stride);
 	else if (channel == 3)
-		mat = cv::Mat(height, width, CV_8UC3, data);
+		mat = cv::Mat(height, width, CV_8UC3, data, stride);
 	else if (channel == 4)
-		mat = cv::Mat(height, width, CV_8UC4, data);
+		mat = cv::Mat(height, width, CV_8UC4, data, stride);
 
 	WebRTCStreamer*  This = static_cast<WebRTCStreamer*>(ctx);
 
-	This->Send(mat);
+	return This->Send(mat) ? 1 : 0;
 }
 
 void deleteWebRTCStreamer(cWebStreamer * ctx)
@@ -203,3 +344,110 @@ void stopStreamerServer(cWebStreamer ctx)
 	This->stopWebRTCServer();
 }
 
+void setStreamerMediaPort(cWebStreamer ctx, int udp_port, int tcp_port)
+{
+	WebRTCStreamer*  This = static_cast<WebRTCStreamer*>(ctx);
+
+	This->setMediaPort(udp_port, tcp_port);
+}
+
+int hasStreamerSubscribers(cWebStreamer ctx)
+{
+	WebRTCStreamer*  This = static_cast<WebRTCStreamer*>(ctx);
+
+	return This->hasSubscribers() ? 1 : 0;
+}
+
+void setStreamerSubscribersCallback(cWebStreamer ctx, WebRTCSubscribersCallback callback, void* user_data)
+{
+	WebRTCStreamer*  This = static_cast<WebRTCStreamer*>(ctx);
+
+	if (!callback)
+	{
+		This->setOnSubscribersChanged(nullptr);
+		return;
+	}
+	This->setOnSubscribersChanged([callback, user_data](bool hasSubscribers)
+	{
+		callback(user_data, hasSubscribers ? 1 : 0);
+	});
+}
+
+int openStreamerSharedRing(cWebStreamer ctx, const char* name, int slots, int slot_bytes)
+{
+	if (!ctx || !name || slots < 1 || slot_bytes <= 0)
+		return -1;
+
+	WebRTCStreamer*  This = static_cast<WebRTCStreamer*>(ctx);
+
+	return This->openSharedRing(name, slots, static_cast<size_t>(slot_bytes)) ? 0 : -1;
+}
+
+void closeStreamerSharedRing(cWebStreamer ctx)
+{
+	WebRTCStreamer*  This = static_cast<WebRTCStreamer*>(ctx);
+
+	This->closeSharedRing();
+}
+
+int getStreamerStats(cWebStreamer ctx, WebRTCStreamStats* stats)
+{
+	if (!ctx || !stats)
+		return -1;
+
+	WebRTCStreamer*  This = static_cast<WebRTCStreamer*>(ctx);
+
+	*stats = This->getStats();
+	return 0;
+}
+
+int setStreamerQueuePolicy(cWebStreamer ctx, const WebRTCQueuePolicy* policy)
+{
+	if (!ctx || !policy)
+		return -1;
+
+	WebRTCStreamer*  This = static_cast<WebRTCStreamer*>(ctx);
+
+	return This->setQueuePolicy(*policy) ? 0 : -1;
+}
+
+void setFrameTracing(int enabled)
+{
+	FrameTrace::setEnabled(enabled != 0);
+}
+
+int dumpFrameTrace(const char* path)
+{
+	return FrameTrace::dumpChromeTrace(path) ? 0 : -1;
+}
+
+int setLogLevel(const char* category, int severity)
+{
+	if (!category || severity < rtc::LS_SENSITIVE || severity > rtc::LS_NONE)
+		return -1;
+
+	return AsyncLog::setLevel(category, static_cast<rtc::LoggingSeverity>(severity)) ? 0 : -1;
+}
+
+void setConversionThreads(int workers, int min_pixels)
+{
+	StripePool::configure(workers > 0 ? workers : 0, min_pixels > 0 ? min_pixels : 0);
+}
+
+void resetLatencyHistograms()
+{
+	LatencyRegistry::instance().reset();
+}
+
+int dumpLatencyHistograms(char* buffer, int size)
+{
+	std::string json = LatencyRegistry::instance().dump();
+	if (buffer && size > 0)
+	{
+		size_t length = std::min(json.size(), static_cast<size_t>(size - 1));
+		memcpy(buffer, json.data(), length);
+		buffer[length] = '\0';
+	}
+	return static_cast<int>(json.size());
+}
+
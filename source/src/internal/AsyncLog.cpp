@@ -0,0 +1,195 @@
+#include "internal/AsyncLog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include "rtc_base/timeutils.h"
+
+std::atomic<int> AsyncLog::s_levels[kLogCategoryCount] = {
+	{ rtc::LS_INFO },     // kLogWebRTC
+	{ rtc::LS_INFO },     // kLogSignaling
+	{ rtc::LS_WARNING },  // kLogMedia
+	{ rtc::LS_WARNING },  // kLogNetwork
+};
+
+static const char* const kCategoryNames[kLogCategoryCount] = { "webrtc", "signaling", "media", "network" };
+
+static const char* severityName(rtc::LoggingSeverity severity)
+{
+	switch (severity)
+	{
+	case rtc::LS_SENSITIVE: return "S";
+	case rtc::LS_VERBOSE:   return "V";
+	case rtc::LS_INFO:      return "I";
+	case rtc::LS_WARNING:   return "W";
+	case rtc::LS_ERROR:     return "E";
+	default:                return "?";
+	}
+}
+
+AsyncLog& AsyncLog::instance()
+{
+	static AsyncLog log;
+	return log;
+}
+
+AsyncLog::AsyncLog()
+	: m_cells(new Cell[kQueueSize])
+	, m_enqueuePos(0)
+	, m_dequeuePos(0)
+	, m_dropped(0)
+	, m_running(false)
+{
+	for (size_t i = 0; i < kQueueSize; i++)
+	{
+		m_cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+AsyncLog::~AsyncLog()
+{
+	stop();
+}
+
+void AsyncLog::start()
+{
+	if (m_running.exchange(true))
+		return;
+
+	m_writer.reset(new std::thread([this]()
+	{
+		run();
+	}));
+
+	rtc::LogMessage::LogToDebug(rtc::LS_NONE);
+	rtc::LogMessage::AddLogToStream(this, static_cast<rtc::LoggingSeverity>(s_levels[kLogWebRTC].load()));
+}
+
+void AsyncLog::stop()
+{
+	if (!m_running.exchange(false))
+		return;
+
+	rtc::LogMessage::RemoveLogToStream(this);
+	if (m_writer && m_writer->joinable())
+		m_writer->join();
+	m_writer.reset();
+}
+
+void AsyncLog::setLevel(LogCategory category, rtc::LoggingSeverity severity)
+{
+	s_levels[category].store(severity, std::memory_order_relaxed);
+
+	if (category == kLogWebRTC && instance().m_running)
+	{
+		rtc::LogMessage::RemoveLogToStream(&instance());
+		rtc::LogMessage::AddLogToStream(&instance(), severity);
+	}
+}
+
+bool AsyncLog::setLevel(const std::string& category, rtc::LoggingSeverity severity)
+{
+	for (int i = 0; i < kLogCategoryCount; i++)
+	{
+		if (category == kCategoryNames[i])
+		{
+			setLevel(static_cast<LogCategory>(i), severity);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool AsyncLog::sample(std::atomic<int64_t>& last, int periodMs)
+{
+	int64_t now = rtc::TimeMillis();
+	int64_t previous = last.load(std::memory_order_relaxed);
+	if (previous != 0 && now - previous < periodMs)
+		return false;
+
+	// only one thread wins the slot
+	return last.compare_exchange_strong(previous, now, std::memory_order_relaxed);
+}
+
+// bounded multi-producer queue (D. Vyukov), single consumer
+bool AsyncLog::push(std::string&& message)
+{
+	size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+	Cell* cell;
+	while (true)
+	{
+		cell = &m_cells[pos % kQueueSize];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+		if (diff == 0)
+		{
+			if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else
+		{
+			pos = m_enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	cell->message = std::move(message);
+	cell->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+void AsyncLog::OnLogMessage(const std::string& message)
+{
+	push(std::string(message));
+}
+
+void AsyncLog::run()
+{
+	uint64_t reportedDrops = 0;
+	while (true)
+	{
+		Cell& cell = m_cells[m_dequeuePos % kQueueSize];
+		size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		if (sequence == m_dequeuePos + 1)
+		{
+			std::string message = std::move(cell.message);
+			cell.message.clear();
+			cell.sequence.store(m_dequeuePos + kQueueSize, std::memory_order_release);
+			m_dequeuePos++;
+
+			fwrite(message.data(), 1, message.size(), stderr);
+			if (message.empty() || message.back() != '\n')
+				fputc('\n', stderr);
+			continue;
+		}
+
+		uint64_t drops = m_dropped.load(std::memory_order_relaxed);
+		if (drops != reportedDrops)
+		{
+			fprintf(stderr, "(log) %llu messages dropped\n", static_cast<unsigned long long>(drops - reportedDrops));
+			reportedDrops = drops;
+		}
+		fflush(stderr);
+
+		if (!m_running)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+AsyncLogMessage::AsyncLogMessage(LogCategory category, rtc::LoggingSeverity severity, const char* file, int line)
+{
+	const char* base = strrchr(file, '/');
+	m_stream << "(" << (base ? base + 1 : file) << ":" << line << ") [" << kCategoryNames[category] << "]["
+		<< severityName(severity) << "] ";
+}
+
+AsyncLogMessage::~AsyncLogMessage()
+{
+	AsyncLog::instance().push(m_stream.str());
+}
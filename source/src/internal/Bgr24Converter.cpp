@@ -0,0 +1,492 @@
+#include "internal/Bgr24Converter.h"
+
+#include <algorithm>
+#include <atomic>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BGR24_X86 1
+#include <immintrin.h>
+#define BGR24_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define BGR24_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+	// Converts the pixels [0, n) of a pair of rows, n being a multiple of the
+	// kernel block; dst_uv (NV12) or dst_u/dst_v (I420) receives the chroma.
+	// Returns n, the scalar rows finish the remaining pixels.
+	typedef int (*RowPair)(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1,
+	                       uint8_t* u, uint8_t* v, uint8_t* uv, int width);
+
+	inline uint8_t rgbToY(int r, int g, int b) { return static_cast<uint8_t>((66 * r + 129 * g + 25 * b + 0x1080) >> 8); }
+	inline uint8_t rgbToU(int r, int g, int b) { return static_cast<uint8_t>((112 * b - 74 * g - 38 * r + 0x8080) >> 8); }
+	inline uint8_t rgbToV(int r, int g, int b) { return static_cast<uint8_t>((112 * r - 94 * g - 18 * b + 0x8080) >> 8); }
+
+	// from pixel x to the end, the last column of an odd width is its own pair
+	void rowPairScalar(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1,
+	                   uint8_t* u, uint8_t* v, uint8_t* uv, int x, int width)
+	{
+		for (; x < width; x += 2)
+		{
+			int x1 = std::min(x + 1, width - 1);
+			const uint8_t* p00 = src0 + 3 * x;
+			const uint8_t* p01 = src0 + 3 * x1;
+			const uint8_t* p10 = src1 + 3 * x;
+			const uint8_t* p11 = src1 + 3 * x1;
+
+			y0[x] = rgbToY(p00[2], p00[1], p00[0]);
+			y0[x1] = rgbToY(p01[2], p01[1], p01[0]);
+			y1[x] = rgbToY(p10[2], p10[1], p10[0]);
+			y1[x1] = rgbToY(p11[2], p11[1], p11[0]);
+
+			int b = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+			int g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+			int r = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+			if (uv)
+			{
+				uv[x] = rgbToU(r, g, b);
+				uv[x + 1] = rgbToV(r, g, b);
+			}
+			else
+			{
+				u[x / 2] = rgbToU(r, g, b);
+				v[x / 2] = rgbToV(r, g, b);
+			}
+		}
+	}
+
+	int rowPairNone(const uint8_t*, const uint8_t*, uint8_t*, uint8_t*, uint8_t*, uint8_t*, uint8_t*, int)
+	{
+		return 0;
+	}
+
+#ifdef BGR24_X86
+	/* -----------------------------------------------------------------------
+	**  x86: 16 pixels (48 bytes) are split in B, G, R planes with pshufb,
+	**  the arithmetic is done on 16 bits lanes of 128, 256 or 512 bits.
+	** ---------------------------------------------------------------------*/
+	#define BGR24_DEINTERLEAVE_BODY                                                                            \
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));                                  \
+		__m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));                             \
+		__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));                             \
+		b = _mm_or_si128(_mm_or_si128(                                                                        \
+			_mm_shuffle_epi8(a, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),   \
+			_mm_shuffle_epi8(m, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))), \
+			_mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13))); \
+		g = _mm_or_si128(_mm_or_si128(                                                                        \
+			_mm_shuffle_epi8(a, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),  \
+			_mm_shuffle_epi8(m, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),  \
+			_mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14))); \
+		r = _mm_or_si128(_mm_or_si128(                                                                        \
+			_mm_shuffle_epi8(a, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),  \
+			_mm_shuffle_epi8(m, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))), \
+			_mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+
+	// the same body compiled for each instruction set, VEX/EVEX encoded in the wider kernels
+	BGR24_TARGET("sse4.1") inline void deinterleaveSSE41(const uint8_t* src, __m128i& b, __m128i& g, __m128i& r)
+	{
+		BGR24_DEINTERLEAVE_BODY
+	}
+
+	BGR24_TARGET("avx2") inline void deinterleaveAVX2(const uint8_t* src, __m128i& b, __m128i& g, __m128i& r)
+	{
+		BGR24_DEINTERLEAVE_BODY
+	}
+
+	BGR24_TARGET("avx512bw") inline void deinterleaveAVX512(const uint8_t* src, __m128i& b, __m128i& g, __m128i& r)
+	{
+		BGR24_DEINTERLEAVE_BODY
+	}
+
+	// y = (66 r + 129 g + 25 b + 0x1080) >> 8, wrapping 16 bits arithmetic is exact
+	BGR24_TARGET("sse4.1") inline __m128i lumaSSE41(__m128i r, __m128i g, __m128i b)
+	{
+		__m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+		y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+		return _mm_srli_epi16(_mm_add_epi16(y, _mm_set1_epi16(0x1080)), 8);
+	}
+
+	// rounded mean of the 2x2 blocks: pair sums of both rows
+	BGR24_TARGET("sse4.1") inline __m128i meanSSE41(__m128i row0, __m128i row1)
+	{
+		const __m128i ones = _mm_set1_epi8(1);
+		__m128i sum = _mm_add_epi16(_mm_maddubs_epi16(row0, ones), _mm_maddubs_epi16(row1, ones));
+		return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+	}
+
+	BGR24_TARGET("sse4.1") int rowPairSSE41(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1,
+	                                         uint8_t* u, uint8_t* v, uint8_t* uv, int width)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		int x = 0;
+		for (; x + 16 <= width; x += 16)
+		{
+			__m128i b0, g0, r0, b1, g1, r1;
+			deinterleaveSSE41(src0 + 3 * x, b0, g0, r0);
+			deinterleaveSSE41(src1 + 3 * x, b1, g1, r1);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), _mm_packus_epi16(
+				lumaSSE41(_mm_unpacklo_epi8(r0, zero), _mm_unpacklo_epi8(g0, zero), _mm_unpacklo_epi8(b0, zero)),
+				lumaSSE41(_mm_unpackhi_epi8(r0, zero), _mm_unpackhi_epi8(g0, zero), _mm_unpackhi_epi8(b0, zero))));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), _mm_packus_epi16(
+				lumaSSE41(_mm_unpacklo_epi8(r1, zero), _mm_unpacklo_epi8(g1, zero), _mm_unpacklo_epi8(b1, zero)),
+				lumaSSE41(_mm_unpackhi_epi8(r1, zero), _mm_unpackhi_epi8(g1, zero), _mm_unpackhi_epi8(b1, zero))));
+
+			__m128i mb = meanSSE41(b0, b1);
+			__m128i mg = meanSSE41(g0, g1);
+			__m128i mr = meanSSE41(r0, r1);
+			__m128i cu = _mm_sub_epi16(_mm_mullo_epi16(mb, _mm_set1_epi16(112)),
+				_mm_add_epi16(_mm_mullo_epi16(mg, _mm_set1_epi16(74)), _mm_mullo_epi16(mr, _mm_set1_epi16(38))));
+			__m128i cv = _mm_sub_epi16(_mm_mullo_epi16(mr, _mm_set1_epi16(112)),
+				_mm_add_epi16(_mm_mullo_epi16(mg, _mm_set1_epi16(94)), _mm_mullo_epi16(mb, _mm_set1_epi16(18))));
+			cu = _mm_srli_epi16(_mm_add_epi16(cu, _mm_set1_epi16(static_cast<short>(0x8080))), 8);
+			cv = _mm_srli_epi16(_mm_add_epi16(cv, _mm_set1_epi16(static_cast<short>(0x8080))), 8);
+
+			// 8 U then 8 V
+			__m128i packed = _mm_packus_epi16(cu, cv);
+			if (uv)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x), _mm_unpacklo_epi8(packed, _mm_srli_si128(packed, 8)));
+			}
+			else
+			{
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2), packed);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2), _mm_srli_si128(packed, 8));
+			}
+		}
+		return x;
+	}
+
+	BGR24_TARGET("avx2") inline __m256i lumaAVX2(__m128i r, __m128i g, __m128i b)
+	{
+		__m256i wr = _mm256_cvtepu8_epi16(r);
+		__m256i wg = _mm256_cvtepu8_epi16(g);
+		__m256i wb = _mm256_cvtepu8_epi16(b);
+		__m256i y = _mm256_add_epi16(_mm256_mullo_epi16(wr, _mm256_set1_epi16(66)), _mm256_mullo_epi16(wg, _mm256_set1_epi16(129)));
+		y = _mm256_add_epi16(y, _mm256_mullo_epi16(wb, _mm256_set1_epi16(25)));
+		return _mm256_srli_epi16(_mm256_add_epi16(y, _mm256_set1_epi16(0x1080)), 8);
+	}
+
+	BGR24_TARGET("avx2") inline __m256i meanAVX2(__m128i row0lo, __m128i row0hi, __m128i row1lo, __m128i row1hi)
+	{
+		const __m256i ones = _mm256_set1_epi8(1);
+		__m256i row0 = _mm256_inserti128_si256(_mm256_castsi128_si256(row0lo), row0hi, 1);
+		__m256i row1 = _mm256_inserti128_si256(_mm256_castsi128_si256(row1lo), row1hi, 1);
+		__m256i sum = _mm256_add_epi16(_mm256_maddubs_epi16(row0, ones), _mm256_maddubs_epi16(row1, ones));
+		return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+	}
+
+	// 32 pixels: two 16 pixels deinterleaves, arithmetic on 16 lanes
+	BGR24_TARGET("avx2") int rowPairAVX2(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1,
+	                                      uint8_t* u, uint8_t* v, uint8_t* uv, int width)
+	{
+		int x = 0;
+		for (; x + 32 <= width; x += 32)
+		{
+			__m128i b0[2], g0[2], r0[2], b1[2], g1[2], r1[2];
+			for (int half = 0; half < 2; half++)
+			{
+				deinterleaveAVX2(src0 + 3 * (x + 16 * half), b0[half], g0[half], r0[half]);
+				deinterleaveAVX2(src1 + 3 * (x + 16 * half), b1[half], g1[half], r1[half]);
+			}
+
+			// packus interleaves the 128 bits lanes, permute back to pixel order
+			__m256i luma0 = _mm256_packus_epi16(lumaAVX2(r0[0], g0[0], b0[0]), lumaAVX2(r0[1], g0[1], b0[1]));
+			__m256i luma1 = _mm256_packus_epi16(lumaAVX2(r1[0], g1[0], b1[0]), lumaAVX2(r1[1], g1[1], b1[1]));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(y0 + x), _mm256_permute4x64_epi64(luma0, 0xD8));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(y1 + x), _mm256_permute4x64_epi64(luma1, 0xD8));
+
+			__m256i mb = meanAVX2(b0[0], b0[1], b1[0], b1[1]);
+			__m256i mg = meanAVX2(g0[0], g0[1], g1[0], g1[1]);
+			__m256i mr = meanAVX2(r0[0], r0[1], r1[0], r1[1]);
+			__m256i cu = _mm256_sub_epi16(_mm256_mullo_epi16(mb, _mm256_set1_epi16(112)),
+				_mm256_add_epi16(_mm256_mullo_epi16(mg, _mm256_set1_epi16(74)), _mm256_mullo_epi16(mr, _mm256_set1_epi16(38))));
+			__m256i cv = _mm256_sub_epi16(_mm256_mullo_epi16(mr, _mm256_set1_epi16(112)),
+				_mm256_add_epi16(_mm256_mullo_epi16(mg, _mm256_set1_epi16(94)), _mm256_mullo_epi16(mb, _mm256_set1_epi16(18))));
+			cu = _mm256_srli_epi16(_mm256_add_epi16(cu, _mm256_set1_epi16(static_cast<short>(0x8080))), 8);
+			cv = _mm256_srli_epi16(_mm256_add_epi16(cv, _mm256_set1_epi16(static_cast<short>(0x8080))), 8);
+
+			// 16 U then 16 V
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(cu, cv), 0xD8);
+			__m128i pu = _mm256_castsi256_si128(packed);
+			__m128i pv = _mm256_extracti128_si256(packed, 1);
+			if (uv)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x), _mm_unpacklo_epi8(pu, pv));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x + 16), _mm_unpackhi_epi8(pu, pv));
+			}
+			else
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(u + x / 2), pu);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(v + x / 2), pv);
+			}
+		}
+		return x;
+	}
+
+	BGR24_TARGET("avx512bw") inline __m512i widenAVX512(const __m128i* plane)
+	{
+		__m256i lo = _mm256_inserti128_si256(_mm256_castsi128_si256(plane[0]), plane[1], 1);
+		return _mm512_cvtepu8_epi16(lo);
+	}
+
+	BGR24_TARGET("avx512bw") inline __m512i lumaAVX512(const __m128i* r, const __m128i* g, const __m128i* b)
+	{
+		__m512i y = _mm512_add_epi16(_mm512_mullo_epi16(widenAVX512(r), _mm512_set1_epi16(66)),
+		                             _mm512_mullo_epi16(widenAVX512(g), _mm512_set1_epi16(129)));
+		y = _mm512_add_epi16(y, _mm512_mullo_epi16(widenAVX512(b), _mm512_set1_epi16(25)));
+		return _mm512_srli_epi16(_mm512_add_epi16(y, _mm512_set1_epi16(0x1080)), 8);
+	}
+
+	BGR24_TARGET("avx512bw") inline __m512i combineAVX512(const __m128i* plane)
+	{
+		__m512i v = _mm512_castsi128_si512(plane[0]);
+		v = _mm512_inserti32x4(v, plane[1], 1);
+		v = _mm512_inserti32x4(v, plane[2], 2);
+		return _mm512_inserti32x4(v, plane[3], 3);
+	}
+
+	BGR24_TARGET("avx512bw") inline __m512i meanAVX512(const __m128i* row0, const __m128i* row1)
+	{
+		const __m512i ones = _mm512_set1_epi8(1);
+		__m512i sum = _mm512_add_epi16(_mm512_maddubs_epi16(combineAVX512(row0), ones),
+		                               _mm512_maddubs_epi16(combineAVX512(row1), ones));
+		return _mm512_srli_epi16(_mm512_add_epi16(sum, _mm512_set1_epi16(2)), 2);
+	}
+
+	// 64 pixels: four 16 pixels deinterleaves, arithmetic on 32 lanes
+	BGR24_TARGET("avx512bw") int rowPairAVX512(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1,
+	                                            uint8_t* u, uint8_t* v, uint8_t* uv, int width)
+	{
+		// packus interleaves the 128 bits lanes of its two operands
+		const __m512i order = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+		int x = 0;
+		for (; x + 64 <= width; x += 64)
+		{
+			__m128i b0[4], g0[4], r0[4], b1[4], g1[4], r1[4];
+			for (int quarter = 0; quarter < 4; quarter++)
+			{
+				deinterleaveAVX512(src0 + 3 * (x + 16 * quarter), b0[quarter], g0[quarter], r0[quarter]);
+				deinterleaveAVX512(src1 + 3 * (x + 16 * quarter), b1[quarter], g1[quarter], r1[quarter]);
+			}
+
+			__m512i luma0 = _mm512_packus_epi16(lumaAVX512(r0, g0, b0), lumaAVX512(r0 + 2, g0 + 2, b0 + 2));
+			__m512i luma1 = _mm512_packus_epi16(lumaAVX512(r1, g1, b1), lumaAVX512(r1 + 2, g1 + 2, b1 + 2));
+			_mm512_storeu_si512(y0 + x, _mm512_maskz_permutexvar_epi64(0xFF, order, luma0));
+			_mm512_storeu_si512(y1 + x, _mm512_maskz_permutexvar_epi64(0xFF, order, luma1));
+
+			__m512i mb = meanAVX512(b0, b1);
+			__m512i mg = meanAVX512(g0, g1);
+			__m512i mr = meanAVX512(r0, r1);
+			__m512i cu = _mm512_sub_epi16(_mm512_mullo_epi16(mb, _mm512_set1_epi16(112)),
+				_mm512_add_epi16(_mm512_mullo_epi16(mg, _mm512_set1_epi16(74)), _mm512_mullo_epi16(mr, _mm512_set1_epi16(38))));
+			__m512i cv = _mm512_sub_epi16(_mm512_mullo_epi16(mr, _mm512_set1_epi16(112)),
+				_mm512_add_epi16(_mm512_mullo_epi16(mg, _mm512_set1_epi16(94)), _mm512_mullo_epi16(mb, _mm512_set1_epi16(18))));
+			cu = _mm512_srli_epi16(_mm512_add_epi16(cu, _mm512_set1_epi16(static_cast<short>(0x8080))), 8);
+			cv = _mm512_srli_epi16(_mm512_add_epi16(cv, _mm512_set1_epi16(static_cast<short>(0x8080))), 8);
+
+			// 32 U then 32 V
+			__m512i packed = _mm512_maskz_permutexvar_epi64(0xFF, order, _mm512_packus_epi16(cu, cv));
+			__m256i pu = _mm512_maskz_extracti64x4_epi64(0xF, packed, 0);
+			__m256i pv = _mm512_maskz_extracti64x4_epi64(0xF, packed, 1);
+			if (uv)
+			{
+				for (int half = 0; half < 2; half++)
+				{
+					__m128i hu = half ? _mm256_extracti128_si256(pu, 1) : _mm256_castsi256_si128(pu);
+					__m128i hv = half ? _mm256_extracti128_si256(pv, 1) : _mm256_castsi256_si128(pv);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x + 32 * half), _mm_unpacklo_epi8(hu, hv));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x + 32 * half + 16), _mm_unpackhi_epi8(hu, hv));
+				}
+			}
+			else
+			{
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(u + x / 2), pu);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(v + x / 2), pv);
+			}
+		}
+		return x;
+	}
+#endif
+
+#ifdef BGR24_NEON
+	/* -----------------------------------------------------------------------
+	**  NEON: vld3 deinterleaves 16 pixels, widening multiply-accumulate
+	** ---------------------------------------------------------------------*/
+	inline uint8x8_t lumaNEON(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+	{
+		uint16x8_t y = vmull_u8(r, vdup_n_u8(66));
+		y = vmlal_u8(y, g, vdup_n_u8(129));
+		y = vmlal_u8(y, b, vdup_n_u8(25));
+		return vshrn_n_u16(vaddq_u16(y, vdupq_n_u16(0x1080)), 8);
+	}
+
+	inline uint16x8_t meanNEON(uint8x16_t row0, uint8x16_t row1)
+	{
+		uint16x8_t sum = vpadalq_u8(vpaddlq_u8(row0), row1);
+		return vshrq_n_u16(vaddq_u16(sum, vdupq_n_u16(2)), 2);
+	}
+
+	int rowPairNEON(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1,
+	                uint8_t* u, uint8_t* v, uint8_t* uv, int width)
+	{
+		int x = 0;
+		for (; x + 16 <= width; x += 16)
+		{
+			uint8x16x3_t p0 = vld3q_u8(src0 + 3 * x);
+			uint8x16x3_t p1 = vld3q_u8(src1 + 3 * x);
+
+			vst1q_u8(y0 + x, vcombine_u8(lumaNEON(vget_low_u8(p0.val[2]), vget_low_u8(p0.val[1]), vget_low_u8(p0.val[0])),
+			                             lumaNEON(vget_high_u8(p0.val[2]), vget_high_u8(p0.val[1]), vget_high_u8(p0.val[0]))));
+			vst1q_u8(y1 + x, vcombine_u8(lumaNEON(vget_low_u8(p1.val[2]), vget_low_u8(p1.val[1]), vget_low_u8(p1.val[0])),
+			                             lumaNEON(vget_high_u8(p1.val[2]), vget_high_u8(p1.val[1]), vget_high_u8(p1.val[0]))));
+
+			uint16x8_t mb = meanNEON(p0.val[0], p1.val[0]);
+			uint16x8_t mg = meanNEON(p0.val[1], p1.val[1]);
+			uint16x8_t mr = meanNEON(p0.val[2], p1.val[2]);
+			uint16x8_t cu = vsubq_u16(vmulq_n_u16(mb, 112), vaddq_u16(vmulq_n_u16(mg, 74), vmulq_n_u16(mr, 38)));
+			uint16x8_t cv = vsubq_u16(vmulq_n_u16(mr, 112), vaddq_u16(vmulq_n_u16(mg, 94), vmulq_n_u16(mb, 18)));
+			uint8x8_t pu = vshrn_n_u16(vaddq_u16(cu, vdupq_n_u16(0x8080)), 8);
+			uint8x8_t pv = vshrn_n_u16(vaddq_u16(cv, vdupq_n_u16(0x8080)), 8);
+			if (uv)
+			{
+				uint8x8x2_t interleaved = { { pu, pv } };
+				vst2_u8(uv + x, interleaved);
+			}
+			else
+			{
+				vst1_u8(u + x / 2, pu);
+				vst1_u8(v + x / 2, pv);
+			}
+		}
+		return x;
+	}
+#endif
+
+	RowPair rowPairOf(Bgr24Converter::Kernel kernel)
+	{
+		switch (kernel)
+		{
+#ifdef BGR24_X86
+		case Bgr24Converter::kSSE41: return rowPairSSE41;
+		case Bgr24Converter::kAVX2: return rowPairAVX2;
+		case Bgr24Converter::kAVX512: return rowPairAVX512;
+#endif
+#ifdef BGR24_NEON
+		case Bgr24Converter::kNEON: return rowPairNEON;
+#endif
+		default: return rowPairNone;
+		}
+	}
+
+	Bgr24Converter::Kernel bestKernel()
+	{
+		const Bgr24Converter::Kernel preferred[] = { Bgr24Converter::kAVX512, Bgr24Converter::kAVX2,
+		                                             Bgr24Converter::kSSE41, Bgr24Converter::kNEON };
+		for (Bgr24Converter::Kernel kernel : preferred)
+		{
+			if (Bgr24Converter::isSupported(kernel))
+				return kernel;
+		}
+		return Bgr24Converter::kScalar;
+	}
+
+	std::atomic<int> s_kernel(-1);
+
+	void convert(const uint8_t* src, int src_stride, uint8_t* dst_y, int stride_y,
+	             uint8_t* dst_u, int stride_u, uint8_t* dst_v, int stride_v, uint8_t* dst_uv, int stride_uv,
+	             int width, int height)
+	{
+		RowPair rowPair = rowPairOf(Bgr24Converter::kernel());
+		for (int row = 0; row < height; row += 2)
+		{
+			// the last row of an odd height is paired with itself
+			int next = (row + 1 < height) ? 1 : 0;
+			const uint8_t* src0 = src + static_cast<ptrdiff_t>(row) * src_stride;
+			const uint8_t* src1 = src0 + next * static_cast<ptrdiff_t>(src_stride);
+			uint8_t* y0 = dst_y + static_cast<ptrdiff_t>(row) * stride_y;
+			uint8_t* y1 = y0 + next * static_cast<ptrdiff_t>(stride_y);
+			uint8_t* u = dst_u ? dst_u + static_cast<ptrdiff_t>(row / 2) * stride_u : nullptr;
+			uint8_t* v = dst_v ? dst_v + static_cast<ptrdiff_t>(row / 2) * stride_v : nullptr;
+			uint8_t* uv = dst_uv ? dst_uv + static_cast<ptrdiff_t>(row / 2) * stride_uv : nullptr;
+
+			int done = rowPair(src0, src1, y0, y1, u, v, uv, width);
+			rowPairScalar(src0, src1, y0, y1, u, v, uv, done, width);
+		}
+	}
+}
+
+Bgr24Converter::Kernel Bgr24Converter::kernel()
+{
+	int kernel = s_kernel.load(std::memory_order_relaxed);
+	if (kernel < 0)
+	{
+		kernel = bestKernel();
+		s_kernel.store(kernel, std::memory_order_relaxed);
+	}
+	return static_cast<Kernel>(kernel);
+}
+
+const char* Bgr24Converter::kernelName(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case kSSE41: return "sse4.1";
+	case kAVX2: return "avx2";
+	case kAVX512: return "avx512bw";
+	case kNEON: return "neon";
+	default: return "scalar";
+	}
+}
+
+bool Bgr24Converter::isSupported(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case kScalar: return true;
+#ifdef BGR24_X86
+	case kSSE41: return __builtin_cpu_supports("sse4.1");
+	case kAVX2: return __builtin_cpu_supports("avx2");
+	case kAVX512: return __builtin_cpu_supports("avx512bw");
+#endif
+#ifdef BGR24_NEON
+	case kNEON: return true;
+#endif
+	default: return false;
+	}
+}
+
+bool Bgr24Converter::setKernel(Kernel kernel)
+{
+	if (!isSupported(kernel))
+		return false;
+
+	s_kernel = kernel;
+	return true;
+}
+
+void Bgr24Converter::resetKernel()
+{
+	s_kernel = -1;
+}
+
+void Bgr24Converter::toI420(const uint8_t* src, int src_stride,
+                            uint8_t* dst_y, int stride_y,
+                            uint8_t* dst_u, int stride_u,
+                            uint8_t* dst_v, int stride_v,
+                            int width, int height)
+{
+	convert(src, src_stride, dst_y, stride_y, dst_u, stride_u, dst_v, stride_v, nullptr, 0, width, height);
+}
+
+void Bgr24Converter::toNV12(const uint8_t* src, int src_stride,
+                            uint8_t* dst_y, int stride_y,
+                            uint8_t* dst_uv, int stride_uv,
+                            int width, int height)
+{
+	convert(src, src_stride, dst_y, stride_y, nullptr, 0, nullptr, 0, dst_uv, stride_uv, width, height);
+}
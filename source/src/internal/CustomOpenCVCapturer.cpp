@@ -1,5 +1,8 @@
 #define NOMINMAX
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <thread>
 #include <common_video/libyuv/include/webrtc_libyuv.h>
@@ -8,21 +11,63 @@
 
 #include "internal/webrtc.h"
 #include "internal/CustomOpenCVCapturer.h"
+#include "internal/FrameTrace.h"
+#include "internal/AsyncLog.h"
+#include "internal/StripePool.h"
+#include "internal/Bgr24Converter.h"
 #include <media/base/videocapturer.h>
 #include <libyuv/rotate.h>
 #include <libyuv/convert.h>
+#include <libyuv/convert_from_argb.h>
+#include <libyuv/scale_argb.h>
 
 #include <rtc_base/logging.h>
 
 using std::endl;
 using namespace rtc;
 
-CustomOpenCVCapturer::CustomOpenCVCapturer(std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat> > i_stack)
+namespace
+{
+	// OpenCV conversion to BGRA, -1 if the image is BGRA already
+	bool bgraConversion(const cv::Mat& source, int& code)
+	{
+		switch (source.channels())
+		{
+		case 1: code = CV_GRAY2BGRA; return true;
+		case 3: code = CV_BGR2BGRA; return true;
+		case 4: code = -1; return true;
+		default: return false;
+		}
+	}
+
+	// rows [y0, y1) of the stripe index, y0 even so that chroma rows are not shared
+	void stripeRows(int rows, int stripes, int index, int& y0, int& y1)
+	{
+		int band = ((rows + stripes - 1) / stripes + 1) & ~1;
+		y0 = std::min(rows, index * band);
+		y1 = std::min(rows, y0 + band);
+	}
+
+	// BGRA rows to the I420 rows starting at y0
+	bool argbToI420Rows(const cv::Mat& bgra, int y0, rtc::scoped_refptr<webrtc::I420Buffer>& buffer)
+	{
+		return libyuv::ARGBToI420(bgra.ptr(), static_cast<int>(bgra.step),
+		                          buffer->MutableDataY() + y0 * buffer->StrideY(), buffer->StrideY(),
+		                          buffer->MutableDataU() + (y0 / 2) * buffer->StrideU(), buffer->StrideU(),
+		                          buffer->MutableDataV() + (y0 / 2) * buffer->StrideV(), buffer->StrideV(),
+		                          bgra.cols, bgra.rows) == 0;
+	}
+}
+
+CustomOpenCVCapturer::CustomOpenCVCapturer(std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat> > i_stack,
+                                           const std::string& streamLabel)
 	: now_rendering(false)
 	  , start()
 	  , end(std::chrono::system_clock::now())
-	  , frame_timer(std::chrono::system_clock::now()), frame_counter(0)
 	  , stack(i_stack)
+	  , queue_wait(LatencyRegistry::instance().get("stream:" + streamLabel, kLatencyQueueWait))
+	  , conversion(LatencyRegistry::instance().get("stream:" + streamLabel, kLatencyConversion))
+	  , stats(StreamContext::of(i_stack.get())->stats)
 {
 	
 }
@@ -50,30 +95,26 @@ void CustomOpenCVCapturer::PushFrame()
 			continue;
 		}*/
 
-		// frame rate count;
-		frame_counter++;
-		if (std::chrono::duration_cast<std::chrono::milliseconds>(start - frame_timer).count() >= 1000)
-		{
-			//renderer->SetFrameRate(frame_counter);
-
-			frame_timer = std::chrono::system_clock::now();
-			frame_counter = 0;
-		}
 		cv::Mat popped;
-		cv::Mat I420Mat;
 		if (!stack)
 		{
-			RTC_LOG(LS_WARNING) << "Frame buffering isn't yet set";
+			CLOG_EVERY_MS(kLogMedia, LS_WARNING, 5000) << "Frame buffering isn't yet set";
 			continue;
 		}
-		if (!stack->trypop_until(popped, 500)) // 500ms is like infinity but check if 
+		bool isPopped;
+		int64_t pushedUs = 0;
+		{
+			// parked until a frame is sent or Stop() is called
+			FrameTraceSpan span("PushFrame.dequeue");
+			isPopped = stack->wait_and_pop(popped, [this]() { return !now_rendering; }, &pushedUs);
+		}
+		if (!isPopped)
 		{
-			RTC_LOG(LS_WARNING) << "Fail to pop";
 			continue;
 		}
 		else if (popped.empty() || popped.size().height == 0 || popped.size().width == 0)
 		{
-			RTC_LOG(LS_WARNING) << "Fail to pop Image is empty";
+			CLOG_EVERY_MS(kLogMedia, LS_WARNING, 5000) << "Fail to pop Image is empty";
 			continue;
 		}
 		
@@ -82,56 +123,143 @@ void CustomOpenCVCapturer::PushFrame()
 
 		int buf_width = popped.size().width;
 		int buf_height = popped.size().height;
-		
-		if (popped.channels() == 3)
-			cv::cvtColor(popped, I420Mat, CV_BGR2BGRA);
-		else if (popped.channels() == 1)
-			cv::cvtColor(popped, I420Mat, CV_GRAY2BGRA);
-		else if (popped.channels() == 4)
-			I420Mat = popped;
-		else
-			RTC_LOG(LS_WARNING) << "Fail to convert";
-
-		//    rtc::scoped_refptr<webrtc::I420Buffer> buffer = webrtc::I420Buffer::Create(width, height);
-		rtc::scoped_refptr<webrtc::I420Buffer> buffer = webrtc::I420Buffer::Create(
-			buf_width, buf_height, buf_width, (buf_width + 1) / 2, (buf_width + 1) / 2);
-		/*const int conversionResult = libyuv::ARGBToI420(I420Mat.ptr(), buf_width * buf_height, 
-			buffer.get()->MutableDataY(), buffer.get()->StrideY(), 
-			buffer.get()->MutableDataU(), buffer.get()->StrideU(), 
-			buffer.get()->MutableDataV(), buffer.get()->StrideV(), 
-			buf_width, buf_height);*/
-		const int conversionResult = libyuv::ConvertToI420((const uint8_t*)I420Mat.ptr(), buf_width * buf_height * 4,
-							buffer->MutableDataY(), buffer->StrideY(),
-							buffer->MutableDataU(), buffer->StrideU(),
-							buffer->MutableDataV(), buffer->StrideV(),
-							0, 0,
-							buf_width, buf_height,
-							buf_width, buf_height,
-							libyuv::kRotate0, cricket::FOURCC_ARGB);		
-		//const int conversionResult = libyuv::ConvertToI420(
-		//	I420Mat.ptr(), 0, 0, // No cropping
-		//	buf_width, buf_height, CalcBufferSize(webrtc::VideoType::kARGB, buf_width, buf_height),
-		//	webrtc::kVideoRotation_0, buffer.get());
-
-		if (conversionResult < 0)
+		// the wait of this frame, a FIFO policy may hold several
+		queue_wait->record(LatencyHistogram::nowUs() - pushedUs);
+
+		// the video adapter follows the sink wants (max_pixel_count, max_framerate_fps)
+		// of the encoder: the frame is dropped or cropped and scaled before conversion
+		int out_width, out_height, crop_width, crop_height, crop_x, crop_y;
+		int64_t translated_time_us;
+		int64_t now_us = rtc::TimeMicros();
+		if (!AdaptFrame(buf_width, buf_height, now_us, now_us, &out_width, &out_height,
+		                &crop_width, &crop_height, &crop_x, &crop_y, &translated_time_us))
+		{
+			CLOG_EVERY_MS(kLogMedia, LS_VERBOSE, 5000) << "frame dropped by the video adapter";
+			continue;
+		}
+
+		int64_t conversionBegin = LatencyHistogram::nowUs();
+		rtc::scoped_refptr<webrtc::I420Buffer> buffer = ConvertToI420(popped, cv::Rect(crop_x, crop_y, crop_width, crop_height),
+		                                                              out_width, out_height);
+		int64_t conversionUs = LatencyHistogram::nowUs() - conversionBegin;
+		conversion->record(conversionUs);
+		stats->onConversion(conversionUs);
+		if (!buffer)
 		{
-			RTC_LOG(LS_ERROR) << "Failed to convert capture frame from type "
-				<< static_cast<int>(webrtc::VideoType::kARGB) << "to I420.";
 			continue;
 		}
 
 		webrtc::VideoFrame frame(buffer, 0, rtc::TimeMillis(), webrtc::kVideoRotation_0);
 		frame.set_ntp_time_ms(0);
 
-		OnFrame(frame, buf_width, buf_height);
+		{
+			FrameTraceSpan span("OnFrame");
+			OnFrame(frame, buf_width, buf_height);
+		}
+		stats->onOutput(out_width, out_height);
 
 		end = std::chrono::system_clock::now();
-		RTC_LOG(LS_VERBOSE) << "frame used "
+		CLOG(kLogMedia, LS_VERBOSE) << "frame used "
 			<< std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()
 			<< " micro sec.";
 	}
 }
 
+rtc::scoped_refptr<webrtc::I420Buffer> CustomOpenCVCapturer::ConvertToI420(const cv::Mat& popped)
+{
+	return ConvertToI420(popped, cv::Rect(0, 0, popped.cols, popped.rows), popped.cols, popped.rows);
+}
+
+rtc::scoped_refptr<webrtc::I420Buffer> CustomOpenCVCapturer::ConvertToI420(const cv::Mat& popped, const cv::Rect& crop,
+                                                                           int width, int height)
+{
+	FrameTraceSpan span("ConvertToI420");
+	cv::Mat source = popped(crop);
+	int code;
+	if (!bgraConversion(source, code))
+	{
+		CLOG_EVERY_MS(kLogMedia, LS_WARNING, 5000) << "Fail to convert";
+		return nullptr;
+	}
+
+	// a smaller output (cpu overuse adaptation) is scaled first, so that the color
+	// conversion, one pass for BGR24, runs at the output size
+	if ((width != crop.width || height != crop.height) && code >= 0)
+	{
+		cv::Mat scaled;
+		cv::resize(source, scaled, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+		return ConvertToI420(scaled, cv::Rect(0, 0, width, height), width, height);
+	}
+
+	// large frames are converted by stripes on the shared pool
+	std::shared_ptr<StripePool> pool = StripePool::shared();
+	int stripes = 1;
+	if (pool && static_cast<int64_t>(crop.width) * crop.height >= StripePool::minPixels())
+		stripes = static_cast<int>(pool->workers()) + 1;
+
+	auto forEachStripe = [&pool, stripes, &source](const std::function<bool(int, int)>& convert)
+	{
+		std::atomic<bool> ok(true);
+		std::function<void(int)> task = [&](int index)
+		{
+			int y0, y1;
+			stripeRows(source.rows, stripes, index, y0, y1);
+			if (y0 < y1 && !convert(y0, y1))
+				ok = false;
+		};
+		if (stripes > 1)
+			pool->parallelFor(stripes, task);
+		else
+			task(0);
+		return ok.load();
+	};
+
+	rtc::scoped_refptr<webrtc::I420Buffer> buffer = webrtc::I420Buffer::Create(
+		width, height, width, (width + 1) / 2, (width + 1) / 2);
+
+	bool converted;
+	if (width == crop.width && height == crop.height)
+	{
+		converted = forEachStripe([&source, code, &buffer](int y0, int y1)
+		{
+			if (source.channels() == 3)
+			{
+				// one pass, no intermediate BGRA image
+				Bgr24Converter::toI420(source.ptr(y0), static_cast<int>(source.step),
+				                       buffer->MutableDataY() + y0 * buffer->StrideY(), buffer->StrideY(),
+				                       buffer->MutableDataU() + (y0 / 2) * buffer->StrideU(), buffer->StrideU(),
+				                       buffer->MutableDataV() + (y0 / 2) * buffer->StrideV(), buffer->StrideV(),
+				                       source.cols, y1 - y0);
+				return true;
+			}
+
+			cv::Mat BGRAMat;
+			if (code >= 0)
+				cv::cvtColor(source.rowRange(y0, y1), BGRAMat, code);
+			else
+				BGRAMat = source.rowRange(y0, y1);
+			return argbToI420Rows(BGRAMat, y0, buffer);
+		});
+	}
+	else
+	{
+		// already BGRA, libyuv ARGB in memory order: scaled as is
+		cv::Mat scaled(height, width, CV_8UC4);
+		converted = libyuv::ARGBScale(source.ptr(), static_cast<int>(source.step), crop.width, crop.height,
+		                              scaled.ptr(), static_cast<int>(scaled.step), width, height, libyuv::kFilterBox) == 0
+			&& argbToI420Rows(scaled, 0, buffer);
+	}
+
+	if (!converted)
+	{
+		CLOG_EVERY_MS(kLogMedia, LS_ERROR, 1000) << "Failed to convert capture frame from type "
+			<< static_cast<int>(webrtc::VideoType::kARGB) << "to I420.";
+		return nullptr;
+	}
+
+	return buffer;
+}
+
 cricket::CaptureState CustomOpenCVCapturer::Start(const cricket::VideoFormat& capture_format)
 {
 	RTC_LOG(INFO) << "CustomVideoCapture start.";
@@ -157,6 +285,8 @@ void CustomOpenCVCapturer::Stop()
 {
 	RTC_LOG(INFO) << "CustomVideoCapture::Stop()";
 	now_rendering = false;
+	if (stack)
+		stack->wake();
 	
 	if (renderer_task && renderer_task->joinable())
 	{
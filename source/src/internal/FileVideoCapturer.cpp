@@ -0,0 +1,324 @@
+#include "internal/FileVideoCapturer.h"
+#include "internal/FrameTrace.h"
+#include "internal/AsyncLog.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <api/video/i420_buffer.h>
+#include <common_video/include/video_frame_buffer.h>
+#include <rtc_base/callback.h>
+#include <rtc_base/logging.h>
+#include <rtc_base/timeutils.h>
+
+struct FileVideoCapturer::Mapping
+{
+	const uint8_t* data = nullptr;
+	size_t         size = 0;
+
+	~Mapping()
+	{
+#ifndef WIN32
+		if (data)
+			munmap(const_cast<uint8_t *>(data), size);
+#endif
+	}
+};
+
+namespace
+{
+	size_t i420Bytes(int width, int height)
+	{
+		size_t chroma = static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+		return static_cast<size_t>(width) * height + 2 * chroma;
+	}
+
+	int option(const std::map<std::string, std::string>& opts, const std::string& key, int value)
+	{
+		auto it = opts.find(key);
+		return it == opts.end() ? value : std::atoi(it->second.c_str());
+	}
+
+	// "YUV4MPEG2 W<w> H<h> F<num>:<den> ... C420jpeg\n" then "FRAME[ params]\n" and
+	// the planes for each frame. 8 bit 4:2:0 only, the chroma siting is ignored.
+	bool parseY4m(const uint8_t* data, size_t size, int& width, int& height, double& fps, std::vector<size_t>& frames)
+	{
+		static const char kMagic[] = "YUV4MPEG2 ";
+		size_t magic = sizeof(kMagic) - 1;
+		const uint8_t* eol = size > magic ? static_cast<const uint8_t *>(memchr(data, '\n', size)) : nullptr;
+		if (!eol || memcmp(data, kMagic, magic) != 0)
+			return false;
+
+		const char* text = reinterpret_cast<const char *>(data);
+		std::istringstream tokens(std::string(text + magic, text + (eol - data)));
+		std::string token;
+		std::string chroma = "420jpeg";
+		while (tokens >> token)
+		{
+			switch (token[0])
+			{
+			case 'W': width = std::atoi(token.c_str() + 1); break;
+			case 'H': height = std::atoi(token.c_str() + 1); break;
+			case 'C': chroma = token.substr(1); break;
+			case 'F':
+			{
+				int num = 0, den = 0;
+				if (sscanf(token.c_str() + 1, "%d:%d", &num, &den) == 2 && num > 0 && den > 0)
+					fps = static_cast<double>(num) / den;
+				break;
+			}
+			default: break;
+			}
+		}
+		if (width <= 0 || height <= 0
+			|| (chroma != "420" && chroma != "420jpeg" && chroma != "420paldv" && chroma != "420mpeg2"))
+		{
+			RTC_LOG(LS_ERROR) << "unsupported Y4M stream " << width << "x" << height << " C" << chroma;
+			return false;
+		}
+
+		size_t frameBytes = i420Bytes(width, height);
+		size_t offset = eol - data + 1;
+		while (offset + 5 <= size && memcmp(data + offset, "FRAME", 5) == 0)
+		{
+			const uint8_t* header = static_cast<const uint8_t *>(memchr(data + offset, '\n', size - offset));
+			size_t pixels = header ? header - data + 1 : size;
+			// a truncated last frame is ignored
+			if (pixels + frameBytes > size)
+				break;
+			frames.push_back(pixels);
+			offset = pixels + frameBytes;
+		}
+		return !frames.empty();
+	}
+}
+
+std::unique_ptr<FileVideoCapturer> FileVideoCapturer::Create(const std::string& url,
+                                                             const std::map<std::string, std::string>& opts)
+{
+	std::unique_ptr<FileVideoCapturer> capturer;
+#ifndef WIN32
+	static const std::string kScheme = "file://";
+	std::string path = url.compare(0, kScheme.size(), kScheme) == 0 ? url.substr(kScheme.size()) : url;
+
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		RTC_LOG(LS_ERROR) << "cannot open " << path << ": " << errno;
+		return capturer;
+	}
+	struct stat status;
+	std::shared_ptr<Mapping> mapping = std::make_shared<Mapping>();
+	if (fstat(fd, &status) == 0 && status.st_size > 0)
+	{
+		void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED)
+		{
+			mapping->data = static_cast<const uint8_t *>(data);
+			mapping->size = static_cast<size_t>(status.st_size);
+			// read ahead now rather than fault pages while sending
+			madvise(data, mapping->size, MADV_WILLNEED);
+		}
+	}
+	close(fd);
+	if (!mapping->data)
+	{
+		RTC_LOG(LS_ERROR) << "cannot map " << path;
+		return capturer;
+	}
+
+	int width = 0;
+	int height = 0;
+	double fps = 30;
+	std::vector<size_t> frames;
+	if (!parseY4m(mapping->data, mapping->size, width, height, fps, frames))
+	{
+		// raw I420: the size comes from the options
+		width = option(opts, "width", 0);
+		height = option(opts, "height", 0);
+		if (width > 0 && height > 0)
+		{
+			size_t frameBytes = i420Bytes(width, height);
+			for (size_t offset = 0; offset + frameBytes <= mapping->size; offset += frameBytes)
+				frames.push_back(offset);
+		}
+	}
+	if (frames.empty())
+	{
+		RTC_LOG(LS_ERROR) << path << " is neither a Y4M 4:2:0 file nor a raw I420 file of width x height frames";
+		return capturer;
+	}
+
+	fps = opts.count("fps") ? std::atof(opts.at("fps").c_str()) : fps;
+	bool loop = option(opts, "loop", 1) != 0;
+	RTC_LOG(INFO) << "file source " << path << ": " << frames.size() << " frames " << width << "x" << height
+		<< " at " << fps << " fps";
+	capturer.reset(new FileVideoCapturer(mapping, std::move(frames), width, height, fps, loop));
+#else
+	RTC_LOG(LS_ERROR) << "file:// sources are not supported on this platform: " << url;
+	(void)opts;
+#endif
+	return capturer;
+}
+
+FileVideoCapturer::FileVideoCapturer(std::shared_ptr<Mapping> i_mapping, std::vector<size_t> i_frames,
+                                     int i_width, int i_height, double i_fps, bool i_loop)
+	: mapping(i_mapping), frames(std::move(i_frames)), width(i_width), height(i_height), fps(i_fps), loop(i_loop)
+	, now_sending(false)
+{
+	int64_t interval = fps > 0 ? static_cast<int64_t>(rtc::kNumNanosecsPerSec / fps) : 0;
+	std::vector<cricket::VideoFormat> formats;
+	formats.push_back(cricket::VideoFormat(width, height, interval, cricket::FOURCC_I420));
+	SetSupportedFormats(formats);
+}
+
+FileVideoCapturer::~FileVideoCapturer()
+{
+	Stop();
+}
+
+rtc::scoped_refptr<webrtc::I420BufferInterface> FileVideoCapturer::WrapFrame(size_t index) const
+{
+	int strideUV = (width + 1) / 2;
+	const uint8_t* y = mapping->data + frames[index];
+	const uint8_t* u = y + static_cast<size_t>(width) * height;
+	const uint8_t* v = u + static_cast<size_t>(strideUV) * ((height + 1) / 2);
+
+	// the encoder may hold the frame after Stop(), or after the capturer is gone
+	std::shared_ptr<Mapping> keep = mapping;
+	return webrtc::WrapI420Buffer(width, height, y, width, u, strideUV, v, strideUV,
+	                              rtc::Callback0<void>([keep]() {}));
+}
+
+void FileVideoCapturer::PushFrames()
+{
+	typedef std::chrono::steady_clock Clock;
+	Clock::duration interval = fps > 0
+		? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps))
+		: Clock::duration::zero();
+	Clock::time_point next = Clock::now();
+
+	size_t index = 0;
+	while (now_sending)
+	{
+		if (index == frames.size())
+		{
+			if (!loop)
+				break;
+			index = 0;
+		}
+		if (interval > Clock::duration::zero())
+		{
+			std::unique_lock<std::mutex> lock(wake_mutex);
+			if (wake.wait_until(lock, next, [this]() { return !now_sending; }))
+				break;
+			// on schedule, not drifting with the time spent in OnFrame
+			next += interval;
+		}
+
+		rtc::scoped_refptr<webrtc::I420BufferInterface> buffer = WrapFrame(index++);
+
+		int out_width, out_height, crop_width, crop_height, crop_x, crop_y;
+		int64_t translated_time_us;
+		int64_t now_us = rtc::TimeMicros();
+		if (!AdaptFrame(width, height, now_us, now_us, &out_width, &out_height,
+		                &crop_width, &crop_height, &crop_x, &crop_y, &translated_time_us))
+		{
+			CLOG_EVERY_MS(kLogMedia, LS_VERBOSE, 5000) << "frame dropped by the video adapter";
+			continue;
+		}
+		// the file pixels go as they are unless the encoder asked for less
+		if (out_width != width || out_height != height)
+		{
+			rtc::scoped_refptr<webrtc::I420Buffer> scaled = webrtc::I420Buffer::Create(out_width, out_height);
+			scaled->CropAndScaleFrom(*buffer, crop_x, crop_y, crop_width, crop_height);
+			buffer = scaled;
+		}
+
+		webrtc::VideoFrame frame(buffer, 0, rtc::TimeMillis(), webrtc::kVideoRotation_0);
+		frame.set_ntp_time_ms(0);
+
+		FrameTraceSpan span("OnFrame");
+		OnFrame(frame, width, height);
+	}
+}
+
+cricket::CaptureState FileVideoCapturer::Start(const cricket::VideoFormat& capture_format)
+{
+	if (capture_state() == cricket::CS_RUNNING)
+	{
+		RTC_LOG(LS_ERROR) << "Start called when it's already started.";
+		return capture_state();
+	}
+
+	now_sending = true;
+	SetCaptureFormat(&capture_format);
+	sender_task.reset(new std::thread([this]()
+	{
+		PushFrames();
+	}));
+
+	return cricket::CS_RUNNING;
+}
+
+void FileVideoCapturer::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		now_sending = false;
+	}
+	wake.notify_all();
+
+	if (sender_task && sender_task->joinable())
+	{
+		sender_task->join();
+		sender_task.reset();
+	}
+
+	if (capture_state() == cricket::CS_STOPPED)
+		return;
+
+	SetCaptureFormat(nullptr);
+	SetCaptureState(cricket::CS_STOPPED);
+}
+
+bool FileVideoCapturer::IsRunning()
+{
+	return capture_state() == cricket::CS_RUNNING;
+}
+
+bool FileVideoCapturer::GetPreferredFourccs(std::vector<uint32_t>* fourccs)
+{
+	if (!fourccs)
+		return false;
+	fourccs->push_back(cricket::FOURCC_I420);
+	return true;
+}
+
+bool FileVideoCapturer::GetBestCaptureFormat(const cricket::VideoFormat& desired, cricket::VideoFormat* best_format)
+{
+	if (!best_format)
+		return false;
+
+	// the file decides, the video adapter scales down if the encoder wants less
+	best_format->width = width;
+	best_format->height = height;
+	best_format->fourcc = cricket::FOURCC_I420;
+	best_format->interval = desired.interval;
+	return true;
+}
+
+bool FileVideoCapturer::IsScreencast() const
+{
+	return false;
+}
@@ -0,0 +1,130 @@
+#include "internal/FrameSequence.h"
+#include "internal/LatencyHistogram.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+FrameSequence::FrameSequence() : m_waiting(0), m_lastWaitUs(0), m_nextReader(1)
+{
+}
+
+uint64_t FrameSequence::publish(const cv::Mat& image, int64_t timestampUs, uint32_t rtpTimestamp, int64_t idleUs)
+{
+	Frame frame;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_latest.sequence++;
+		m_latest.image = image;
+		m_latest.timestampUs = timestampUs;
+		m_latest.rtpTimestamp = rtpTimestamp;
+		frame = m_latest;
+	}
+	m_published.notify_all();
+
+	// pushed out of the readers lock: a FifoBlock reader may hold us
+	std::vector<std::shared_ptr<Reader>> readers;
+	{
+		std::lock_guard<std::mutex> lock(m_readersMutex);
+		for (auto& entry : m_readers)
+			readers.push_back(entry.second);
+	}
+	for (auto& target : readers)
+	{
+		Reader* r = target.get();
+		r->queue.push(frame, [r, idleUs]()
+		{
+			return r->removed || LatencyHistogram::nowUs() - r->queue.lastPopTimeUs() > idleUs;
+		});
+	}
+	return frame.sequence;
+}
+
+bool FrameSequence::waitNewer(uint64_t lastSequence, int timeoutMs, Frame& frame)
+{
+	m_lastWaitUs = LatencyHistogram::nowUs();
+	m_waiting++;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	bool newer = m_published.wait_for(lock, std::chrono::milliseconds(std::max(timeoutMs, 0)), [this, lastSequence]()
+	{
+		return m_latest.sequence > lastSequence && !m_latest.image.empty();
+	});
+	if (newer)
+		frame = m_latest;
+	lock.unlock();
+
+	m_lastWaitUs = LatencyHistogram::nowUs();
+	m_waiting--;
+	return newer;
+}
+
+int64_t FrameSequence::lastWaitTimeUs() const
+{
+	if (m_waiting > 0)
+		return LatencyHistogram::nowUs();
+
+	int64_t last = m_lastWaitUs;
+	std::lock_guard<std::mutex> lock(m_readersMutex);
+	for (auto& entry : m_readers)
+		last = std::max(last, entry.second->queue.lastPopTimeUs());
+	return last;
+}
+
+int FrameSequence::addReader(const core::queue::QueuePolicy& policy)
+{
+	std::shared_ptr<Reader> reader = std::make_shared<Reader>();
+	reader->queue.setPolicy(policy);
+
+	std::lock_guard<std::mutex> lock(m_readersMutex);
+	int id = m_nextReader++;
+	m_readers[id] = reader;
+	return id;
+}
+
+void FrameSequence::removeReader(int id)
+{
+	std::shared_ptr<Reader> removed;
+	{
+		std::lock_guard<std::mutex> lock(m_readersMutex);
+		auto it = m_readers.find(id);
+		if (it == m_readers.end())
+			return;
+		removed = it->second;
+		m_readers.erase(it);
+	}
+	removed->removed = true;
+	removed->queue.clear();
+	removed->queue.wake();
+}
+
+std::shared_ptr<FrameSequence::Reader> FrameSequence::reader(int id) const
+{
+	std::lock_guard<std::mutex> lock(m_readersMutex);
+	auto it = m_readers.find(id);
+	return it == m_readers.end() ? nullptr : it->second;
+}
+
+bool FrameSequence::read(int id, int timeoutMs, Frame& frame)
+{
+	std::shared_ptr<Reader> r = reader(id);
+	if (!r || !r->queue.trypop_until(frame, std::max(timeoutMs, 0)) || r->removed)
+		return false;
+
+	r->delivered++;
+	return true;
+}
+
+bool FrameSequence::readerStats(int id, WebRTCReaderStats& stats) const
+{
+	std::shared_ptr<Reader> r = reader(id);
+	if (!r)
+		return false;
+
+	stats.delivered_frames = r->delivered;
+	stats.rejected_frames = r->queue.rejectedCount();
+	stats.expired_frames = r->queue.expiredCount();
+	stats.dropped_frames = r->queue.replacedCount() + stats.rejected_frames + stats.expired_frames;
+	stats.queue_depth = static_cast<int>(r->queue.size());
+	return true;
+}
@@ -0,0 +1,244 @@
+#include "internal/FrameTrace.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "rtc_base/timeutils.h"
+
+std::atomic<bool> FrameTrace::s_enabled(false);
+
+namespace
+{
+	const size_t kRingSize = 8192;
+
+	// A slot is stable when its sequence is even and did not change while read.
+	struct TraceSlot
+	{
+		std::atomic<uint64_t>    seq{ 0 };
+		std::atomic<const char*> name{ nullptr };
+		std::atomic<int64_t>     begin{ 0 };
+		std::atomic<int64_t>     duration{ 0 };
+		std::atomic<int64_t>     frameId{ -1 };
+	};
+
+	// written by its thread only, read by dumpChromeTrace
+	struct ThreadRing
+	{
+		long                     tid;        // s_ringsMutex
+		std::string              threadName; // s_ringsMutex
+		bool                     owned;      // s_ringsMutex, false once its thread exited
+		std::atomic<uint64_t>    head{ 0 };
+		std::atomic<uint64_t>    tail{ 0 };
+		TraceSlot                slots[kRingSize];
+	};
+
+	std::mutex s_ringsMutex;
+	std::vector<std::shared_ptr<ThreadRing>> s_rings;
+
+	long currentThreadId()
+	{
+#ifdef __linux__
+		return syscall(SYS_gettid);
+#else
+		// a number per thread, enough to tell the tracks apart
+		static std::atomic<long> next(1);
+		return next++;
+#endif
+	}
+
+	std::string currentThreadName()
+	{
+		char name[32] = { 0 };
+#ifdef __linux__
+		pthread_getname_np(pthread_self(), name, sizeof(name));
+#endif
+		return name;
+	}
+
+	long processId()
+	{
+#ifdef __linux__
+		return getpid();
+#else
+		return 1;
+#endif
+	}
+
+	// gives the ring back when its thread exits: threads come and go with the
+	// peers, the rings are as many as the threads tracing at the same time
+	struct RingOwner
+	{
+		std::shared_ptr<ThreadRing> ring;
+
+		~RingOwner()
+		{
+			if (!ring)
+				return;
+			std::lock_guard<std::mutex> lock(s_ringsMutex);
+			ring->owned = false;
+		}
+	};
+
+	ThreadRing* currentRing()
+	{
+		thread_local RingOwner owner;
+		if (!owner.ring)
+		{
+			long tid = currentThreadId();
+			std::string threadName = currentThreadName();
+
+			std::lock_guard<std::mutex> lock(s_ringsMutex);
+			for (auto& ring : s_rings)
+			{
+				if (!ring->owned)
+				{
+					// the events of the thread that exited are dropped with it
+					ring->tail.store(ring->head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+					owner.ring = ring;
+					break;
+				}
+			}
+			if (!owner.ring)
+			{
+				owner.ring = std::make_shared<ThreadRing>();
+				s_rings.push_back(owner.ring);
+			}
+			owner.ring->tid = tid;
+			owner.ring->threadName = threadName;
+			owner.ring->owned = true;
+		}
+		return owner.ring.get();
+	}
+
+	void appendEscaped(std::string& out, const std::string& value)
+	{
+		for (char c : value)
+		{
+			if (c == '"' || c == '\\')
+				out += '\\';
+			if (static_cast<unsigned char>(c) >= 0x20)
+				out += c;
+		}
+	}
+}
+
+void FrameTrace::setEnabled(bool enabled)
+{
+	s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+int64_t FrameTrace::nowUs()
+{
+	return rtc::TimeMicros();
+}
+
+void FrameTrace::record(const char* name, int64_t beginUs, int64_t endUs, int64_t frameId)
+{
+	if (!enabled())
+		return;
+
+	ThreadRing* ring = currentRing();
+	uint64_t index = ring->head.load(std::memory_order_relaxed);
+	TraceSlot& slot = ring->slots[index % kRingSize];
+
+	slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.begin.store(beginUs, std::memory_order_relaxed);
+	slot.duration.store(endUs - beginUs, std::memory_order_relaxed);
+	slot.frameId.store(frameId, std::memory_order_relaxed);
+	slot.seq.store(2 * index + 2, std::memory_order_release);
+
+	ring->head.store(index + 1, std::memory_order_release);
+}
+
+std::string FrameTrace::dumpChromeTrace()
+{
+	// a ring may change owner while read: its thread is taken with the list
+	struct Track
+	{
+		std::shared_ptr<ThreadRing> ring;
+		long                        tid;
+		std::string                 threadName;
+	};
+	std::vector<Track> tracks;
+	{
+		std::lock_guard<std::mutex> lock(s_ringsMutex);
+		for (auto& ring : s_rings)
+		{
+			Track track = { ring, ring->tid, ring->threadName };
+			tracks.push_back(track);
+		}
+	}
+
+	long pid = processId();
+	std::string out = "{\"traceEvents\":[";
+	bool first = true;
+	char event[256];
+	for (auto& track : tracks)
+	{
+		ThreadRing* ring = track.ring.get();
+		out += first ? "" : ",";
+		first = false;
+		snprintf(event, sizeof(event), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,\"args\":{\"name\":\"", pid, track.tid);
+		out += event;
+		appendEscaped(out, track.threadName);
+		out += "\"}}";
+
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+		uint64_t begin = std::max(tail, head > kRingSize ? head - kRingSize : 0);
+		for (uint64_t index = begin; index < head; index++)
+		{
+			TraceSlot& slot = ring->slots[index % kRingSize];
+			uint64_t seq = slot.seq.load(std::memory_order_acquire);
+			const char* name = slot.name.load(std::memory_order_relaxed);
+			int64_t ts = slot.begin.load(std::memory_order_relaxed);
+			int64_t duration = slot.duration.load(std::memory_order_relaxed);
+			int64_t frameId = slot.frameId.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (seq != 2 * index + 2 || slot.seq.load(std::memory_order_relaxed) != seq || !name)
+				continue; // overwritten while reading
+
+			snprintf(event, sizeof(event), ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,\"ts\":%lld,\"dur\":%lld",
+				name, pid, track.tid, static_cast<long long>(ts), static_cast<long long>(duration));
+			out += event;
+			if (frameId >= 0)
+			{
+				snprintf(event, sizeof(event), ",\"args\":{\"frame\":%lld}", static_cast<long long>(frameId));
+				out += event;
+			}
+			out += "}";
+		}
+	}
+	out += "],\"displayTimeUnit\":\"ms\"}";
+	return out;
+}
+
+bool FrameTrace::dumpChromeTrace(const std::string& path)
+{
+	std::ofstream file(path, std::ios::out | std::ios::trunc);
+	if (!file)
+		return false;
+
+	file << dumpChromeTrace();
+	return file.good();
+}
+
+void FrameTrace::clear()
+{
+	std::lock_guard<std::mutex> lock(s_ringsMutex);
+	for (auto& ring : s_rings)
+	{
+		ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+	}
+}
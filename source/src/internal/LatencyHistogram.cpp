@@ -0,0 +1,192 @@
+#include "internal/LatencyHistogram.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+#if defined(_MSC_VER) && defined(_WIN64)
+#include <intrin.h>
+#endif
+
+const char kLatencyQueueWait[] = "queue_wait";
+const char kLatencyConversion[] = "conversion";
+const char kLatencyEncode[] = "encode";
+const char kLatencyNetworkRtt[] = "network_rtt";
+const char kLatencyDecode[] = "decode";
+const char kLatencyRendererConversion[] = "renderer_conversion";
+const char kLatencyCaptureWait[] = "capture_wait";
+
+LatencyHistogram::LatencyHistogram()
+{
+	reset();
+}
+
+int64_t LatencyHistogram::nowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+namespace
+{
+	// index of the highest bit set, value not 0
+	int highestBit(uint64_t value)
+	{
+#if defined(__GNUC__)
+		return 63 - __builtin_clzll(value);
+#elif defined(_MSC_VER) && defined(_WIN64)
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return static_cast<int>(index);
+#else
+		int index = 0;
+		while (value >>= 1)
+			index++;
+		return index;
+#endif
+	}
+}
+
+// values below 16 have their own bucket, above each power of two is split in 16
+int LatencyHistogram::bucketIndex(uint64_t value)
+{
+	if (value < kSubBuckets)
+		return static_cast<int>(value);
+
+	int msb = highestBit(value);
+	int shift = msb - kSubBucketBits;
+	int sub = static_cast<int>(value >> shift) - kSubBuckets;
+	return (shift + 1) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(int index)
+{
+	if (index < kSubBuckets)
+		return index;
+
+	int shift = index / kSubBuckets - 1;
+	uint64_t lower = static_cast<uint64_t>(kSubBuckets + index % kSubBuckets) << shift;
+	return lower + (1ULL << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t us)
+{
+	uint64_t value = us > 0 ? static_cast<uint64_t>(us) : 0;
+
+	m_buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(value, std::memory_order_relaxed);
+
+	uint64_t min = m_min.load(std::memory_order_relaxed);
+	while (value < min && !m_min.compare_exchange_weak(min, value, std::memory_order_relaxed)) {}
+	uint64_t max = m_max.load(std::memory_order_relaxed);
+	while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::reset()
+{
+	for (auto& bucket : m_buckets)
+		bucket.store(0, std::memory_order_relaxed);
+	m_count.store(0, std::memory_order_relaxed);
+	m_sum.store(0, std::memory_order_relaxed);
+	m_min.store(UINT64_MAX, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::percentile(double p) const
+{
+	uint64_t total = 0;
+	for (const auto& bucket : m_buckets)
+		total += bucket.load(std::memory_order_relaxed);
+	if (total == 0)
+		return 0;
+
+	uint64_t rank = static_cast<uint64_t>(p * total + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	uint64_t seen = 0;
+	for (int i = 0; i < kBucketCount; i++)
+	{
+		seen += m_buckets[i].load(std::memory_order_relaxed);
+		if (seen >= rank)
+			return static_cast<int64_t>(std::min(bucketUpperBound(i), m_max.load(std::memory_order_relaxed)));
+	}
+	return static_cast<int64_t>(m_max.load(std::memory_order_relaxed));
+}
+
+Json::Value LatencyHistogram::toJson() const
+{
+	Json::Value value;
+	uint64_t count = m_count.load(std::memory_order_relaxed);
+	value["count"] = static_cast<Json::UInt64>(count);
+	value["min"] = static_cast<Json::UInt64>(count ? m_min.load(std::memory_order_relaxed) : 0);
+	value["mean"] = count ? static_cast<double>(m_sum.load(std::memory_order_relaxed)) / count : 0.0;
+	value["p50"] = static_cast<Json::Int64>(percentile(0.50));
+	value["p90"] = static_cast<Json::Int64>(percentile(0.90));
+	value["p99"] = static_cast<Json::Int64>(percentile(0.99));
+	value["p999"] = static_cast<Json::Int64>(percentile(0.999));
+	value["max"] = static_cast<Json::UInt64>(m_max.load(std::memory_order_relaxed));
+	return value;
+}
+
+LatencyRegistry& LatencyRegistry::instance()
+{
+	static LatencyRegistry registry;
+	return registry;
+}
+
+std::shared_ptr<LatencyHistogram> LatencyRegistry::get(const std::string& scope, const std::string& stage)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::shared_ptr<LatencyHistogram>& histogram = m_histograms[scope][stage];
+	if (!histogram)
+		histogram = std::make_shared<LatencyHistogram>();
+	return histogram;
+}
+
+void LatencyRegistry::reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto scope = m_histograms.begin(); scope != m_histograms.end();)
+	{
+		for (auto stage = scope->second.begin(); stage != scope->second.end();)
+		{
+			if (stage->second.use_count() == 1)
+			{
+				stage = scope->second.erase(stage);
+			}
+			else
+			{
+				stage->second->reset();
+				++stage;
+			}
+		}
+		scope = scope->second.empty() ? m_histograms.erase(scope) : std::next(scope);
+	}
+}
+
+void LatencyRegistry::remove(const std::string& scope)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_histograms.erase(scope);
+}
+
+Json::Value LatencyRegistry::toJson()
+{
+	Json::Value value(Json::objectValue);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& scope : m_histograms)
+	{
+		for (auto& stage : scope.second)
+		{
+			value[scope.first][stage.first] = stage.second->toJson();
+		}
+	}
+	return value;
+}
+
+std::string LatencyRegistry::dump()
+{
+	Json::FastWriter writer;
+	return writer.write(toJson());
+}
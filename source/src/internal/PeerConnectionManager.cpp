@@ -25,6 +25,8 @@
 #include <internal/PeerConnectionManager.h>
 #include "rtc_base/strings/json.h"
 #include "internal/CapturerFactory.h"
+#include "internal/TracingVideoCodec.h"
+#include "internal/AsyncLog.h"
 
 
 // Names used for a IceCandidate JSON object.
@@ -145,25 +147,45 @@ IceServer getIceServerFromUrl(const std::string& url, const std::string& clientI
 	return srv;
 }
 
+/* ---------------------------------------------------------------------------
+**  network thread owned by the manager so that sockets can be shared
+** -------------------------------------------------------------------------*/
+// PeerConnections closed concurrently, whatever the number of peers leaving
+static const size_t kTeardownWorkers = 2;
+
+static std::unique_ptr<rtc::Thread> createNetworkThread()
+{
+	std::unique_ptr<rtc::Thread> thread = rtc::Thread::CreateWithSocketServer();
+	thread->SetName("network_thread", nullptr);
+	thread->Start();
+	return thread;
+}
+
 /* ---------------------------------------------------------------------------
 **  Constructor
 ** -------------------------------------------------------------------------*/
 PeerConnectionManager::PeerConnectionManager(const std::list<std::string>& iceServerList
                                              , const webrtc::AudioDeviceModule::AudioLayer audioLayer
                                              , const std::string& publishFilter)
-	: audioDeviceModule_(webrtc::AudioDeviceModule::Create(0, audioLayer))
+	: m_networkThread(createNetworkThread())
+	  , audioDeviceModule_(webrtc::AudioDeviceModule::Create(0, audioLayer))
 	  , audioDecoderfactory_(webrtc::CreateBuiltinAudioDecoderFactory())
-	  , peer_connection_factory_(webrtc::CreatePeerConnectionFactory(NULL,
+	  , m_encodedRecorder(std::make_shared<RecorderTap>())
+	  , peer_connection_factory_(webrtc::CreatePeerConnectionFactory(m_networkThread.get(),
 	                                                                 NULL,
 	                                                                 NULL,
 	                                                                 audioDeviceModule_,
 	                                                                 webrtc::CreateBuiltinAudioEncoderFactory(),
 	                                                                 audioDecoderfactory_,
-	                                                                 webrtc::CreateBuiltinVideoEncoderFactory(),
-	                                                                 webrtc::CreateBuiltinVideoDecoderFactory(),
+	                                                                 std::unique_ptr<webrtc::VideoEncoderFactory>(
+		                                                                 new TracingVideoEncoderFactory(webrtc::CreateBuiltinVideoEncoderFactory())),
+	                                                                 std::unique_ptr<webrtc::VideoDecoderFactory>(
+		                                                                 new TracingVideoDecoderFactory(webrtc::CreateBuiltinVideoDecoderFactory(),
+		                                                                                                m_encodedRecorder)),
 	                                                                 NULL, NULL))
 	  , iceServerList_(iceServerList)
 	  , m_publishFilter(publishFilter)
+	  , m_teardown(new TeardownExecutor(kTeardownWorkers))
 {
 	// build video audio map
 	//m_videoaudiomap = getV4l2AlsaMap();
@@ -192,6 +214,69 @@ PeerConnectionManager::~PeerConnectionManager()
 		std::lock_guard<std::mutex> peerlock(m_peerMapMutex);
 		this->peer_connectionobs_map_.clear();
 	}
+
+	// Close() is proxied to the signaling thread, that is usually this one
+	m_teardown->drain([]()
+	{
+		rtc::Thread* current = rtc::Thread::Current();
+		if (current)
+		{
+			current->ProcessMessages(0);
+		}
+	});
+	m_teardown.reset();
+
+	if (m_portMux || m_networkManager)
+	{
+		m_networkThread->Invoke<void>(RTC_FROM_HERE, [this]()
+		{
+			m_networkManager.reset();
+		});
+		m_portMux.reset();
+	}
+}
+
+/* ---------------------------------------------------------------------------
+**  serve all the peers from one UDP port (and one TCP port if not 0)
+** -------------------------------------------------------------------------*/
+bool PeerConnectionManager::setSharedMediaPort(int udpPort, int tcpPort)
+{
+	if (udpPort <= 0)
+	{
+		RTC_LOG(LS_ERROR) << __FUNCTION__ << " invalid udp port:" << udpPort;
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> peerlock(m_peerMapMutex);
+		if (!peer_connectionobs_map_.empty())
+		{
+			RTC_LOG(LS_ERROR) << __FUNCTION__ << " must be set before the first PeerConnection";
+			return false;
+		}
+	}
+
+	m_networkManager.reset(new rtc::BasicNetworkManager());
+	m_portMux.reset(new SharedPortMux(m_networkThread.get(), udpPort, tcpPort));
+	return true;
+}
+
+/* ---------------------------------------------------------------------------
+**  once the local description is known, its ufrag identifies the peer on the
+**  shared port
+** -------------------------------------------------------------------------*/
+std::function<void(webrtc::SessionDescriptionInterface*)> PeerConnectionManager::registerLocalDescription(
+	const std::string& peerid, std::function<void(webrtc::SessionDescriptionInterface*)> i_funcOnSucess)
+{
+	if (!m_portMux)
+		return i_funcOnSucess;
+
+	return [this, peerid, i_funcOnSucess](webrtc::SessionDescriptionInterface* desc)
+	{
+		m_portMux->registerSessionDescription(peerid, desc);
+		if (i_funcOnSucess)
+			i_funcOnSucess(desc);
+	};
 }
 
 
@@ -407,6 +492,7 @@ PeerConnectionManager::PeerConnectionObserver* PeerConnectionManager::createClie
 				peer_connectionobs_map_.insert(
 					std::pair<std::string, PeerConnectionObserver*>(peerid, peerConnectionObserver));
 			}
+			peerCountChanged();
 		}
 	}
 	return peerConnectionObserver;
@@ -443,6 +529,7 @@ const Json::Value PeerConnectionManager::createOffer(const std::string& peerid,
 			peer_connectionobs_map_.insert(
 				std::pair<std::string, PeerConnectionObserver*>(peerid, peerConnectionObserver));
 		}
+		peerCountChanged();
 			
 		if (!this->AddStreams(peerConnection, options, i_stack))
 		{
@@ -452,7 +539,7 @@ const Json::Value PeerConnectionManager::createOffer(const std::string& peerid,
 		// ask to create offer
 		webrtc::PeerConnectionInterface::RTCOfferAnswerOptions rtcoptions;
 		CreateSessionDescriptionObserver* session_description_observer = CreateSessionDescriptionObserver::Create(peerConnection);
-		session_description_observer->setOnSuccess(i_funcOnSucess);
+		session_description_observer->setOnSuccess(registerLocalDescription(peerid, i_funcOnSucess));
 		peerConnection->CreateOffer(session_description_observer, rtcoptions);
 
 	}
@@ -491,7 +578,7 @@ const Json::Value PeerConnectionManager::createAnswerToClientOffer(const std::st
 	                                                                   webrtc::SessionDescriptionInterface*)>
                                                                    i_funcOnSucess)
 {
-	RTC_LOG(INFO) << jmessage;
+	CLOG(kLogSignaling, LS_VERBOSE) << jmessage;
 	Json::Value answer;
 	std::string type;
 	std::string sdp;
@@ -533,7 +620,7 @@ const Json::Value PeerConnectionManager::createAnswerToClientOffer(const std::st
 				webrtc::PeerConnectionInterface::RTCOfferAnswerOptions rtcoptions;
 				CreateSessionDescriptionObserver* session_description_observer = CreateSessionDescriptionObserver::
 					Create(peerConnection);
-				session_description_observer->setOnSuccess(i_funcOnSucess);
+				session_description_observer->setOnSuccess(registerLocalDescription(peerid, i_funcOnSucess));
 
 				rtcoptions.offer_to_receive_video = 1;
 				/*	rtcoptions.offer_to_receive_audio = 0;*/
@@ -587,7 +674,7 @@ const Json::Value PeerConnectionManager::createAnswerToClientOffer(const std::st
 ** -------------------------------------------------------------------------*/
 void PeerConnectionManager::setAnswer(const std::string& peerid, const Json::Value& jmessage)
 {
-	RTC_LOG(INFO) << jmessage;
+	CLOG(kLogSignaling, LS_VERBOSE) << jmessage;
 
 	std::string type;
 	std::string sdp;
@@ -624,6 +711,11 @@ void PeerConnectionManager::startOpenCVStreaming(const std::string& peer_id,
 {
 	std::string options;
 	PeerConnectionObserver* peer_connection_observer = this->getPeerConnectionObserver(peer_id);
+	if (!peer_connection_observer)
+	{
+		RTC_LOG(LS_ERROR) << __FUNCTION__ << " unknown peerid:" << peer_id;
+		return;
+	}
 
 	this->AddStreams(peer_connection_observer->getPeerConnection(), options, i_stack);
 }
@@ -638,30 +730,95 @@ void PeerConnectionManager::stopOpenCVStreaming(const std::string& peer_id)
 		rtc::scoped_refptr<webrtc::PeerConnectionInterface> peerConnection = pcObserver->getPeerConnection();
 
 		rtc::scoped_refptr<webrtc::StreamCollectionInterface> localstreams(peerConnection->local_streams());
-		for (unsigned int i = 0; i < localstreams->count(); i++)
+		for (unsigned int i = localstreams->count(); i > 0; i--)
 		{
-			auto stream = localstreams->at(i);
-
-			std::string streamLabel = stream->id();
-			bool stillUsed = this->streamStillUsed(streamLabel);
-			if (!stillUsed)
-			{
-				RTC_LOG(LS_ERROR) << "hangUp stream is no more used " << streamLabel;
-				std::lock_guard<std::mutex> mlock(m_streamMapMutex);
-				auto it = stream_map_.find(streamLabel);
-				if (it != stream_map_.end())
-				{
-					stream_map_.erase(it);
-				}
-
-				RTC_LOG(LS_ERROR) << "hangUp stream closed " << streamLabel;
-			}
+			rtc::scoped_refptr<webrtc::MediaStreamInterface> stream(localstreams->at(i - 1));
 
 			peerConnection->RemoveStream(stream);
+			this->releaseStream(stream->id());
 		}
 	}
 }
 
+/* ---------------------------------------------------------------------------
+**  round trip time and target bitrate of each peer, delivered asynchronously
+**  by the stats collectors
+** -------------------------------------------------------------------------*/
+void PeerConnectionManager::samplePeerStats()
+{
+	struct Sample
+	{
+		rtc::scoped_refptr<webrtc::PeerConnectionInterface> peerConnection;
+		rtc::scoped_refptr<RoundTripTimeCallback>           rttCallback;
+		rtc::scoped_refptr<TargetBitrateObserver>           bitrateObserver;
+	};
+	std::vector<Sample> samples;
+	{
+		// the histogram is looked up with the peer in the map: hangUp removes
+		// it after erasing the peer, it is not created again
+		std::lock_guard<std::mutex> peerlock(m_peerMapMutex);
+		samples.reserve(peer_connectionobs_map_.size());
+		for (auto& pair : peer_connectionobs_map_)
+		{
+			Sample sample;
+			sample.peerConnection = pair.second->getPeerConnection();
+			if (!sample.peerConnection)
+				continue;
+			sample.rttCallback = new rtc::RefCountedObject<RoundTripTimeCallback>(
+				LatencyRegistry::instance().get("peer:" + pair.first, kLatencyNetworkRtt));
+			sample.bitrateObserver = new rtc::RefCountedObject<TargetBitrateObserver>(pair.second->getTargetBitrate());
+			samples.push_back(sample);
+		}
+	}
+
+	// GetStats is proxied: not with the peers locked
+	for (const Sample& sample : samples)
+	{
+		sample.peerConnection->GetStats(sample.rttCallback);
+		sample.peerConnection->GetStats(sample.bitrateObserver, nullptr, webrtc::PeerConnectionInterface::kStatsOutputLevelStandard);
+	}
+}
+
+size_t PeerConnectionManager::pendingTeardowns()
+{
+	return m_teardown ? m_teardown->pending() : 0;
+}
+
+void PeerConnectionManager::setOnPeerCountChanged(std::function<void(int)> callback)
+{
+	std::lock_guard<std::mutex> lock(m_peerCountMutex);
+	m_onPeerCountChanged = callback;
+}
+
+void PeerConnectionManager::peerCountChanged()
+{
+	std::lock_guard<std::mutex> lock(m_peerCountMutex);
+	int count = getPeerCount();
+	if (count == m_notifiedPeerCount)
+		return;
+
+	m_notifiedPeerCount = count;
+	if (m_onPeerCountChanged)
+		m_onPeerCountChanged(count);
+}
+
+int PeerConnectionManager::getPeerCount()
+{
+	std::lock_guard<std::mutex> peerlock(m_peerMapMutex);
+	return static_cast<int>(peer_connectionobs_map_.size());
+}
+
+int PeerConnectionManager::getTargetBitrate()
+{
+	int bitrate = 0;
+	std::lock_guard<std::mutex> peerlock(m_peerMapMutex);
+	for (auto& pair : peer_connectionobs_map_)
+	{
+		bitrate += pair.second->getTargetBitrate()->load();
+	}
+	return bitrate;
+}
+
 /* ---------------------------------------------------------------------------
 **  auto-answer to a call
 ** -------------------------------------------------------------------------*/
@@ -709,6 +866,7 @@ const Json::Value PeerConnectionManager::call(const std::string& peerid, const s
 				peer_connectionobs_map_.insert(
 					std::pair<std::string, PeerConnectionObserver*>(peerid, peerConnectionObserver));
 			}
+			peerCountChanged();
 
 			// set remote offer
 			webrtc::SessionDescriptionInterface* session_description(webrtc::CreateSessionDescription(type, sdp, NULL));
@@ -743,7 +901,10 @@ const Json::Value PeerConnectionManager::call(const std::string& peerid, const s
 			webrtc::PeerConnectionInterface::RTCOfferAnswerOptions rtcoptions;
 			rtcoptions.offer_to_receive_video = 0;
 			rtcoptions.offer_to_receive_audio = 0;
-			peerConnection->CreateAnswer(CreateSessionDescriptionObserver::Create(peerConnection), rtcoptions);
+			CreateSessionDescriptionObserver* session_description_observer = CreateSessionDescriptionObserver::
+				Create(peerConnection);
+			session_description_observer->setOnSuccess(registerLocalDescription(peerid, nullptr));
+			peerConnection->CreateAnswer(session_description_observer, rtcoptions);
 
 			RTC_LOG(INFO) << "nbStreams local:" << peerConnection->local_streams()->count() << " remote:" <<
 				peerConnection
@@ -787,23 +948,24 @@ const Json::Value PeerConnectionManager::call(const std::string& peerid, const s
 	return answer;
 }
 
-bool PeerConnectionManager::streamStillUsed(const std::string& streamLabel)
+/* ---------------------------------------------------------------------------
+**  drop one subscriber of a stream, the track is released with the last one
+** -------------------------------------------------------------------------*/
+void PeerConnectionManager::releaseStream(const std::string& streamLabel)
 {
-	bool stillUsed = false;
-	for (auto it : peer_connectionobs_map_)
+	std::lock_guard<std::mutex> mlock(m_streamMapMutex);
+	auto it = stream_map_.find(streamLabel);
+	if (it == stream_map_.end())
 	{
-		rtc::scoped_refptr<webrtc::PeerConnectionInterface> peerConnection = it.second->getPeerConnection();
-		rtc::scoped_refptr<webrtc::StreamCollectionInterface> localstreams(peerConnection->local_streams());
-		for (unsigned int i = 0; i < localstreams->count(); i++)
-		{
-			if (localstreams->at(i)->id() == streamLabel)
-			{
-				stillUsed = true;
-				break;
-			}
-		}
+		return;
+	}
+
+	if (--it->second.subscribers <= 0)
+	{
+		RTC_LOG(LS_ERROR) << "hangUp stream is no more used " << streamLabel;
+		stream_map_.erase(it);
+		RTC_LOG(LS_ERROR) << "hangUp stream closed " << streamLabel;
 	}
-	return stillUsed;
 }
 
 /* ---------------------------------------------------------------------------
@@ -823,39 +985,36 @@ const Json::Value PeerConnectionManager::hangUp(const std::string& peerid)
 			pcObserver = it->second;
 			RTC_LOG(INFO) << "Remove PeerConnection peerid:" << peerid;
 			peer_connectionobs_map_.erase(it);
+			// out of the map, samplePeerStats does not create it again
+			LatencyRegistry::instance().remove("peer:" + peerid);
 		}
 
-		if (pcObserver)
+		if (m_portMux)
+		{
+			m_portMux->unregisterPeer(peerid);
+		}
+	}
+	peerCountChanged();
+
+	if (pcObserver)
+	{
+		// the peer is no more reachable, streams and PeerConnection are released asynchronously
+		m_teardown->post([this, pcObserver]()
 		{
 			rtc::scoped_refptr<webrtc::PeerConnectionInterface> peerConnection = pcObserver->getPeerConnection();
 
 			rtc::scoped_refptr<webrtc::StreamCollectionInterface> localstreams(peerConnection->local_streams());
-			for (unsigned int i = 0; i < localstreams->count(); i++)
+			for (unsigned int i = localstreams->count(); i > 0; i--)
 			{
-				auto stream = localstreams->at(i);
-
-				std::string streamLabel = stream->id();
-				bool stillUsed = this->streamStillUsed(streamLabel);
-				if (!stillUsed)
-				{
-					RTC_LOG(LS_ERROR) << "hangUp stream is no more used " << streamLabel;
-					std::lock_guard<std::mutex> mlock(m_streamMapMutex);
-					std::map<std::string, rtc::scoped_refptr<webrtc::VideoTrackInterface>>::iterator it = stream_map_.
-						find(streamLabel);
-					if (it != stream_map_.end())
-					{
-						stream_map_.erase(it);
-					}
-
-					RTC_LOG(LS_ERROR) << "hangUp stream closed " << streamLabel;
-				}
+				rtc::scoped_refptr<webrtc::MediaStreamInterface> stream(localstreams->at(i - 1));
 
 				peerConnection->RemoveStream(stream);
+				this->releaseStream(stream->id());
 			}
 
 			delete pcObserver;
-			result = true;
-		}
+		});
+		result = true;
 	}
 	Json::Value answer;
 	/*if (result)
@@ -995,8 +1154,27 @@ PeerConnectionManager::PeerConnectionObserver* PeerConnectionManager::CreatePeer
 		config.servers.push_back(server);
 	}
 
+	std::unique_ptr<cricket::PortAllocator> allocator;
+	std::unique_ptr<rtc::PacketSocketFactory> socketFactory;
+	if (m_portMux)
+	{
+		// one 5-tuple per peer
+		config.bundle_policy = webrtc::PeerConnectionInterface::kBundlePolicyMaxBundle;
+		config.rtcp_mux_policy = webrtc::PeerConnectionInterface::kRtcpMuxPolicyRequire;
+
+		// srflx/relay answers cannot be demultiplexed by ufrag, only host candidates are gathered
+		socketFactory = m_portMux->CreateSocketFactory(peerid);
+		allocator.reset(new cricket::BasicPortAllocator(m_networkManager.get(), socketFactory.get()));
+		int flags = cricket::PORTALLOCATOR_DISABLE_STUN | cricket::PORTALLOCATOR_DISABLE_RELAY;
+		if (m_portMux->tcpPort() <= 0)
+		{
+			flags |= cricket::PORTALLOCATOR_DISABLE_TCP;
+		}
+		allocator->set_flags(allocator->flags() | flags);
+	}
+
 	RTC_LOG(INFO) << __FUNCTION__ << "CreatePeerConnection peerid:" << peerid;
-	PeerConnectionObserver* obs = new PeerConnectionObserver(this, peerid, config);
+	PeerConnectionObserver* obs = new PeerConnectionObserver(this, peerid, config, std::move(allocator), std::move(socketFactory));
 	if (!obs)
 	{
 		RTC_LOG(LS_ERROR) << __FUNCTION__ << "CreatePeerConnection failed";
@@ -1149,13 +1327,13 @@ bool PeerConnectionManager::AddStreams(webrtc::PeerConnectionInterface* peer_con
 	                                 [](char c) { return c == ' ' || c == ':' || c == '.' || c == '/'; })
 	                  , streamLabel.end());
 
-	bool existingStream = false;
-	{
-		std::lock_guard<std::mutex> mlock(m_streamMapMutex);
-		existingStream = (stream_map_.find(streamLabel) != stream_map_.end());
-	}
-
-	if (!existingStream)
+	// look up, create and subscribe in one critical section: the teardown thread
+	// releases the subscriber of a leaving peer meanwhile, and two peers joining
+	// together must share one capturer
+	std::lock_guard<std::mutex> mlock(m_streamMapMutex);
+	std::map<std::string, StreamEntry>::iterator it = stream_map_.find(streamLabel);
+	bool createdStream = false;
+	if (it == stream_map_.end())
 	{
 		// compute audiourl if not set
 		/*if (audio.empty()) {
@@ -1196,55 +1374,53 @@ bool PeerConnectionManager::AddStreams(webrtc::PeerConnectionInterface* peer_con
 		// need to create the stream
 		rtc::scoped_refptr<webrtc::VideoTrackInterface> video_track(this->CreateVideoTrack(video, opts, i_stack));
 		/*	rtc::scoped_refptr<webrtc::AudioTrackInterface> audio_track(this->CreateAudioTrack(audio, opts));*/
+		if (!video_track)
+		{
+			RTC_LOG(LS_ERROR) << "Cannot create stream " << streamLabel;
+			return false;
+		}
 		RTC_LOG(INFO) << "Adding Stream to map";
-		std::lock_guard<std::mutex> mlock(m_streamMapMutex);
-		stream_map_[streamLabel] = video_track;
+		it = stream_map_.insert(std::make_pair(streamLabel, StreamEntry(video_track))).first;
+		createdStream = true;
 	}
 
-
+	rtc::scoped_refptr<webrtc::MediaStreamInterface> stream = peer_connection_factory_->CreateLocalMediaStream(
+		streamLabel);
+	if (!stream.get())
 	{
-		std::lock_guard<std::mutex> mlock(m_streamMapMutex);
-		std::map<std::string, rtc::scoped_refptr<webrtc::VideoTrackInterface>>::iterator it = stream_map_.find(
-			streamLabel);
-		if (it != stream_map_.end())
+		RTC_LOG(LS_ERROR) << "Cannot create stream";
+	}
+	else
+	{
+		//std::pair < rtc::scoped_refptr<webrtc::VideoTrackInterface>, rtc::scoped_refptr<webrtc::AudioTrackInterface> > pair = it->second;
+		rtc::scoped_refptr<webrtc::VideoTrackInterface> video_track(it->second.track);
+		if ((video_track) && (!stream->AddTrack(video_track)))
 		{
-			rtc::scoped_refptr<webrtc::MediaStreamInterface> stream = peer_connection_factory_->CreateLocalMediaStream(
-				streamLabel);
-			if (!stream.get())
-			{
-				RTC_LOG(LS_ERROR) << "Cannot create stream";
-			}
-			else
-			{
-				//std::pair < rtc::scoped_refptr<webrtc::VideoTrackInterface>, rtc::scoped_refptr<webrtc::AudioTrackInterface> > pair = it->second;
-				rtc::scoped_refptr<webrtc::VideoTrackInterface> video_track(it->second);
-				if ((video_track) && (!stream->AddTrack(video_track)))
-				{
-					RTC_LOG(LS_ERROR) << "Adding VideoTrack to MediaStream failed";
-				}
+			RTC_LOG(LS_ERROR) << "Adding VideoTrack to MediaStream failed";
+		}
 
-				/*rtc::scoped_refptr<webrtc::AudioTrackInterface> audio_track(pair.second);
-				if ((audio_track) && (!stream->AddTrack(audio_track)))
-				{
-					RTC_LOG(LS_ERROR) << "Adding AudioTrack to MediaStream failed";
-				}
+		/*rtc::scoped_refptr<webrtc::AudioTrackInterface> audio_track(pair.second);
+		if ((audio_track) && (!stream->AddTrack(audio_track)))
+		{
+			RTC_LOG(LS_ERROR) << "Adding AudioTrack to MediaStream failed";
+		}
 */
-				if (!peer_connection->AddStream(stream))
-				{
-					RTC_LOG(LS_ERROR) << "Adding stream to PeerConnection failed";
-				}
-				else
-				{
-					RTC_LOG(INFO) << "stream added to PeerConnection";
-					ret = true;
-				}
-			}
+		if (!peer_connection->AddStream(stream))
+		{
+			RTC_LOG(LS_ERROR) << "Adding stream to PeerConnection failed";
 		}
 		else
 		{
-			RTC_LOG(LS_ERROR) << "Cannot find stream";
+			RTC_LOG(INFO) << "stream added to PeerConnection";
+			it->second.subscribers++;
+			ret = true;
 		}
 	}
+	// a track nobody subscribed to is not kept
+	if (createdStream && it->second.subscribers == 0)
+	{
+		stream_map_.erase(it);
+	}
 
 	return ret;
 }
@@ -1255,6 +1431,12 @@ void PeerConnectionManager::PeerConnectionObserver::SetOnIceCandidate(
 	funcOnIceCandidate = i_funcOnIceCandidate;
 }
 
+void PeerConnectionManager::PeerConnectionObserver::SetOnIceGatheringComplete(
+	std::function<void()> i_funcOnIceGatheringComplete)
+{
+	funcOnIceGatheringComplete = i_funcOnIceGatheringComplete;
+}
+
 /* ---------------------------------------------------------------------------
 **  ICE callback
 ** -------------------------------------------------------------------------*/
@@ -0,0 +1,538 @@
+#include "internal/SharedFrameRing.h"
+#include "internal/LatencyHistogram.h"
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <signal.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <rtc_base/logging.h>
+
+namespace
+{
+	size_t align64(size_t size)
+	{
+		return (size + 63) & ~static_cast<size_t>(63);
+	}
+
+	// POSIX shared memory names start with a slash
+	std::string shmName(const std::string& name)
+	{
+		return (!name.empty() && name[0] == '/') ? name : "/" + name;
+	}
+
+	// The words of the ring are plain integers of the C layout, accessed as
+	// std::atomic of the same size: lock free, so across processes as well.
+	static_assert(ATOMIC_INT_LOCK_FREE == 2, "the ring needs lock free 32 bit atomics");
+
+	template <typename T>
+	std::atomic<T>* atomicAt(const T* word)
+	{
+		static_assert(sizeof(std::atomic<T>) == sizeof(T), "atomic and plain words differ");
+		return reinterpret_cast<std::atomic<T> *>(const_cast<T *>(word));
+	}
+
+	template <typename T>
+	T load(const T* word)
+	{
+		return atomicAt(word)->load(std::memory_order_acquire);
+	}
+
+	template <typename T>
+	void store(T* word, T value)
+	{
+		atomicAt(word)->store(value, std::memory_order_release);
+	}
+
+	bool exchange(uint32_t* word, uint32_t expected, uint32_t desired)
+	{
+		return atomicAt(word)->compare_exchange_strong(expected, desired, std::memory_order_acq_rel, std::memory_order_acquire);
+	}
+
+	// one more reader of a published slot, false while it is free or written
+	bool share(uint32_t* state)
+	{
+		uint32_t current = load(state);
+		while (current == WEBRTC_SLOT_READY || current >= WEBRTC_SLOT_READING)
+		{
+			uint32_t desired = current == WEBRTC_SLOT_READY ? WEBRTC_SLOT_READING : current + 1;
+			if (atomicAt(state)->compare_exchange_strong(current, desired, std::memory_order_acq_rel, std::memory_order_acquire))
+				return true;
+		}
+		return false;
+	}
+
+	// the last reader leaves the frame READY: the writer may take it back unless it is the latest
+	void unshare(uint32_t* state)
+	{
+		uint32_t current = load(state);
+		while (current >= WEBRTC_SLOT_READING)
+		{
+			uint32_t desired = current == WEBRTC_SLOT_READING ? WEBRTC_SLOT_READY : current - 1;
+			if (atomicAt(state)->compare_exchange_strong(current, desired, std::memory_order_acq_rel, std::memory_order_acquire))
+				return;
+		}
+	}
+
+	uint32_t currentPid()
+	{
+#ifdef __linux__
+		return static_cast<uint32_t>(getpid());
+#else
+		return 1;
+#endif
+	}
+
+	// EPERM: alive, owned by another user
+	bool processAlive(uint32_t pid)
+	{
+#ifdef __linux__
+		return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+#else
+		(void)pid;
+		return true;
+#endif
+	}
+
+#ifdef __linux__
+	// shared (not private) futex: the word is mapped in both processes
+	void futexWait(uint32_t* word, uint32_t expected, int64_t timeoutUs)
+	{
+		timespec timeout;
+		timeout.tv_sec = static_cast<time_t>(timeoutUs / 1000000);
+		timeout.tv_nsec = static_cast<long>((timeoutUs % 1000000) * 1000);
+		syscall(SYS_futex, word, FUTEX_WAIT, expected, &timeout, nullptr, 0);
+	}
+
+	void futexWake(uint32_t* word)
+	{
+		syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+	}
+#endif
+
+	// Mat over a slot: releases it when the last copy of the Mat goes away
+	class SlotAllocator : public cv::MatAllocator
+	{
+	public:
+#if CV_VERSION_MAJOR >= 4
+		typedef cv::AccessFlag AccessFlags;
+#else
+		typedef int AccessFlags;
+#endif
+
+		SlotAllocator(std::shared_ptr<SharedFrameRing> ring, int slot) : m_ring(ring), m_slot(slot)
+		{
+		}
+
+		cv::UMatData* allocate(int, const int*, int, void*, size_t*, AccessFlags, cv::UMatUsageFlags) const override
+		{
+			return nullptr;
+		}
+
+		bool allocate(cv::UMatData*, AccessFlags, cv::UMatUsageFlags) const override
+		{
+			return false;
+		}
+
+		void deallocate(cv::UMatData* data) const override
+		{
+			m_ring->release(m_slot);
+			delete data;
+			delete this;
+		}
+
+	private:
+		std::shared_ptr<SharedFrameRing> m_ring;
+		int                              m_slot;
+	};
+}
+
+SharedFrameRing::SharedFrameRing(const std::string& name, void* base, size_t size, bool owner)
+	: m_name(name), m_base(base), m_size(size), m_owner(owner), m_reader(-1)
+{
+	const WebRTCSharedRingHeader* ring = header();
+	m_slotCount = static_cast<int>(ring->slot_count);
+	m_slotBytes = static_cast<size_t>(ring->slot_bytes);
+	m_slotStride = static_cast<size_t>(ring->slot_stride);
+	m_firstSlot = static_cast<size_t>(ring->first_slot);
+	m_holds.assign(m_slotCount, 0);
+}
+
+SharedFrameRing::~SharedFrameRing()
+{
+	// slots a C API reader did not release
+	if (m_reader >= 0)
+	{
+		for (int slot = 0; slot < slotCount(); slot++)
+		{
+			if (m_holds[slot] > 0)
+			{
+				m_holds[slot] = 1;
+				unhold(slot);
+			}
+		}
+		store(&header()->reader_pids[m_reader], 0u);
+	}
+#ifdef __linux__
+	munmap(m_base, m_size);
+	if (m_owner)
+		shm_unlink(m_name.c_str());
+#endif
+}
+
+std::shared_ptr<SharedFrameRing> SharedFrameRing::create(const std::string& name, int slots, size_t slotBytes)
+{
+#ifdef __linux__
+	if (slots < 1 || slotBytes == 0)
+		return nullptr;
+
+	std::string path = shmName(name);
+	size_t first = align64(sizeof(WebRTCSharedRingHeader));
+	size_t stride = align64(WEBRTC_SHARED_RING_SLOT_HEADER + slotBytes);
+	size_t size = first + stride * slots;
+
+	// a ring left by a crashed owner is replaced
+	shm_unlink(path.c_str());
+	int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+	{
+		RTC_LOG(LS_ERROR) << "shm_open " << path << " failed: " << errno;
+		return nullptr;
+	}
+	void* base = MAP_FAILED;
+	if (ftruncate(fd, static_cast<off_t>(size)) == 0)
+		base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		RTC_LOG(LS_ERROR) << "mapping " << size << " bytes for " << path << " failed: " << errno;
+		shm_unlink(path.c_str());
+		return nullptr;
+	}
+
+	// ftruncate zero fills: every slot is FREE
+	WebRTCSharedRingHeader* header = static_cast<WebRTCSharedRingHeader *>(base);
+	header->version = WEBRTC_SHARED_RING_VERSION;
+	header->slot_count = static_cast<uint32_t>(slots);
+	header->latest = -1;
+	header->slot_bytes = slotBytes;
+	header->slot_stride = stride;
+	header->first_slot = first;
+	// published last: a reader checks the magic before anything else
+	store(&header->magic, static_cast<uint32_t>(WEBRTC_SHARED_RING_MAGIC));
+
+	return std::shared_ptr<SharedFrameRing>(new SharedFrameRing(path, base, size, true));
+#else
+	(void)name; (void)slots; (void)slotBytes;
+	return nullptr;
+#endif
+}
+
+std::shared_ptr<SharedFrameRing> SharedFrameRing::open(const std::string& name)
+{
+#ifdef __linux__
+	std::string path = shmName(name);
+	int fd = shm_open(path.c_str(), O_RDWR, 0);
+	if (fd < 0)
+		return nullptr;
+
+	struct stat status;
+	void* base = MAP_FAILED;
+	size_t size = 0;
+	if (fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(WebRTCSharedRingHeader))
+	{
+		size = static_cast<size_t>(status.st_size);
+		base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (base == MAP_FAILED)
+		return nullptr;
+
+	const WebRTCSharedRingHeader* header = static_cast<const WebRTCSharedRingHeader *>(base);
+	if (load(&header->magic) != WEBRTC_SHARED_RING_MAGIC || header->version != WEBRTC_SHARED_RING_VERSION
+		|| header->slot_count < 1 || header->slot_count > INT_MAX
+		|| header->slot_bytes > size || header->slot_stride > size || header->first_slot > size
+		|| header->first_slot + header->slot_stride * header->slot_count > size
+		|| header->slot_stride < WEBRTC_SHARED_RING_SLOT_HEADER + header->slot_bytes)
+	{
+		RTC_LOG(LS_ERROR) << path << " is not a frame ring";
+		munmap(base, size);
+		return nullptr;
+	}
+
+	return std::shared_ptr<SharedFrameRing>(new SharedFrameRing(path, base, size, false));
+#else
+	(void)name;
+	return nullptr;
+#endif
+}
+
+WebRTCSharedRingHeader* SharedFrameRing::header() const
+{
+	return static_cast<WebRTCSharedRingHeader *>(m_base);
+}
+
+WebRTCSharedRingSlot* SharedFrameRing::slotAt(int slot) const
+{
+	uint8_t* base = static_cast<uint8_t *>(m_base);
+	return reinterpret_cast<WebRTCSharedRingSlot *>(base + m_firstSlot + m_slotStride * slot);
+}
+
+int SharedFrameRing::slotCount() const
+{
+	return m_slotCount;
+}
+
+size_t SharedFrameRing::slotBytes() const
+{
+	return m_slotBytes;
+}
+
+size_t SharedFrameRing::frameBytes(uint32_t format, int width, int height, int channels, int stride)
+{
+	if (width <= 0 || height <= 0)
+		return 0;
+
+	size_t rows = static_cast<size_t>(height);
+	if (format == WEBRTC_RING_I420)
+	{
+		if (stride < width)
+			return 0;
+		size_t chroma = static_cast<size_t>((stride + 1) / 2) * ((rows + 1) / 2);
+		return static_cast<size_t>(stride) * rows + 2 * chroma;
+	}
+	if (format != WEBRTC_RING_PACKED || (channels != 1 && channels != 3 && channels != 4) || stride < width * channels)
+		return 0;
+	return static_cast<size_t>(stride) * rows;
+}
+
+uint8_t* SharedFrameRing::pixels(int slot)
+{
+	return reinterpret_cast<uint8_t *>(slotAt(slot)) + WEBRTC_SHARED_RING_SLOT_HEADER;
+}
+
+bool SharedFrameRing::frameInfo(int slot, WebRTCSharedRingSlot& info) const
+{
+	if (slot < 0 || slot >= slotCount())
+		return false;
+
+	// checked once on a copy: the other process may still change the slot
+	memcpy(&info, slotAt(slot), sizeof(info));
+	if (info.channels != 1 && info.channels != 3 && info.channels != 4)
+		return false;
+	size_t bytes = frameBytes(info.format, info.width, info.height, info.channels, info.stride);
+	return bytes != 0 && bytes <= slotBytes();
+}
+
+int SharedFrameRing::acquireWrite()
+{
+	int count = slotCount();
+	int latest = load(&header()->latest);
+	if (latest < 0 || latest >= count)
+		latest = -1;
+
+	// a free slot after the latest one, else the oldest frame nobody took,
+	// else the same after taking back the slots of crashed readers
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		if (attempt == 1)
+			reclaimDeadReaders();
+		for (int i = 1; i <= count; i++)
+		{
+			int slot = (latest + i + count) % count;
+			if (exchange(&slotAt(slot)->state, WEBRTC_SLOT_FREE, WEBRTC_SLOT_WRITING))
+				return slot;
+		}
+		for (int i = 1; i < count; i++)
+		{
+			int slot = (latest + i + count) % count;
+			if (slot != latest && exchange(&slotAt(slot)->state, WEBRTC_SLOT_READY, WEBRTC_SLOT_WRITING))
+				return slot;
+		}
+	}
+	return -1;
+}
+
+void SharedFrameRing::reclaimDeadReaders()
+{
+	WebRTCSharedRingHeader* ring = header();
+	for (uint32_t reader = 0; reader < WEBRTC_SHARED_RING_MAX_READERS; reader++)
+	{
+		uint32_t pid = load(&ring->reader_pids[reader]);
+		if (pid == 0 || pid == WEBRTC_READER_RECLAIMING || processAlive(pid)
+			|| !exchange(&ring->reader_pids[reader], pid, WEBRTC_READER_RECLAIMING))
+			continue;
+
+		// the entry is ours: no reader sets the bit until it is free again
+		uint32_t bit = 1u << reader;
+		int reclaimed = 0;
+		for (int slot = 0; slot < slotCount(); slot++)
+		{
+			if (atomicAt(&slotAt(slot)->readers)->fetch_and(~bit, std::memory_order_acq_rel) & bit)
+			{
+				unshare(&slotAt(slot)->state);
+				reclaimed++;
+			}
+		}
+		store(&ring->reader_pids[reader], 0u);
+		RTC_LOG(LS_WARNING) << m_name << ": reader " << pid << " is gone, " << reclaimed << " slots taken back";
+	}
+}
+
+bool SharedFrameRing::publish(int slot, int width, int height, int channels, int stride, int64_t timestampUs,
+                              uint32_t format)
+{
+	if (slot < 0 || slot >= slotCount())
+		return false;
+
+	WebRTCSharedRingSlot* target = slotAt(slot);
+	if (format == WEBRTC_RING_I420)
+		channels = 1;
+	size_t bytes = frameBytes(format, width, height, channels, stride);
+	if (bytes == 0 || bytes > slotBytes())
+	{
+		store(&target->state, static_cast<uint32_t>(WEBRTC_SLOT_FREE));
+		return false;
+	}
+
+	WebRTCSharedRingHeader* ring = header();
+	target->width = width;
+	target->height = height;
+	target->channels = channels;
+	target->stride = stride;
+	target->format = format;
+	target->timestamp_us = timestampUs;
+	target->sequence = load(&ring->published) + 1;
+	store(&target->state, static_cast<uint32_t>(WEBRTC_SLOT_READY));
+	store(&ring->latest, static_cast<int32_t>(slot));
+	atomicAt(&ring->published)->fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+	futexWake(&ring->published);
+#endif
+	return true;
+}
+
+int SharedFrameRing::acquireRead(uint32_t& lastPublished, int timeoutMs)
+{
+	WebRTCSharedRingHeader* ring = header();
+	int64_t deadline = LatencyHistogram::nowUs() + static_cast<int64_t>(timeoutMs) * 1000;
+	while (true)
+	{
+		uint32_t published = load(&ring->published);
+		if (published != lastPublished)
+		{
+			int latest = load(&ring->latest);
+			std::unique_lock<std::mutex> lock(m_holdsMutex);
+			if (!lease())
+				return -1;
+			if (latest >= 0 && latest < slotCount() && hold(latest))
+			{
+				uint32_t sequence = static_cast<uint32_t>(slotAt(latest)->sequence);
+				if (sequence != lastPublished)
+				{
+					lastPublished = sequence;
+					return latest;
+				}
+				unhold(latest);
+			}
+			// the writer took the slot back after a newer publish: look again
+			else if (load(&ring->published) != published)
+				continue;
+			lastPublished = published;
+		}
+
+		int64_t remaining = deadline - LatencyHistogram::nowUs();
+		if (remaining <= 0)
+			return -1;
+#ifdef __linux__
+		futexWait(&ring->published, published, remaining);
+#endif
+	}
+}
+
+void SharedFrameRing::release(int slot)
+{
+	if (slot < 0 || slot >= slotCount())
+		return;
+	std::lock_guard<std::mutex> lock(m_holdsMutex);
+	if (m_holds[slot] > 0)
+		unhold(slot);
+}
+
+bool SharedFrameRing::lease()
+{
+	if (m_reader >= 0)
+		return true;
+
+	uint32_t pid = currentPid();
+	WebRTCSharedRingHeader* ring = header();
+	for (uint32_t reader = 0; reader < WEBRTC_SHARED_RING_MAX_READERS; reader++)
+	{
+		if (exchange(&ring->reader_pids[reader], 0, pid))
+		{
+			m_reader = static_cast<int>(reader);
+			return true;
+		}
+	}
+	RTC_LOG(LS_ERROR) << m_name << ": more than " << WEBRTC_SHARED_RING_MAX_READERS << " readers";
+	return false;
+}
+
+bool SharedFrameRing::hold(int slot)
+{
+	// a slot this reader holds is not written: the frame is still there
+	if (m_holds[slot] == 0)
+	{
+		if (!share(&slotAt(slot)->state))
+			return false;
+		// a crash before the bit is set leaks the slot, never a count of another reader
+		atomicAt(&slotAt(slot)->readers)->fetch_or(1u << m_reader, std::memory_order_acq_rel);
+	}
+	m_holds[slot]++;
+	return true;
+}
+
+void SharedFrameRing::unhold(int slot)
+{
+	if (--m_holds[slot] > 0)
+		return;
+	atomicAt(&slotAt(slot)->readers)->fetch_and(~(1u << m_reader), std::memory_order_acq_rel);
+	unshare(&slotAt(slot)->state);
+}
+
+cv::Mat SharedFrameRing::readLatest(uint32_t& lastPublished, int timeoutMs)
+{
+	int slot = acquireRead(lastPublished, timeoutMs);
+	if (slot < 0)
+		return cv::Mat();
+
+	// a writer in another process is not trusted with the size of the Mat
+	WebRTCSharedRingSlot info;
+	if (!frameInfo(slot, info) || info.format != WEBRTC_RING_PACKED)
+	{
+		release(slot);
+		return cv::Mat();
+	}
+	uint8_t* data = pixels(slot);
+	cv::Mat frame(info.height, info.width, CV_8UC(info.channels), data, static_cast<size_t>(info.stride));
+
+	// refcounted like an OpenCV allocation, WebRTCStreamer::Send then queues it without copy
+	SlotAllocator* allocator = new SlotAllocator(shared_from_this(), slot);
+	cv::UMatData* owner = new cv::UMatData(allocator);
+	owner->data = owner->origdata = data;
+	owner->size = static_cast<size_t>(info.stride) * info.height;
+	owner->refcount = 1;
+	frame.u = owner;
+	return frame;
+}
@@ -0,0 +1,542 @@
+#define _WINSOCKAPI_
+#include "internal/SharedPortMux.h"
+#include "internal/AsyncLog.h"
+
+/* ---------------------------------------------------------------------------
+** This software is in the public domain, furnished "as is", without technical
+** support, and with no warranty, express or implied, as to its usefulness for
+** any purpose.
+**
+** SharedPortMux.cpp
+**
+** -------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cerrno>
+
+#include "pc/sessiondescription.h"
+#include "rtc_base/logging.h"
+
+namespace
+{
+	const size_t kStunHeaderSize = 20;
+	const uint32_t kStunMagicCookie = 0x2112A442;
+	const uint16_t kStunAttrUsername = 0x0006;
+
+	inline uint16_t readU16(const uint8_t* p) { return static_cast<uint16_t>((p[0] << 8) | p[1]); }
+	inline uint32_t readU32(const uint8_t* p) { return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]; }
+}
+
+/* ---------------------------------------------------------------------------
+**  virtual UDP socket : one per PeerConnection port, backed by the shared socket
+** -------------------------------------------------------------------------*/
+class SharedPortMux::MuxedUdpSocket : public rtc::AsyncPacketSocket
+{
+public:
+	MuxedUdpSocket(SharedPortMux* mux, const std::string& peerid, const rtc::SocketAddress& local_address)
+		: m_mux(mux), m_peerid(peerid), m_localAddress(local_address), m_error(0) {}
+
+	virtual ~MuxedUdpSocket() { Close(); }
+
+	const std::string& peerid() const { return m_peerid; }
+	void detach() { m_mux = nullptr; }
+
+	rtc::SocketAddress GetLocalAddress() const override { return m_localAddress; }
+	rtc::SocketAddress GetRemoteAddress() const override { return rtc::SocketAddress(); }
+
+	int Send(const void* pv, size_t cb, const rtc::PacketOptions& options) override
+	{
+		m_error = ENOTCONN;
+		return -1;
+	}
+
+	int SendTo(const void* pv, size_t cb, const rtc::SocketAddress& addr, const rtc::PacketOptions& options) override
+	{
+		if (!m_mux)
+		{
+			m_error = ENOTCONN;
+			return -1;
+		}
+		return m_mux->sendUdp(this, pv, cb, addr, options);
+	}
+
+	int Close() override
+	{
+		if (m_mux)
+		{
+			m_mux->releaseUdpSocket(this);
+			m_mux = nullptr;
+		}
+		return 0;
+	}
+
+	State GetState() const override { return m_mux ? STATE_BOUND : STATE_CLOSED; }
+
+	int GetOption(rtc::Socket::Option opt, int* value) override
+	{
+		rtc::AsyncPacketSocket* real = shared();
+		return real ? real->GetOption(opt, value) : -1;
+	}
+
+	int SetOption(rtc::Socket::Option opt, int value) override
+	{
+		rtc::AsyncPacketSocket* real = shared();
+		return real ? real->SetOption(opt, value) : -1;
+	}
+
+	int GetError() const override { return m_error; }
+	void SetError(int error) override { m_error = error; }
+
+private:
+	rtc::AsyncPacketSocket* shared() const
+	{
+		if (!m_mux) return nullptr;
+		UdpEndpoint* endpoint = m_mux->getUdpEndpoint(m_localAddress.ipaddr());
+		return endpoint ? endpoint->socket.get() : nullptr;
+	}
+
+	SharedPortMux* m_mux;
+	const std::string m_peerid;
+	const rtc::SocketAddress m_localAddress;
+	int m_error;
+};
+
+/* ---------------------------------------------------------------------------
+**  virtual passive TCP socket : accepted connections are handed over once
+**  their first STUN request tells which peer they belong to
+** -------------------------------------------------------------------------*/
+class SharedPortMux::MuxedTcpServerSocket : public rtc::AsyncPacketSocket
+{
+public:
+	MuxedTcpServerSocket(SharedPortMux* mux, const std::string& peerid, const rtc::SocketAddress& local_address)
+		: m_mux(mux), m_peerid(peerid), m_localAddress(local_address), m_error(0) {}
+
+	virtual ~MuxedTcpServerSocket() { Close(); }
+
+	const std::string& peerid() const { return m_peerid; }
+	void detach() { m_mux = nullptr; }
+
+	rtc::SocketAddress GetLocalAddress() const override { return m_localAddress; }
+	rtc::SocketAddress GetRemoteAddress() const override { return rtc::SocketAddress(); }
+
+	int Send(const void* pv, size_t cb, const rtc::PacketOptions& options) override
+	{
+		m_error = ENOTCONN;
+		return -1;
+	}
+
+	int SendTo(const void* pv, size_t cb, const rtc::SocketAddress& addr, const rtc::PacketOptions& options) override
+	{
+		m_error = ENOTCONN;
+		return -1;
+	}
+
+	int Close() override
+	{
+		if (m_mux)
+		{
+			m_mux->releaseTcpServerSocket(this);
+			m_mux = nullptr;
+		}
+		return 0;
+	}
+
+	State GetState() const override { return m_mux ? STATE_BOUND : STATE_CLOSED; }
+	int GetOption(rtc::Socket::Option opt, int* value) override { return -1; }
+	int SetOption(rtc::Socket::Option opt, int value) override { return 0; }
+	int GetError() const override { return m_error; }
+	void SetError(int error) override { m_error = error; }
+
+private:
+	SharedPortMux* m_mux;
+	const std::string m_peerid;
+	const rtc::SocketAddress m_localAddress;
+	int m_error;
+};
+
+/* ---------------------------------------------------------------------------
+**  per PeerConnection socket factory
+** -------------------------------------------------------------------------*/
+SharedPortMux::PeerSocketFactory::PeerSocketFactory(SharedPortMux* mux, const std::string& peerid)
+	: rtc::BasicPacketSocketFactory(mux->m_networkThread)
+	  , m_mux(mux)
+	  , m_peerid(peerid)
+{
+}
+
+rtc::AsyncPacketSocket* SharedPortMux::PeerSocketFactory::CreateUdpSocket(const rtc::SocketAddress& local_address,
+                                                                          uint16_t min_port, uint16_t max_port)
+{
+	return m_mux->CreateUdpSocket(m_peerid, local_address);
+}
+
+rtc::AsyncPacketSocket* SharedPortMux::PeerSocketFactory::CreateServerTcpSocket(
+	const rtc::SocketAddress& local_address, uint16_t min_port, uint16_t max_port, int opts)
+{
+	if (m_mux->tcpPort() <= 0)
+	{
+		return rtc::BasicPacketSocketFactory::CreateServerTcpSocket(local_address, min_port, max_port, opts);
+	}
+	return m_mux->CreateTcpServerSocket(m_peerid, local_address);
+}
+
+/* ---------------------------------------------------------------------------
+**  Constructor
+** -------------------------------------------------------------------------*/
+SharedPortMux::SharedPortMux(rtc::Thread* network_thread, int udp_port, int tcp_port)
+	: m_networkThread(network_thread)
+	  , m_udpPort(udp_port)
+	  , m_tcpPort(tcp_port)
+{
+	RTC_LOG(INFO) << __FUNCTION__ << " udp:" << udp_port << " tcp:" << tcp_port;
+}
+
+/* ---------------------------------------------------------------------------
+**  Destructor
+** -------------------------------------------------------------------------*/
+SharedPortMux::~SharedPortMux()
+{
+	// sockets belong to the network thread
+	m_networkThread->Invoke<void>(RTC_FROM_HERE, [this]()
+	{
+		for (auto& endpoint : m_udpEndpoints)
+		{
+			for (auto& peer : endpoint.second->peers)
+				peer.second->detach();
+		}
+		for (auto& endpoint : m_tcpEndpoints)
+		{
+			for (auto& peer : endpoint.second->peers)
+				peer.second->detach();
+		}
+		m_pendingTcp.clear();
+		m_tcpEndpoints.clear();
+		m_udpEndpoints.clear();
+	});
+}
+
+std::unique_ptr<rtc::PacketSocketFactory> SharedPortMux::CreateSocketFactory(const std::string& peerid)
+{
+	return std::unique_ptr<rtc::PacketSocketFactory>(new PeerSocketFactory(this, peerid));
+}
+
+/* ---------------------------------------------------------------------------
+**  ufrag registration (signaling thread)
+** -------------------------------------------------------------------------*/
+void SharedPortMux::registerSessionDescription(const std::string& peerid,
+                                               const webrtc::SessionDescriptionInterface* desc)
+{
+	if (!desc || !desc->description())
+		return;
+
+	std::lock_guard<std::mutex> lock(m_ufragMutex);
+	for (const cricket::TransportInfo& info : desc->description()->transport_infos())
+	{
+		RTC_LOG(INFO) << __FUNCTION__ << " peerid:" << peerid << " ufrag:" << info.description.ice_ufrag;
+		m_ufragToPeer[info.description.ice_ufrag] = peerid;
+	}
+}
+
+void SharedPortMux::unregisterPeer(const std::string& peerid)
+{
+	std::lock_guard<std::mutex> lock(m_ufragMutex);
+	for (auto it = m_ufragToPeer.begin(); it != m_ufragToPeer.end();)
+	{
+		if (it->second == peerid)
+			it = m_ufragToPeer.erase(it);
+		else
+			++it;
+	}
+}
+
+std::string SharedPortMux::getPeerFromUfrag(const std::string& ufrag)
+{
+	std::lock_guard<std::mutex> lock(m_ufragMutex);
+	auto it = m_ufragToPeer.find(ufrag);
+	return (it != m_ufragToPeer.end()) ? it->second : std::string();
+}
+
+std::string SharedPortMux::GetStunLocalUfrag(const char* data, size_t size)
+{
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+	if (size < kStunHeaderSize || (p[0] & 0xC0) != 0 || readU32(p + 4) != kStunMagicCookie)
+		return std::string();
+
+	// only requests carry the USERNAME "receiver:sender"
+	const uint16_t type = readU16(p);
+	if ((type & 0x0110) != 0)
+		return std::string();
+
+	const size_t end = kStunHeaderSize + readU16(p + 2);
+	if (end > size)
+		return std::string();
+
+	size_t pos = kStunHeaderSize;
+	while (pos + 4 <= end)
+	{
+		const uint16_t attrType = readU16(p + pos);
+		const uint16_t attrLen = readU16(p + pos + 2);
+		if (pos + 4 + attrLen > end)
+			break;
+		if (attrType == kStunAttrUsername)
+		{
+			std::string username(data + pos + 4, attrLen);
+			return username.substr(0, username.find(':'));
+		}
+		pos += 4 + ((attrLen + 3) & ~3);
+	}
+	return std::string();
+}
+
+/* ---------------------------------------------------------------------------
+**  shared sockets (network thread)
+** -------------------------------------------------------------------------*/
+SharedPortMux::UdpEndpoint* SharedPortMux::getUdpEndpoint(const rtc::IPAddress& ip)
+{
+	auto it = m_udpEndpoints.find(ip);
+	if (it != m_udpEndpoints.end())
+		return it->second.get();
+
+	rtc::SocketAddress bindAddress(ip, m_udpPort);
+	std::unique_ptr<rtc::AsyncPacketSocket> socket(
+		rtc::AsyncUDPSocket::Create(m_networkThread->socketserver(), bindAddress));
+	if (!socket)
+	{
+		RTC_LOG(LS_ERROR) << "Cannot bind shared UDP port " << bindAddress.ToString();
+		return nullptr;
+	}
+	RTC_LOG(INFO) << "Shared UDP port bound " << socket->GetLocalAddress().ToString();
+
+	socket->SignalReadPacket.connect(this, &SharedPortMux::OnUdpReadPacket);
+	socket->SignalSentPacket.connect(this, &SharedPortMux::OnUdpSentPacket);
+	socket->SignalReadyToSend.connect(this, &SharedPortMux::OnUdpReadyToSend);
+
+	std::unique_ptr<UdpEndpoint> endpoint(new UdpEndpoint());
+	endpoint->socket = std::move(socket);
+	endpoint->sending = nullptr;
+	UdpEndpoint* result = endpoint.get();
+	m_udpEndpoints[ip] = std::move(endpoint);
+	return result;
+}
+
+SharedPortMux::TcpEndpoint* SharedPortMux::getTcpEndpoint(const rtc::IPAddress& ip)
+{
+	auto it = m_tcpEndpoints.find(ip);
+	if (it != m_tcpEndpoints.end())
+		return it->second.get();
+
+	rtc::SocketAddress bindAddress(ip, m_tcpPort);
+	std::unique_ptr<rtc::AsyncSocket> listener(
+		m_networkThread->socketserver()->CreateAsyncSocket(ip.family(), SOCK_STREAM));
+	if (!listener || listener->Bind(bindAddress) < 0 || listener->Listen(SOMAXCONN) < 0)
+	{
+		RTC_LOG(LS_ERROR) << "Cannot listen on shared TCP port " << bindAddress.ToString();
+		return nullptr;
+	}
+	RTC_LOG(INFO) << "Shared TCP port listening " << listener->GetLocalAddress().ToString();
+
+	listener->SignalReadEvent.connect(this, &SharedPortMux::OnTcpAccept);
+
+	std::unique_ptr<TcpEndpoint> endpoint(new TcpEndpoint());
+	endpoint->listener = std::move(listener);
+	TcpEndpoint* result = endpoint.get();
+	m_tcpEndpoints[ip] = std::move(endpoint);
+	return result;
+}
+
+SharedPortMux::MuxedUdpSocket* SharedPortMux::CreateUdpSocket(const std::string& peerid,
+                                                              const rtc::SocketAddress& local_address)
+{
+	UdpEndpoint* endpoint = getUdpEndpoint(local_address.ipaddr());
+	if (!endpoint)
+		return nullptr;
+
+	MuxedUdpSocket* socket = new MuxedUdpSocket(this, peerid, endpoint->socket->GetLocalAddress());
+	endpoint->peers[peerid] = socket;
+	return socket;
+}
+
+SharedPortMux::MuxedTcpServerSocket* SharedPortMux::CreateTcpServerSocket(const std::string& peerid,
+                                                                          const rtc::SocketAddress& local_address)
+{
+	TcpEndpoint* endpoint = getTcpEndpoint(local_address.ipaddr());
+	if (!endpoint)
+		return nullptr;
+
+	MuxedTcpServerSocket* socket = new MuxedTcpServerSocket(this, peerid, endpoint->listener->GetLocalAddress());
+	endpoint->peers[peerid] = socket;
+	return socket;
+}
+
+void SharedPortMux::releaseUdpSocket(MuxedUdpSocket* socket)
+{
+	auto it = m_udpEndpoints.find(socket->GetLocalAddress().ipaddr());
+	if (it == m_udpEndpoints.end())
+		return;
+
+	UdpEndpoint* endpoint = it->second.get();
+	auto peer = endpoint->peers.find(socket->peerid());
+	if (peer != endpoint->peers.end() && peer->second == socket)
+		endpoint->peers.erase(peer);
+
+	for (auto remote = endpoint->remotes.begin(); remote != endpoint->remotes.end();)
+	{
+		if (remote->second == socket)
+			remote = endpoint->remotes.erase(remote);
+		else
+			++remote;
+	}
+	if (endpoint->sending == socket)
+		endpoint->sending = nullptr;
+}
+
+void SharedPortMux::releaseTcpServerSocket(MuxedTcpServerSocket* socket)
+{
+	auto it = m_tcpEndpoints.find(socket->GetLocalAddress().ipaddr());
+	if (it == m_tcpEndpoints.end())
+		return;
+
+	auto peer = it->second->peers.find(socket->peerid());
+	if (peer != it->second->peers.end() && peer->second == socket)
+		it->second->peers.erase(peer);
+}
+
+int SharedPortMux::sendUdp(MuxedUdpSocket* socket, const void* data, size_t size, const rtc::SocketAddress& addr,
+                           const rtc::PacketOptions& options)
+{
+	auto it = m_udpEndpoints.find(socket->GetLocalAddress().ipaddr());
+	if (it == m_udpEndpoints.end())
+		return -1;
+
+	UdpEndpoint* endpoint = it->second.get();
+
+	// answers to our own connectivity checks come back from this address
+	if (endpoint->remotes.find(addr) == endpoint->remotes.end())
+		endpoint->remotes[addr] = socket;
+
+	// SignalSentPacket is raised synchronously from SendTo, route it to the sender only
+	endpoint->sending = socket;
+	int ret = endpoint->socket->SendTo(data, size, addr, options);
+	endpoint->sending = nullptr;
+	if (ret < 0)
+		socket->SetError(endpoint->socket->GetError());
+	return ret;
+}
+
+void SharedPortMux::OnUdpReadPacket(rtc::AsyncPacketSocket* socket, const char* data, size_t size,
+                                    const rtc::SocketAddress& remote_addr, const rtc::PacketTime& packet_time)
+{
+	auto it = m_udpEndpoints.find(socket->GetLocalAddress().ipaddr());
+	if (it == m_udpEndpoints.end())
+		return;
+
+	UdpEndpoint* endpoint = it->second.get();
+	MuxedUdpSocket* target = nullptr;
+
+	std::string ufrag = GetStunLocalUfrag(data, size);
+	if (!ufrag.empty())
+	{
+		auto peer = endpoint->peers.find(getPeerFromUfrag(ufrag));
+		if (peer != endpoint->peers.end())
+		{
+			target = peer->second;
+			endpoint->remotes[remote_addr] = target;
+		}
+	}
+	else
+	{
+		auto remote = endpoint->remotes.find(remote_addr);
+		if (remote != endpoint->remotes.end())
+			target = remote->second;
+	}
+
+	if (!target)
+	{
+		CLOG_EVERY_MS(kLogNetwork, LS_VERBOSE, 1000) << "Drop packet from unknown peer " << remote_addr.ToString();
+		return;
+	}
+	target->SignalReadPacket(target, data, size, remote_addr, packet_time);
+}
+
+void SharedPortMux::OnUdpSentPacket(rtc::AsyncPacketSocket* socket, const rtc::SentPacket& sent_packet)
+{
+	auto it = m_udpEndpoints.find(socket->GetLocalAddress().ipaddr());
+	if (it != m_udpEndpoints.end() && it->second->sending)
+	{
+		MuxedUdpSocket* sender = it->second->sending;
+		sender->SignalSentPacket(sender, sent_packet);
+	}
+}
+
+void SharedPortMux::OnUdpReadyToSend(rtc::AsyncPacketSocket* socket)
+{
+	auto it = m_udpEndpoints.find(socket->GetLocalAddress().ipaddr());
+	if (it == m_udpEndpoints.end())
+		return;
+
+	for (auto& peer : it->second->peers)
+		peer.second->SignalReadyToSend(peer.second);
+}
+
+void SharedPortMux::OnTcpAccept(rtc::AsyncSocket* listener)
+{
+	rtc::SocketAddress remote;
+	rtc::AsyncSocket* accepted = listener->Accept(&remote);
+	if (!accepted)
+	{
+		RTC_LOG(LS_WARNING) << "Shared TCP accept failed:" << listener->GetError();
+		return;
+	}
+
+	// RFC4571 framing, same as a passive TCPPort
+	rtc::AsyncTCPSocket* socket = new rtc::AsyncTCPSocket(accepted, false);
+	socket->SignalReadPacket.connect(this, &SharedPortMux::OnTcpPendingPacket);
+	socket->SignalClose.connect(this, &SharedPortMux::OnTcpPendingClose);
+	m_pendingTcp[socket].reset(socket);
+}
+
+void SharedPortMux::OnTcpPendingPacket(rtc::AsyncPacketSocket* socket, const char* data, size_t size,
+                                       const rtc::SocketAddress& remote_addr, const rtc::PacketTime& packet_time)
+{
+	auto pending = m_pendingTcp.find(socket);
+	if (pending == m_pendingTcp.end())
+		return;
+
+	MuxedTcpServerSocket* server = nullptr;
+	auto endpoint = m_tcpEndpoints.find(socket->GetLocalAddress().ipaddr());
+	if (endpoint != m_tcpEndpoints.end())
+	{
+		auto peer = endpoint->second->peers.find(getPeerFromUfrag(GetStunLocalUfrag(data, size)));
+		if (peer != endpoint->second->peers.end())
+			server = peer->second;
+	}
+
+	std::unique_ptr<rtc::AsyncPacketSocket> owned(std::move(pending->second));
+	m_pendingTcp.erase(pending);
+	owned->SignalReadPacket.disconnect(this);
+	owned->SignalClose.disconnect(this);
+
+	if (!server)
+	{
+		RTC_LOG(LS_WARNING) << "Drop TCP connection from unknown peer " << remote_addr.ToString();
+		// still inside its read signal, delete later
+		owned->Close();
+		m_networkThread->Dispose(owned.release());
+		return;
+	}
+
+	// hand the connection to the TCPPort, then replay the packet it has not seen
+	server->SignalNewConnection(server, owned.release());
+	socket->SignalReadPacket(socket, data, size, remote_addr, packet_time);
+}
+
+void SharedPortMux::OnTcpPendingClose(rtc::AsyncPacketSocket* socket, int error)
+{
+	auto pending = m_pendingTcp.find(socket);
+	if (pending == m_pendingTcp.end())
+		return;
+
+	// still inside its close signal, delete later
+	m_networkThread->Dispose(pending->second.release());
+	m_pendingTcp.erase(pending);
+}
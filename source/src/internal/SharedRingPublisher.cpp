@@ -0,0 +1,92 @@
+#include "internal/SharedRingPublisher.h"
+
+#include <libyuv/convert.h>
+#include <libyuv/convert_from.h>
+
+namespace
+{
+	// packed slots are BGR: libyuv RGB24 is B, G, R in memory
+	int channelsOf(uint32_t format)
+	{
+		return format == WEBRTC_RING_I420 ? 1 : 3;
+	}
+
+	int strideOf(uint32_t format, int width)
+	{
+		return width * channelsOf(format);
+	}
+}
+
+SharedRingPublisher::SharedRingPublisher() : m_format(WEBRTC_RING_I420), m_open(false), m_published(0), m_dropped(0)
+{
+}
+
+bool SharedRingPublisher::open(const std::string& name, int slots, int maxWidth, int maxHeight, uint32_t format)
+{
+	if (format != WEBRTC_RING_I420 && format != WEBRTC_RING_PACKED)
+		return false;
+
+	size_t slotBytes = SharedFrameRing::frameBytes(format, maxWidth, maxHeight, channelsOf(format), strideOf(format, maxWidth));
+	if (slotBytes == 0)
+		return false;
+
+	// the previous ring is unlinked first, it may have the same name
+	close();
+	std::shared_ptr<SharedFrameRing> ring = SharedFrameRing::create(name, slots, slotBytes);
+	if (!ring)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_ring = ring;
+	m_format = format;
+	m_open = true;
+	return true;
+}
+
+void SharedRingPublisher::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_open = false;
+	// readers keep their mapping, the name is gone
+	m_ring.reset();
+}
+
+bool SharedRingPublisher::publish(const uint8_t* y, int strideY, const uint8_t* u, int strideU,
+                                  const uint8_t* v, int strideV, int width, int height, int64_t timestampUs)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_ring)
+		return false;
+
+	int stride = strideOf(m_format, width);
+	size_t bytes = SharedFrameRing::frameBytes(m_format, width, height, channelsOf(m_format), stride);
+	int slot = (bytes > 0 && bytes <= m_ring->slotBytes()) ? m_ring->acquireWrite() : -1;
+	if (slot < 0)
+	{
+		// every slot is read, or the stream grew above the size given to open
+		m_dropped++;
+		return false;
+	}
+
+	uint8_t* pixels = m_ring->pixels(slot);
+	if (m_format == WEBRTC_RING_I420)
+	{
+		int strideUV = (stride + 1) / 2;
+		uint8_t* dstU = pixels + static_cast<size_t>(stride) * height;
+		uint8_t* dstV = dstU + static_cast<size_t>(strideUV) * ((height + 1) / 2);
+		libyuv::I420Copy(y, strideY, u, strideU, v, strideV,
+		                 pixels, stride, dstU, strideUV, dstV, strideUV, width, height);
+	}
+	else
+	{
+		libyuv::I420ToRGB24(y, strideY, u, strideU, v, strideV, pixels, stride, width, height);
+	}
+
+	if (!m_ring->publish(slot, width, height, channelsOf(m_format), stride, timestampUs, m_format))
+	{
+		m_dropped++;
+		return false;
+	}
+	m_published++;
+	return true;
+}
@@ -0,0 +1,26 @@
+#include "internal/SignalingMessage.h"
+
+std::string writeSignalingMessage(const Json::Value& message)
+{
+	thread_local Json::FastWriter writer;
+
+	return writer.write(message);
+}
+
+bool readSignalingMessage(const std::string& payload, Json::Value& message)
+{
+	thread_local Json::Reader reader;
+
+	return reader.parse(payload.data(), payload.data() + payload.size(), message, false);
+}
+
+Json::Value makeIceCandidatesMessage(const Json::Value& candidates)
+{
+	Json::Value message;
+	if (candidates.size() == 1)
+		message["candidate"] = candidates[0];
+	else
+		message["candidates"] = candidates;
+
+	return message;
+}
@@ -0,0 +1,23 @@
+#include "internal/StreamContext.h"
+
+StreamContext::StreamContext()
+	: stats(std::make_shared<StreamStats>())
+	, sequence(std::make_shared<FrameSequence>())
+	, sharedRing(std::make_shared<SharedRingPublisher>())
+	, recorder(std::make_shared<RecorderTap>())
+{
+}
+
+std::shared_ptr<StreamContext> StreamContext::attach(FrameQueue& queue)
+{
+	std::shared_ptr<StreamContext> context = std::make_shared<StreamContext>();
+	queue.setContext(context);
+	return context;
+}
+
+std::shared_ptr<StreamContext> StreamContext::of(const FrameQueue* queue)
+{
+	// only attach() sets the context of a frame queue
+	std::shared_ptr<StreamContext> context = queue ? std::static_pointer_cast<StreamContext>(queue->context()) : nullptr;
+	return context ? context : std::make_shared<StreamContext>();
+}
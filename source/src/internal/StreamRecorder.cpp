@@ -0,0 +1,303 @@
+#include "internal/StreamRecorder.h"
+#include "internal/AsyncLog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <libyuv/scale.h>
+
+namespace
+{
+	// IVF and its header are little endian
+	uint8_t* put16(uint8_t* out, uint16_t value)
+	{
+		out[0] = static_cast<uint8_t>(value);
+		out[1] = static_cast<uint8_t>(value >> 8);
+		return out + 2;
+	}
+
+	uint8_t* put32(uint8_t* out, uint32_t value)
+	{
+		return put16(put16(out, static_cast<uint16_t>(value)), static_cast<uint16_t>(value >> 16));
+	}
+
+	uint8_t* put64(uint8_t* out, uint64_t value)
+	{
+		return put32(put32(out, static_cast<uint32_t>(value)), static_cast<uint32_t>(value >> 32));
+	}
+
+	uint8_t* putPlane(uint8_t* out, const uint8_t* plane, int stride, int width, int height)
+	{
+		for (int row = 0; row < height; row++, out += width)
+			memcpy(out, plane + static_cast<size_t>(row) * stride, width);
+		return out;
+	}
+
+	const size_t kIvfFileHeader = 32;
+	const size_t kIvfFrameHeader = 12;
+	const long   kIvfFrameCountOffset = 24;
+
+	bool isIvf(const std::string& codec)
+	{
+		return codec == "VP8" || codec == "VP9";
+	}
+}
+
+const size_t StreamRecorder::kChunkBytes;
+const size_t StreamRecorder::kDefaultBacklogBytes;
+
+std::shared_ptr<StreamRecorder> StreamRecorder::create(const std::string& path, Format format, size_t maxBacklogBytes)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		CLOG(kLogMedia, LS_ERROR) << "cannot create the recording " << path << ": " << errno;
+		return nullptr;
+	}
+	// the chunks are the buffering
+	setvbuf(file, nullptr, _IONBF, 0);
+
+	std::shared_ptr<StreamRecorder> recorder(new StreamRecorder(file, format, std::max(maxBacklogBytes, kChunkBytes)));
+	StreamRecorder* self = recorder.get();
+	recorder->m_writer = std::thread([self]() { self->writeLoop(); });
+	return recorder;
+}
+
+StreamRecorder::StreamRecorder(FILE* file, Format format, size_t maxBacklogBytes)
+	: m_file(file), m_format(format), m_maxBacklog(maxBacklogBytes), m_backlog(0), m_closing(false)
+	, m_width(0), m_height(0), m_writer(0), m_waitKey(true), m_lastRtp(0), m_pts(0), m_ivfFrames(0)
+	, m_frames(0), m_dropped(0), m_bytes(0)
+{
+}
+
+StreamRecorder::~StreamRecorder()
+{
+	close();
+}
+
+uint8_t* StreamRecorder::reserve(size_t size)
+{
+	if (m_closing || m_backlog + size > m_maxBacklog)
+		return nullptr;
+
+	if (m_current && m_current->used + size > m_current->capacity)
+	{
+		m_full.push_back(std::move(m_current));
+		m_ready.notify_one();
+	}
+	if (!m_current)
+	{
+		if (m_spare && m_spare->capacity >= size)
+			m_current = std::move(m_spare);
+		else
+			m_current.reset(new Chunk(std::max(kChunkBytes, size)));
+	}
+
+	uint8_t* out = m_current->data.get() + m_current->used;
+	m_current->used += size;
+	m_backlog += size;
+	return out;
+}
+
+void StreamRecorder::writeI420(const uint8_t* y, int strideY, const uint8_t* u, int strideU,
+                               const uint8_t* v, int strideV, int width, int height)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_format != Y4m || width <= 0 || height <= 0)
+		return;
+
+	// a Y4M stream has one size: the first one, the sender adapts its resolution
+	// to the network and the CPU and the later frames are scaled back to it
+	std::string header;
+	if (m_width == 0)
+		header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) + " F30:1 Ip A1:1 C420jpeg\n";
+	int outWidth = m_width != 0 ? m_width : width;
+	int outHeight = m_height != 0 ? m_height : height;
+	static const char kFrame[] = "FRAME\n";
+	int chromaWidth = (outWidth + 1) / 2;
+	int chromaHeight = (outHeight + 1) / 2;
+	size_t lumaBytes = static_cast<size_t>(outWidth) * outHeight;
+	size_t chromaBytes = static_cast<size_t>(chromaWidth) * chromaHeight;
+	size_t pixels = lumaBytes + 2 * chromaBytes;
+
+	uint8_t* out = reserve(header.size() + sizeof(kFrame) - 1 + pixels);
+	if (!out)
+	{
+		m_dropped++;
+		return;
+	}
+	m_width = outWidth;
+	m_height = outHeight;
+	memcpy(out, header.data(), header.size());
+	out += header.size();
+	memcpy(out, kFrame, sizeof(kFrame) - 1);
+	out += sizeof(kFrame) - 1;
+	if (width == outWidth && height == outHeight)
+	{
+		out = putPlane(out, y, strideY, width, height);
+		out = putPlane(out, u, strideU, chromaWidth, chromaHeight);
+		putPlane(out, v, strideV, chromaWidth, chromaHeight);
+	}
+	else
+	{
+		// straight into the backlog, planes packed as Y4M has them
+		libyuv::I420Scale(y, strideY, u, strideU, v, strideV, width, height,
+		                  out, outWidth, out + lumaBytes, chromaWidth, out + lumaBytes + chromaBytes, chromaWidth,
+		                  outWidth, outHeight, libyuv::kFilterBilinear);
+	}
+	m_frames++;
+}
+
+void StreamRecorder::writeEncoded(uint64_t writer, const std::string& codec, const uint8_t* data, size_t size,
+                                  uint32_t rtpTimestamp, int width, int height, bool keyFrame)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_format != Encoded || !data || size == 0)
+		return;
+
+	bool first = m_codec.empty();
+	bool known = isIvf(codec) || codec == "H264";
+	// another peer sending the same codec would interleave its frames in the file;
+	// a delta frame without the frames it refers to would not decode
+	if ((m_writer != 0 && writer != m_writer) || (first && !known) || (!first && codec != m_codec)
+		|| (m_waitKey && !keyFrame))
+	{
+		m_dropped++;
+		return;
+	}
+
+	bool ivf = isIvf(codec);
+	size_t header = ivf ? kIvfFrameHeader + (first ? kIvfFileHeader : 0) : 0;
+	uint8_t* out = reserve(header + size);
+	if (!out)
+	{
+		m_dropped++;
+		m_waitKey = true;
+		return;
+	}
+	m_waitKey = false;
+
+	if (first)
+	{
+		m_writer = writer;
+		m_codec = codec;
+		m_lastRtp = rtpTimestamp;
+		if (ivf)
+		{
+			// frame count completed by close()
+			memcpy(out, "DKIF", 4);
+			out = put16(out + 4, 0);
+			out = put16(out, static_cast<uint16_t>(kIvfFileHeader));
+			memcpy(out, codec == "VP8" ? "VP80" : "VP90", 4);
+			out = put16(out + 4, static_cast<uint16_t>(width));
+			out = put16(out, static_cast<uint16_t>(height));
+			out = put32(out, 90000);
+			out = put32(out, 1);
+			out = put32(out, 0);
+			out = put32(out, 0);
+		}
+	}
+	// 90 kHz from the first frame, through the RTP timestamp wrap
+	m_pts += static_cast<uint32_t>(rtpTimestamp - m_lastRtp);
+	m_lastRtp = rtpTimestamp;
+
+	if (ivf)
+	{
+		out = put32(out, static_cast<uint32_t>(size));
+		out = put64(out, m_pts);
+		m_ivfFrames++;
+	}
+	// H264 frames reach the decoder with their start codes: Annex-B as they are
+	memcpy(out, data, size);
+	m_frames++;
+}
+
+void StreamRecorder::writeLoop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		if (m_full.empty())
+		{
+			if (!m_closing)
+				m_ready.wait_for(lock, std::chrono::seconds(1), [this]() { return !m_full.empty() || m_closing; });
+			// a slow stream reaches the disk at least every second, all of it on close
+			if (m_full.empty() && m_current && m_current->used > 0)
+				m_full.push_back(std::move(m_current));
+			if (m_full.empty())
+			{
+				if (m_closing)
+					break;
+				continue;
+			}
+		}
+
+		std::unique_ptr<Chunk> chunk = std::move(m_full.front());
+		m_full.pop_front();
+		lock.unlock();
+		size_t written = fwrite(chunk->data.get(), 1, chunk->used, m_file);
+		if (written != chunk->used)
+			CLOG_EVERY_MS(kLogMedia, LS_ERROR, 5000) << "recording write failed: " << errno;
+		lock.lock();
+
+		m_bytes += written;
+		m_backlog -= chunk->used;
+		chunk->used = 0;
+		if (!m_spare && chunk->capacity == kChunkBytes)
+			m_spare = std::move(chunk);
+	}
+}
+
+void StreamRecorder::close()
+{
+	std::lock_guard<std::mutex> closeLock(m_closeMutex);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closing = true;
+	}
+	m_ready.notify_all();
+	if (m_writer.joinable())
+		m_writer.join();
+	if (!m_file)
+		return;
+
+	if (m_format == Encoded && isIvf(m_codec))
+	{
+		uint8_t count[4];
+		put32(count, m_ivfFrames);
+		if (fseek(m_file, kIvfFrameCountOffset, SEEK_SET) == 0)
+			fwrite(count, 1, sizeof(count), m_file);
+	}
+	fclose(m_file);
+	m_file = nullptr;
+}
+
+WebRTCRecorderStats StreamRecorder::stats() const
+{
+	WebRTCRecorderStats result = WebRTCRecorderStats();
+	result.frames = m_frames;
+	result.dropped_frames = m_dropped;
+	result.bytes = m_bytes;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	result.backlog_bytes = static_cast<int>(m_backlog);
+	return result;
+}
+
+RecorderTap::RecorderTap() : m_active(false)
+{
+}
+
+void RecorderTap::set(std::shared_ptr<StreamRecorder> recorder)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_recorder = recorder;
+	m_active = recorder != nullptr;
+}
+
+std::shared_ptr<StreamRecorder> RecorderTap::get() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_recorder;
+}
@@ -0,0 +1,81 @@
+#include "internal/StreamStats.h"
+#include "internal/LatencyHistogram.h"
+
+FrameRate::FrameRate() : m_windowStart(0), m_frames(0), m_costUs(0), m_windowEnd(0), m_rate(0.0), m_averageCostUs(0.0)
+{
+}
+
+void FrameRate::tick(int64_t nowUs, int64_t costUs)
+{
+	// Capture(), CaptureNext() and the delivery thread count outputs together
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_windowStart == 0)
+		m_windowStart = nowUs;
+
+	m_frames++;
+	m_costUs += costUs;
+
+	int64_t elapsed = nowUs - m_windowStart;
+	if (elapsed >= kWindowUs)
+	{
+		m_rate = m_frames * 1000000.0 / elapsed;
+		m_averageCostUs = static_cast<double>(m_costUs) / m_frames;
+		m_windowEnd = nowUs;
+
+		m_windowStart = nowUs;
+		m_frames = 0;
+		m_costUs = 0;
+	}
+}
+
+// no window closed for two periods: the stream stopped
+bool FrameRate::stale(int64_t nowUs) const
+{
+	return nowUs - m_windowEnd.load() > 2 * kWindowUs;
+}
+
+double FrameRate::rate(int64_t nowUs) const
+{
+	return stale(nowUs) ? 0.0 : m_rate.load();
+}
+
+double FrameRate::averageCostUs(int64_t nowUs) const
+{
+	return stale(nowUs) ? 0.0 : m_averageCostUs.load();
+}
+
+void StreamStats::onInput()
+{
+	m_input.tick(LatencyHistogram::nowUs());
+}
+
+void StreamStats::onDropped(size_t frames)
+{
+	m_dropped.fetch_add(frames, std::memory_order_relaxed);
+}
+
+void StreamStats::onOutput(int width, int height)
+{
+	m_width = width;
+	m_height = height;
+	m_output.tick(LatencyHistogram::nowUs());
+}
+
+void StreamStats::onConversion(int64_t us)
+{
+	m_conversion.tick(LatencyHistogram::nowUs(), us);
+}
+
+WebRTCStreamStats StreamStats::snapshot() const
+{
+	int64_t now = LatencyHistogram::nowUs();
+
+	WebRTCStreamStats stats = WebRTCStreamStats();
+	stats.input_fps = m_input.rate(now);
+	stats.output_fps = m_output.rate(now);
+	stats.dropped_frames = m_dropped.load(std::memory_order_relaxed);
+	stats.width = m_width;
+	stats.height = m_height;
+	stats.conversion_ms = m_conversion.averageCostUs(now) / 1000.0;
+	return stats;
+}
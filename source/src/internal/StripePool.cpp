@@ -0,0 +1,144 @@
+#include "internal/StripePool.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+	// above 1440p, so that 4K sources are split and 1080p ones are not
+	const int64_t kDefaultMinPixels = 2560 * 1440 + 1;
+
+	size_t defaultWorkers()
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		return std::min<size_t>(3, cores > 1 ? cores - 1 : 0);
+	}
+
+	std::mutex                  s_sharedMutex;
+	std::shared_ptr<StripePool> s_shared;
+	bool                        s_configured = false;
+	std::atomic<int64_t>        s_minPixels(kDefaultMinPixels);
+}
+
+StripePool::StripePool(size_t workers) : m_stop(false)
+{
+	for (size_t i = 0; i < workers; i++)
+	{
+		m_workers.emplace_back([this]()
+		{
+			run();
+		});
+	}
+}
+
+StripePool::~StripePool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_jobReady.notify_all();
+
+	for (auto& worker : m_workers)
+	{
+		if (worker.joinable())
+			worker.join();
+	}
+}
+
+bool StripePool::take(Job* job, int& index)
+{
+	if (job->next >= job->count)
+		return false;
+
+	index = job->next++;
+	// the last index is taken, nobody else should pick this job
+	if (job->next >= job->count)
+	{
+		auto it = std::find(m_jobs.begin(), m_jobs.end(), job);
+		if (it != m_jobs.end())
+			m_jobs.erase(it);
+	}
+	return true;
+}
+
+void StripePool::parallelFor(int count, const std::function<void(int)>& task)
+{
+	if (count <= 0)
+		return;
+
+	Job job = { &task, count, 0, 0 };
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (count > 1 && !m_workers.empty())
+	{
+		m_jobs.push_back(&job);
+		m_jobReady.notify_all();
+	}
+
+	int index;
+	while (take(&job, index))
+	{
+		lock.unlock();
+		task(index);
+		lock.lock();
+		job.done++;
+	}
+
+	// job lives on this stack: wait for the stripes taken by the workers
+	m_jobDone.wait(lock, [&job]() { return job.done == job.count; });
+}
+
+void StripePool::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_jobReady.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+		if (m_stop)
+			return;
+
+		Job* job = m_jobs.front();
+		int index;
+		if (!take(job, index))
+			continue;
+
+		lock.unlock();
+		(*job->task)(index);
+		lock.lock();
+
+		if (++job->done == job->count)
+			m_jobDone.notify_all();
+	}
+}
+
+std::shared_ptr<StripePool> StripePool::shared()
+{
+	std::lock_guard<std::mutex> lock(s_sharedMutex);
+	if (!s_configured)
+	{
+		size_t workers = defaultWorkers();
+		if (workers > 0)
+			s_shared = std::make_shared<StripePool>(workers);
+		s_configured = true;
+	}
+	return s_shared;
+}
+
+void StripePool::configure(size_t workers, int64_t minPixels)
+{
+	std::shared_ptr<StripePool> previous;
+	{
+		std::lock_guard<std::mutex> lock(s_sharedMutex);
+		previous = s_shared;
+		s_shared = workers > 0 ? std::make_shared<StripePool>(workers) : nullptr;
+		s_configured = true;
+		s_minPixels = minPixels;
+	}
+	// the previous workers are joined here if no conversion is using them
+	previous.reset();
+}
+
+int64_t StripePool::minPixels()
+{
+	return s_minPixels;
+}
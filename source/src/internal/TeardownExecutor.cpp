@@ -0,0 +1,83 @@
+#include "internal/TeardownExecutor.h"
+
+#include <chrono>
+
+TeardownExecutor::TeardownExecutor(size_t workers) : m_running(0), m_stop(false)
+{
+	for (size_t i = 0; i < workers; i++)
+	{
+		m_workers.emplace_back([this]()
+		{
+			run();
+		});
+	}
+}
+
+TeardownExecutor::~TeardownExecutor()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_taskReady.notify_all();
+
+	for (auto& worker : m_workers)
+	{
+		if (worker.joinable())
+			worker.join();
+	}
+}
+
+void TeardownExecutor::post(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(task));
+	}
+	m_taskReady.notify_one();
+}
+
+void TeardownExecutor::drain(std::function<void()> onWait)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_tasks.empty() || m_running > 0)
+	{
+		if (onWait)
+		{
+			lock.unlock();
+			onWait();
+			lock.lock();
+		}
+		m_taskDone.wait_for(lock, std::chrono::milliseconds(10));
+	}
+}
+
+size_t TeardownExecutor::pending()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_tasks.size() + m_running;
+}
+
+void TeardownExecutor::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_taskReady.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+
+		// pending tasks are still run on stop, they own the resources to release
+		if (m_tasks.empty())
+			return;
+
+		std::function<void()> task = std::move(m_tasks.front());
+		m_tasks.pop_front();
+		m_running++;
+
+		lock.unlock();
+		task();
+		lock.lock();
+
+		m_running--;
+		m_taskDone.notify_all();
+	}
+}
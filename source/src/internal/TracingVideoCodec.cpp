@@ -0,0 +1,233 @@
+#include "internal/TracingVideoCodec.h"
+#include "internal/FrameTrace.h"
+#include "internal/LatencyHistogram.h"
+
+#include <atomic>
+#include <string>
+
+#include "api/video_codecs/video_decoder.h"
+#include "api/video_codecs/video_encoder.h"
+
+namespace
+{
+	// OnEncodedImage hands the frame to the RTP sender, that packetizes it
+	class TracingEncodedImageCallback : public webrtc::EncodedImageCallback
+	{
+	public:
+		explicit TracingEncodedImageCallback(webrtc::EncodedImageCallback* callback) : m_callback(callback) {}
+
+		Result OnEncodedImage(const webrtc::EncodedImage& encoded_image,
+		                      const webrtc::CodecSpecificInfo* codec_specific_info,
+		                      const webrtc::RTPFragmentationHeader* fragmentation) override
+		{
+			FrameTraceSpan span("Packetize", encoded_image._timeStamp);
+			return m_callback->OnEncodedImage(encoded_image, codec_specific_info, fragmentation);
+		}
+
+		void OnDroppedFrame(DropReason reason) override
+		{
+			m_callback->OnDroppedFrame(reason);
+		}
+
+	private:
+		webrtc::EncodedImageCallback* m_callback;
+	};
+
+	class TracingVideoEncoder : public webrtc::VideoEncoder
+	{
+	public:
+		TracingVideoEncoder(std::unique_ptr<webrtc::VideoEncoder> encoder, const std::string& scope)
+			: m_encoder(std::move(encoder)), m_scope(scope), m_latency(LatencyRegistry::instance().get(scope, kLatencyEncode)) {}
+
+		// the scope lives as long as the encoder, peer churn does not grow the registry
+		~TracingVideoEncoder() override
+		{
+			LatencyRegistry::instance().remove(m_scope);
+		}
+
+		int32_t InitEncode(const webrtc::VideoCodec* codec_settings, int32_t number_of_cores, size_t max_payload_size) override
+		{
+			return m_encoder->InitEncode(codec_settings, number_of_cores, max_payload_size);
+		}
+
+		int32_t RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) override
+		{
+			m_callback.reset(callback ? new TracingEncodedImageCallback(callback) : nullptr);
+			return m_encoder->RegisterEncodeCompleteCallback(m_callback.get());
+		}
+
+		int32_t Release() override
+		{
+			return m_encoder->Release();
+		}
+
+		int32_t Encode(const webrtc::VideoFrame& frame, const webrtc::CodecSpecificInfo* codec_specific_info,
+		               const std::vector<webrtc::FrameType>* frame_types) override
+		{
+			FrameTraceSpan span("Encode", frame.timestamp());
+			ScopedLatency latency(m_latency.get());
+			return m_encoder->Encode(frame, codec_specific_info, frame_types);
+		}
+
+		int32_t SetChannelParameters(uint32_t packet_loss, int64_t rtt) override
+		{
+			return m_encoder->SetChannelParameters(packet_loss, rtt);
+		}
+
+		int32_t SetRates(uint32_t bitrate, uint32_t framerate) override
+		{
+			return m_encoder->SetRates(bitrate, framerate);
+		}
+
+		int32_t SetRateAllocation(const webrtc::VideoBitrateAllocation& allocation, uint32_t framerate) override
+		{
+			return m_encoder->SetRateAllocation(allocation, framerate);
+		}
+
+		ScalingSettings GetScalingSettings() const override
+		{
+			return m_encoder->GetScalingSettings();
+		}
+
+		bool SupportsNativeHandle() const override
+		{
+			return m_encoder->SupportsNativeHandle();
+		}
+
+		const char* ImplementationName() const override
+		{
+			return m_encoder->ImplementationName();
+		}
+
+	private:
+		std::unique_ptr<webrtc::VideoEncoder> m_encoder;
+		std::unique_ptr<TracingEncodedImageCallback> m_callback;
+		std::string m_scope;
+		std::shared_ptr<LatencyHistogram> m_latency;
+	};
+
+	class TracingVideoDecoder : public webrtc::VideoDecoder
+	{
+	public:
+		TracingVideoDecoder(std::unique_ptr<webrtc::VideoDecoder> decoder, const std::string& scope,
+		                    std::shared_ptr<RecorderTap> recorder, const std::string& codec)
+			: m_decoder(std::move(decoder)), m_scope(scope), m_latency(LatencyRegistry::instance().get(scope, kLatencyDecode))
+			, m_recorder(recorder), m_codec(codec), m_id(++s_instances) {}
+
+		~TracingVideoDecoder() override
+		{
+			LatencyRegistry::instance().remove(m_scope);
+		}
+
+		int32_t InitDecode(const webrtc::VideoCodec* codec_settings, int32_t number_of_cores) override
+		{
+			return m_decoder->InitDecode(codec_settings, number_of_cores);
+		}
+
+		int32_t Decode(const webrtc::EncodedImage& input_image, bool missing_frames,
+		               const webrtc::RTPFragmentationHeader* fragmentation,
+		               const webrtc::CodecSpecificInfo* codec_specific_info, int64_t render_time_ms) override
+		{
+			// copied to the recorder backlog, written by its own thread; the decoders of
+			// every peer share the tap, the recorder keeps the frames of the first one
+			if (m_recorder && m_recorder->active())
+			{
+				std::shared_ptr<StreamRecorder> recorder = m_recorder->get();
+				if (recorder)
+					recorder->writeEncoded(m_id, m_codec, input_image._buffer, input_image._length, input_image._timeStamp,
+					                       input_image._encodedWidth, input_image._encodedHeight,
+					                       input_image._frameType == webrtc::kVideoFrameKey);
+			}
+
+			FrameTraceSpan span("Decode", input_image._timeStamp);
+			ScopedLatency latency(m_latency.get());
+			return m_decoder->Decode(input_image, missing_frames, fragmentation, codec_specific_info, render_time_ms);
+		}
+
+		int32_t RegisterDecodeCompleteCallback(webrtc::DecodedImageCallback* callback) override
+		{
+			return m_decoder->RegisterDecodeCompleteCallback(callback);
+		}
+
+		int32_t Release() override
+		{
+			return m_decoder->Release();
+		}
+
+		bool PrefersLateDecoding() const override
+		{
+			return m_decoder->PrefersLateDecoding();
+		}
+
+		const char* ImplementationName() const override
+		{
+			return m_decoder->ImplementationName();
+		}
+
+	private:
+		std::unique_ptr<webrtc::VideoDecoder> m_decoder;
+		std::string m_scope;
+		std::shared_ptr<LatencyHistogram> m_latency;
+		std::shared_ptr<RecorderTap> m_recorder;
+		std::string m_codec;
+		// not the address: a later decoder may get the same one
+		uint64_t m_id;
+
+		static std::atomic<uint64_t> s_instances;
+	};
+
+	std::atomic<uint64_t> TracingVideoDecoder::s_instances(0);
+
+	// the factories do not know the peer (webrtc creates the codecs of every peer
+	// of the manager through them), so each codec instance has its own scope
+	std::string codecScope(const char* kind, const webrtc::SdpVideoFormat& format)
+	{
+		static std::atomic<unsigned int> instances(0);
+		return std::string(kind) + ":" + format.name + "#" + std::to_string(++instances);
+	}
+}
+
+TracingVideoEncoderFactory::TracingVideoEncoderFactory(std::unique_ptr<webrtc::VideoEncoderFactory> factory)
+	: m_factory(std::move(factory))
+{
+}
+
+std::vector<webrtc::SdpVideoFormat> TracingVideoEncoderFactory::GetSupportedFormats() const
+{
+	return m_factory->GetSupportedFormats();
+}
+
+webrtc::VideoEncoderFactory::CodecInfo TracingVideoEncoderFactory::QueryVideoEncoder(const webrtc::SdpVideoFormat& format) const
+{
+	return m_factory->QueryVideoEncoder(format);
+}
+
+std::unique_ptr<webrtc::VideoEncoder> TracingVideoEncoderFactory::CreateVideoEncoder(const webrtc::SdpVideoFormat& format)
+{
+	std::unique_ptr<webrtc::VideoEncoder> encoder = m_factory->CreateVideoEncoder(format);
+	if (!encoder)
+		return nullptr;
+
+	return std::unique_ptr<webrtc::VideoEncoder>(new TracingVideoEncoder(std::move(encoder), codecScope("encoder", format)));
+}
+
+TracingVideoDecoderFactory::TracingVideoDecoderFactory(std::unique_ptr<webrtc::VideoDecoderFactory> factory,
+                                                       std::shared_ptr<RecorderTap> recorder)
+	: m_factory(std::move(factory)), m_recorder(recorder)
+{
+}
+
+std::vector<webrtc::SdpVideoFormat> TracingVideoDecoderFactory::GetSupportedFormats() const
+{
+	return m_factory->GetSupportedFormats();
+}
+
+std::unique_ptr<webrtc::VideoDecoder> TracingVideoDecoderFactory::CreateVideoDecoder(const webrtc::SdpVideoFormat& format)
+{
+	std::unique_ptr<webrtc::VideoDecoder> decoder = m_factory->CreateVideoDecoder(format);
+	if (!decoder)
+		return nullptr;
+
+	return std::unique_ptr<webrtc::VideoDecoder>(new TracingVideoDecoder(std::move(decoder), codecScope("decoder", format),
+		m_recorder, format.name));
+}
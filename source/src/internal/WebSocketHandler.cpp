@@ -1,11 +1,180 @@
 #include "internal/WebSocketHandler.h"
 #include "internal/videorenderer.h"
+#include "internal/SignalingMessage.h"
+#include "internal/AsyncLog.h"
+#include "internal/LatencyHistogram.h"
+#include <rtc_base/helpers.h>
+#include <set>
+#include <vector>
+
+// Candidates gathered within this window are sent together.
+static const long kIceCandidateBatchMs = 20;
+
+struct IceCandidateBatch
+{
+	explicit IceCandidateBatch(bool i_batched) : candidates(Json::arrayValue), batched(i_batched), timerArmed(false) {}
+
+	std::mutex mutex;
+	Json::Value candidates;
+	// {"candidates":[...]} for a client that asked for it, else one {"candidate":...} message each
+	const bool batched;
+	bool timerArmed;
+};
+
+// The client reads {"candidates":[...]} when it connects with ?candidates=batch.
+static bool readsCandidateBatches(RTCWebScoketServer::connection_ptr con)
+{
+	const std::string resource = con->get_resource();
+	const std::string parameter = "candidates=batch";
+	size_t query = resource.find('?');
+	for (size_t pos = query; pos != std::string::npos; pos = resource.find('&', pos + 1))
+	{
+		size_t end = pos + 1 + parameter.size();
+		if (resource.compare(pos + 1, parameter.size(), parameter) == 0 && (end == resource.size() || resource[end] == '&'))
+			return true;
+	}
+	return false;
+}
+
+static void flushIceCandidates(RTCWebScoketServer* s, websocketpp::connection_hdl hdl,
+                               std::shared_ptr<IceCandidateBatch> batch)
+{
+	Json::Value candidates(Json::arrayValue);
+	{
+		std::lock_guard<std::mutex> lock(batch->mutex);
+		batch->timerArmed = false;
+		if (batch->candidates.empty())
+			return;
+		candidates.swap(batch->candidates);
+	}
+
+	// the websocket may be closed since the candidates were gathered
+	websocketpp::lib::error_code ec;
+	RTCWebScoketServer::connection_ptr con = s->get_con_from_hdl(hdl, ec);
+	if (ec)
+		return;
+
+	RTC_LOG(INFO) << "send ice candidates... " << candidates.size();
+	std::vector<std::string> messages;
+	if (batch->batched)
+	{
+		messages.push_back(writeSignalingMessage(makeIceCandidatesMessage(candidates)));
+	}
+	else
+	{
+		// written one after the other, in one go
+		for (const Json::Value& candidate : candidates)
+		{
+			Json::Value single(Json::arrayValue);
+			single.append(candidate);
+			messages.push_back(writeSignalingMessage(makeIceCandidatesMessage(single)));
+		}
+	}
+	for (const std::string& message : messages)
+	{
+		ec = con->send(message, websocketpp::frame::opcode::text);
+		if (ec)
+		{
+			RTC_LOG(LS_ERROR) << "Echo failed because: " << ec
+				<< "(" << ec.message() << ")";
+			return;
+		}
+	}
+}
+
+// Local candidates are coalesced until the batch window expires or gathering completes.
+static void setIceCandidateBatching(RTCWebScoketServer* s, RTCWebScoketServer::connection_ptr con,
+                                    PeerConnectionManager::PeerConnectionObserver* peer_connection_observer)
+{
+	std::shared_ptr<IceCandidateBatch> batch = std::make_shared<IceCandidateBatch>(readsCandidateBatches(con));
+	websocketpp::connection_hdl hdl = con->get_handle();
+
+	peer_connection_observer->SetOnIceCandidate([s, hdl, batch](const webrtc::IceCandidateInterface* candidate)
+	{
+		std::string sdp;
+		candidate->ToString(&sdp);
+
+		Json::Value jcandidate;
+		jcandidate["sdpMid"] = candidate->sdp_mid();
+		jcandidate["sdpMLineIndex"] = candidate->sdp_mline_index();
+		jcandidate["candidate"] = sdp;
+
+		bool armTimer = false;
+		{
+			std::lock_guard<std::mutex> lock(batch->mutex);
+			batch->candidates.append(jcandidate);
+			if (!batch->timerArmed)
+				batch->timerArmed = armTimer = true;
+		}
+
+		if (armTimer)
+		{
+			s->set_timer(kIceCandidateBatchMs, [s, hdl, batch](const websocketpp::lib::error_code& ec)
+			{
+				if (!ec)
+					flushIceCandidates(s, hdl, batch);
+			});
+		}
+	});
+
+	peer_connection_observer->SetOnIceGatheringComplete([s, hdl, batch]()
+	{
+		flushIceCandidates(s, hdl, batch);
+	});
+}
+
+static bool addRemoteIceCandidate(PeerConnectionManager::PeerConnectionObserver* peer_connection_observer,
+                                  const Json::Value& jcandidate)
+{
+	webrtc::SdpParseError error;
+	std::unique_ptr<webrtc::IceCandidateInterface> candidate(
+		webrtc::CreateIceCandidate(
+			jcandidate["sdpMid"].asString(),
+			jcandidate["sdpMLineIndex"].asInt(),
+			jcandidate["candidate"].asString(),
+			&error)
+	);
+	if (!candidate.get())
+	{
+		RTC_LOG(LS_WARNING) << "Can't parse received candidate message. "
+			<< "SdpParseError was: " << error.description;
+		return false;
+	}
+	if (!peer_connection_observer || !peer_connection_observer->getPeerConnection()->AddIceCandidate(candidate.get()))
+	{
+		RTC_LOG(LS_WARNING) << "Failed to apply the received candidate";
+		return false;
+	}
+	return true;
+}
 
 std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> OnConnectHandler()
 {
 	auto func = [](RTCWebScoketServer* s, websocketpp::connection_hdl hdl)
 	{
 		RTCWebScoketServer::connection_ptr con = s->get_con_from_hdl(hdl);
+		const std::string method = con->get_request().get_method();
+
+		// GET dumps the latency histograms, DELETE starts a new measurement window
+		if (con->get_resource() == "/stats/latency")
+		{
+			if (method == "GET")
+			{
+				con->set_body(LatencyRegistry::instance().dump());
+				con->append_header("Content-Type", "application/json");
+				con->set_status(websocketpp::http::status_code::ok);
+			}
+			else if (method == "DELETE")
+			{
+				LatencyRegistry::instance().reset();
+				con->set_status(websocketpp::http::status_code::ok);
+			}
+			else
+			{
+				con->set_status(websocketpp::http::status_code::method_not_allowed);
+			}
+			return;
+		}
 
 		con->set_body("Hello World!");
 		con->set_status(websocketpp::http::status_code::ok);
@@ -56,33 +225,7 @@ std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> OnOpenSend
 		if (!s->peer_connection_manager()) return;
 		PeerConnectionManager::PeerConnectionObserver* peer_connection_observer = s->peer_connection_manager()->createClientOffer(peerId);
 
-		peer_connection_observer->SetOnIceCandidate([&, con](const webrtc::IceCandidateInterface* candidate)
-		{
-			std::string sdp;
-			candidate->ToString(&sdp);
-			RTC_LOG(INFO) << "send ice candidate... " << sdp;
-
-			Json::Value jmessage;
-			jmessage["candidate"]["sdpMid"] = candidate->sdp_mid();
-			jmessage["candidate"]["sdpMLineIndex"] = candidate->sdp_mline_index();
-			jmessage["candidate"]["candidate"] = sdp;
-
-			std::string writeJson = Json::StyledWriter().write(jmessage);
-
-			try
-			{
-				s->send(con, writeJson, websocketpp::frame::opcode::text);
-			}
-			catch (const websocketpp::lib::error_code& e)
-			{
-				RTC_LOG(LS_ERROR) << "Echo failed because: " << e
-					<< "(" << e.message() << ")";
-			}
-
-			RTC_LOG(INFO) << "send ice candidate end. ";
-		});
-
-		
+		setIceCandidateBatching(s, con, peer_connection_observer);
 	};
 
 
@@ -94,7 +237,7 @@ inline void ProcessMessage()
 {
 	auto thread = rtc::Thread::Current();
 	auto msg_cnt = thread->size();
-	RTC_LOG(INFO) << "process message. : last " << msg_cnt;
+	CLOG(kLogSignaling, LS_VERBOSE) << "process message. : last " << msg_cnt;
 
 	while (msg_cnt > 0)
 	{
@@ -123,34 +266,12 @@ std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> OnOpenRece
 				webrtc::VideoTrackVector tracks = stream->GetVideoTracks();
 				if (tracks.size() > 0)
 				{
-					peerConnectionObserver->setVideosink(new VideoRenderer(1, 1, tracks[0], stack));
+					peerConnectionObserver->setVideosink(new VideoRenderer(1, 1, tracks[0], stack, peerConnectionObserver->getPeerId()));
 				}
 			});
 
 
-		peer_connection_observer->SetOnIceCandidate([&, con](const webrtc::IceCandidateInterface* candidate)
-		{
-			std::string sdp;
-			candidate->ToString(&sdp);
-			RTC_LOG(INFO) << "send ice candidate... " << sdp;
-
-			Json::Value jmessage;
-			jmessage["candidate"]["sdpMid"] = candidate->sdp_mid();
-			jmessage["candidate"]["sdpMLineIndex"] = candidate->sdp_mline_index();
-			jmessage["candidate"]["candidate"] = sdp;
-			std::string writeJson = Json::StyledWriter().write(jmessage);
-			try
-			{
-				s->send(con, writeJson, websocketpp::frame::opcode::text);
-			}
-			catch (const websocketpp::lib::error_code& e)
-			{
-				RTC_LOG(LS_ERROR) << "Echo failed because: " << e
-					<< "(" << e.message() << ")";
-			}
-
-			RTC_LOG(INFO) << "send ice candidate end. ";
-		});
+		setIceCandidateBatching(s, con, peer_connection_observer);
 	};
 
 	return func;
@@ -162,7 +283,7 @@ std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl, message_ptr
 	auto func = [&](RTCWebScoketServer* s, websocketpp::connection_hdl hdl, message_ptr msg)
 	{
 		RTCWebScoketServer::connection_ptr con = s->get_con_from_hdl(hdl);
-		RTC_LOG(INFO) << "on_message called with hdl: " 
+		CLOG(kLogSignaling, LS_VERBOSE) << "on_message called with hdl: "
 			<< " and message: " << msg->get_payload();
 		std::string peerId = "VideoReceiver";
 		PeerConnectionManager::PeerConnectionObserver* peer_connection_observer = s
@@ -170,10 +291,7 @@ std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl, message_ptr
 		                                                                          getPeerConnectionObserver(peerId);
 
 		Json::Value request;
-		std::string errors;
-		std::string payload = msg->get_payload();
-		const char* str = payload.c_str();
-		Json::Reader().parse(str, request);
+		readSignalingMessage(msg->get_payload(), request);
 
 		// receive offer
 		if (request["type"] == "offer")
@@ -202,7 +320,7 @@ std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl, message_ptr
 				                                                        {
 					                                                        s->send(
 						                                                        con,
-						                                                        Json::StyledWriter().write(answer),
+						                                                        writeSignalingMessage(answer),
 						                                                        msg->get_opcode());
 				                                                        }
 				                                                        catch (const websocketpp::lib::error_code& e)
@@ -258,29 +376,16 @@ std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl, message_ptr
 			RTC_LOG(LS_ERROR) << "4 -------------------- receive client answer ---------------------";
 			throw std::runtime_error("Cannot receive Answer resquest from Client when server ask for video");
 		}
-		else if (request.isMember("candidate"))
+		else if (request.isMember("candidate") || request.isMember("candidates"))
 		{
 			RTC_LOG(INFO) << "on ice candidate.";
 
-			webrtc::SdpParseError error;
-			std::unique_ptr<webrtc::IceCandidateInterface> candidate(
-				webrtc::CreateIceCandidate(
-					request["candidate"]["sdpMid"].asString(),
-					request["candidate"]["sdpMLineIndex"].asInt(),
-					request["candidate"]["candidate"].asString(),
-					&error)
-			);
-			if (!candidate.get())
-			{
-				RTC_LOG(LS_WARNING) << "Can't parse received candidate message. "
-					<< "SdpParseError was: " << error.description;
-				return;
-			}
-			if (!peer_connection_observer->getPeerConnection()->AddIceCandidate(candidate.get()))
-			{
-				RTC_LOG(LS_WARNING) << "Failed to apply the received candidate";
-				return;
-			}
+			if (request.isMember("candidate"))
+				addRemoteIceCandidate(peer_connection_observer, request["candidate"]);
+
+			for (const Json::Value& candidate : request.get("candidates", Json::Value(Json::arrayValue)))
+				addRemoteIceCandidate(peer_connection_observer, candidate);
+
 			RTC_LOG(INFO) << "set ice  candidate end.";
 		}
 		else if (request.isMember("mode"))
@@ -298,7 +403,7 @@ std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl, message_ptr
 	auto func = [&, i_stack](RTCWebScoketServer* s, websocketpp::connection_hdl hdl, message_ptr msg)
 	{
 		RTCWebScoketServer::connection_ptr con = s->get_con_from_hdl(hdl);
-		RTC_LOG(INFO) << "on_message called with hdl: "
+		CLOG(kLogSignaling, LS_VERBOSE) << "on_message called with hdl: "
 			<< " and message: " << msg->get_payload();
 		std::string peerId = "VideoSender";
 		PeerConnectionManager::PeerConnectionObserver* peer_connection_observer = s
@@ -309,10 +414,7 @@ std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl, message_ptr
 		// receive as JSON.
 
 		Json::Value request;
-		std::string errors;
-		std::string payload = msg->get_payload();
-		const char* str = payload.c_str();
-		Json::Reader().parse(str, request);
+		readSignalingMessage(msg->get_payload(), request);
 
 		//// receive offer
 		if (request["type"] == "offer")
@@ -354,29 +456,16 @@ std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl, message_ptr
 			s->peer_connection_manager()->setAnswer(peerId, request);
 		
 		}
-		else if (request.isMember("candidate"))
+		else if (request.isMember("candidate") || request.isMember("candidates"))
 		{
 			RTC_LOG(INFO) << "on ice candidate.";
 
-			webrtc::SdpParseError error;
-			std::unique_ptr<webrtc::IceCandidateInterface> candidate(
-				webrtc::CreateIceCandidate(
-					request["candidate"]["sdpMid"].asString(),
-					request["candidate"]["sdpMLineIndex"].asInt(),
-					request["candidate"]["candidate"].asString(),
-					&error)
-			);
-			if (!candidate.get())
-			{
-				RTC_LOG(LS_WARNING) << "Can't parse received candidate message. "
-					<< "SdpParseError was: " << error.description;
-				return;
-			}
-			if (!peer_connection_observer->getPeerConnection()->AddIceCandidate(candidate.get()))
-			{
-				RTC_LOG(LS_WARNING) << "Failed to apply the received candidate";
-				return;
-			}
+			if (request.isMember("candidate"))
+				addRemoteIceCandidate(peer_connection_observer, request["candidate"]);
+
+			for (const Json::Value& candidate : request.get("candidates", Json::Value(Json::arrayValue)))
+				addRemoteIceCandidate(peer_connection_observer, candidate);
+
 			RTC_LOG(INFO) << "set ice  candidate end.";
 		}
 		else if (request.isMember("mode"))
@@ -407,8 +496,8 @@ std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl, message_ptr
 						                                          "3 -------------------- send server offer ---------------------";
 					                                          try
 					                                          {
-						                                          std::string offer_str = Json::StyledWriter().write(offer);
-						                                          RTC_LOG(LS_VERBOSE) << " sending offer..." << offer_str;
+						                                          std::string offer_str = writeSignalingMessage(offer);
+						                                          CLOG(kLogSignaling, LS_VERBOSE) << " sending offer..." << offer_str;
 						                                          s->send(con, offer_str,
 						                                                  websocketpp::frame::opcode::value::TEXT);
 					                                          }
@@ -431,3 +520,238 @@ std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl, message_ptr
 
 		return func;
 		}
+
+
+/* ---------------------------------------------------------------------------
+**  WHIP / WHEP : the offer and the answer are exchanged in one HTTP request,
+**  the answer is sent once ICE gathering is complete (no trickle), or with the
+**  candidates gathered so far after kHttpAnswerTimeoutMs.
+** -------------------------------------------------------------------------*/
+static const int kHttpAnswerTimeoutMs = 3000;
+
+// One answer per request, from the gathering callback or the timeout (asio thread).
+struct HttpAnswer
+{
+	HttpAnswer() : sent(false) {}
+
+	bool sent;
+	RTCWebScoketServer::timer_ptr timeout;
+};
+
+static void sendHttpAnswer(RTCWebScoketServer* s, websocketpp::connection_hdl hdl, const std::string& peerId,
+                           const std::string& location, std::shared_ptr<HttpAnswer> answer)
+{
+	if (answer->sent)
+		return;
+	answer->sent = true;
+	if (answer->timeout)
+		answer->timeout->cancel();
+
+	// the client may have given up
+	websocketpp::lib::error_code ec;
+	RTCWebScoketServer::connection_ptr con = s->get_con_from_hdl(hdl, ec);
+	if (ec)
+	{
+		s->peer_connection_manager()->hangUp(peerId);
+		return;
+	}
+
+	PeerConnectionManager::PeerConnectionObserver* peer_connection_observer = s->peer_connection_manager()->
+	                                                                          getPeerConnectionObserver(peerId);
+	rtc::scoped_refptr<webrtc::PeerConnectionInterface> peerConnection;
+	if (peer_connection_observer)
+		peerConnection = peer_connection_observer->getPeerConnection();
+
+	if (!peerConnection || !peerConnection->local_description())
+	{
+		RTC_LOG(LS_ERROR) << "Failed to create answer for " << peerId;
+		s->peer_connection_manager()->hangUp(peerId);
+		con->set_status(websocketpp::http::status_code::internal_server_error);
+	}
+	else
+	{
+		// candidates gathered so far are part of the local description
+		std::string sdp;
+		peerConnection->local_description()->ToString(&sdp);
+		con->set_status(websocketpp::http::status_code::created);
+		con->append_header("Content-Type", "application/sdp");
+		con->append_header("Location", location);
+		con->set_body(sdp);
+	}
+
+	ec = con->send_http_response();
+	if (ec)
+	{
+		RTC_LOG(LS_ERROR) << "Failed to send http answer because: " << ec.message();
+	}
+}
+
+// Sessions created by one WHIP/WHEP endpoint, the only ones its DELETE may hang up.
+struct HttpSessions
+{
+	std::mutex mutex;
+	std::set<std::string> peerIds;
+};
+
+// Returns true when the request was a WHIP/WHEP request on the given endpoint.
+static bool handleHttpSignaling(RTCWebScoketServer* s, websocketpp::connection_hdl hdl, const std::string& endpoint,
+                                std::shared_ptr<HttpSessions> sessions,
+                                std::function<void(const std::string&)> setupPeer)
+{
+	RTCWebScoketServer::connection_ptr con = s->get_con_from_hdl(hdl);
+	const std::string resource = con->get_resource();
+	const std::string method = con->get_request().get_method();
+
+	// the endpoint itself or a session of it, not "/whepfoo"
+	if (resource != endpoint && resource.compare(0, endpoint.size() + 1, endpoint + "/") != 0)
+		return false;
+
+	if (!s->peer_connection_manager())
+	{
+		con->set_status(websocketpp::http::status_code::service_unavailable);
+		return true;
+	}
+
+	if (method == "POST" && resource == endpoint)
+	{
+		if (con->get_request_header("Content-Type").find("application/sdp") == std::string::npos)
+		{
+			con->set_status(websocketpp::http::status_code::unsupported_media_type);
+			return true;
+		}
+
+		// not guessable: the id in the Location header is what allows a DELETE
+		std::string peerId = endpoint.substr(1) + "-" + rtc::CreateRandomUuid();
+		RTC_LOG(INFO) << "http offer for " << peerId;
+
+		{
+			std::lock_guard<std::mutex> lock(sessions->mutex);
+			// forget the sessions that ended without a DELETE
+			for (auto it = sessions->peerIds.begin(); it != sessions->peerIds.end();)
+			{
+				if (s->peer_connection_manager()->getPeerConnectionObserver(*it))
+					++it;
+				else
+					it = sessions->peerIds.erase(it);
+			}
+			sessions->peerIds.insert(peerId);
+		}
+
+		s->peer_connection_manager()->createClientOffer(peerId);
+		setupPeer(peerId);
+
+		Json::Value offer;
+		offer["type"] = "offer";
+		offer["sdp"] = con->get_request_body();
+
+		websocketpp::lib::error_code ec = con->defer_http_response();
+		if (ec)
+		{
+			RTC_LOG(LS_ERROR) << "Cannot defer http response because: " << ec.message();
+			s->peer_connection_manager()->hangUp(peerId);
+			con->set_status(websocketpp::http::status_code::internal_server_error);
+			return true;
+		}
+
+		// answered once gathering completes, on the signaling thread (the pump of this
+		// asio thread): the response is posted, not sent from within the pump
+		std::shared_ptr<HttpAnswer> answer = std::make_shared<HttpAnswer>();
+		std::string location = endpoint + "/" + peerId;
+		answer->timeout = s->set_timer(kHttpAnswerTimeoutMs, [s, hdl, peerId, location, answer](const websocketpp::lib::error_code& ec)
+		{
+			if (!ec)
+				sendHttpAnswer(s, hdl, peerId, location, answer);
+		});
+		PeerConnectionManager::PeerConnectionObserver* peer_connection_observer = s->peer_connection_manager()->
+		                                                                          getPeerConnectionObserver(peerId);
+		if (peer_connection_observer)
+		{
+			peer_connection_observer->SetOnIceGatheringComplete([s, hdl, peerId, location, answer]()
+			{
+				s->get_io_service().post([s, hdl, peerId, location, answer]()
+				{
+					sendHttpAnswer(s, hdl, peerId, location, answer);
+				});
+			});
+		}
+
+		s->peer_connection_manager()->createAnswerToClientOffer(peerId, offer, nullptr);
+		ProcessMessage();
+	}
+	else if (method == "DELETE" && resource.size() > endpoint.size() + 1)
+	{
+		std::string peerId = resource.substr(endpoint.size() + 1);
+		bool known;
+		{
+			std::lock_guard<std::mutex> lock(sessions->mutex);
+			known = sessions->peerIds.erase(peerId) != 0;
+		}
+		// websocket peers and the sessions of the other endpoint are not ours to hang up
+		if (!known || !s->peer_connection_manager()->getPeerConnectionObserver(peerId))
+		{
+			con->set_status(websocketpp::http::status_code::not_found);
+			return true;
+		}
+		s->peer_connection_manager()->hangUp(peerId);
+		con->set_status(websocketpp::http::status_code::ok);
+	}
+	else
+	{
+		con->set_status(websocketpp::http::status_code::method_not_allowed);
+	}
+	return true;
+}
+
+std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> OnHttpSenderHandler(std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> i_stack)
+{
+	std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> fallback = OnConnectHandler();
+
+	std::shared_ptr<HttpSessions> sessions = std::make_shared<HttpSessions>();
+
+	auto func = [i_stack, fallback, sessions](RTCWebScoketServer* s, websocketpp::connection_hdl hdl)
+	{
+		bool handled = handleHttpSignaling(s, hdl, "/whep", sessions, [s, i_stack](const std::string& peerId)
+		{
+			s->peer_connection_manager()->startOpenCVStreaming(peerId, i_stack);
+		});
+
+		if (!handled)
+			fallback(s, hdl);
+	};
+
+	return func;
+}
+
+std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> OnHttpReceiverHandler(std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> stack)
+{
+	std::function<void(RTCWebScoketServer*, websocketpp::connection_hdl)> fallback = OnConnectHandler();
+
+	std::shared_ptr<HttpSessions> sessions = std::make_shared<HttpSessions>();
+
+	auto func = [stack, fallback, sessions](RTCWebScoketServer* s, websocketpp::connection_hdl hdl)
+	{
+		bool handled = handleHttpSignaling(s, hdl, "/whip", sessions, [s, stack](const std::string& peerId)
+		{
+			PeerConnectionManager::PeerConnectionObserver* peer_connection_observer = s->peer_connection_manager()->
+			                                                                          getPeerConnectionObserver(peerId);
+			if (!peer_connection_observer)
+				return;
+
+			peer_connection_observer->setFuncOnAddStream(
+				[stack](PeerConnectionManager::PeerConnectionObserver* peerConnectionObserver,
+				        rtc::scoped_refptr<webrtc::MediaStreamInterface> stream)
+				{
+					webrtc::VideoTrackVector tracks = stream->GetVideoTracks();
+					if (tracks.size() > 0)
+					{
+						peerConnectionObserver->setVideosink(new VideoRenderer(1, 1, tracks[0], stack, peerConnectionObserver->getPeerId()));
+					}
+				});
+		});
+
+		if (!handled)
+			fallback(s, hdl);
+	};
+
+	return func;
+}
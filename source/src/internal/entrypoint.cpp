@@ -5,6 +5,7 @@
 #include "internal/customvideocapturer.h"
 #include "internal/CustomOpenCVCapturer.h"
 #include <rtc_base/ssladapter.h>
+#include "internal/AsyncLog.h"
 
 //
 //void SendVideo(rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> peer_connection_factory,
@@ -109,12 +110,14 @@ extern "C"
 	{
 		rtc::InitializeSSL();
 
-		rtc::LogMessage::LogToDebug(rtc::LS_VERBOSE);
+		// verbose logging was written synchronously from the media threads
+		AsyncLog::instance().start();
 
 	}
 
 	DELETEPOINT void unload()
 	{
+		AsyncLog::instance().stop();
 		rtc::CleanupSSL();
 	}
 
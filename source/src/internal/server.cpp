@@ -11,6 +11,9 @@ using websocketpp::lib::placeholders::_1;
 using websocketpp::lib::placeholders::_2;
 using websocketpp::lib::bind;
 
+// period of the rtc message dispatch on the signaling thread
+static const long kSignalingPumpMs = 20;
+
 
 
 std::string get_password() {
@@ -106,9 +109,12 @@ RTCWebScoketServer* RTCWebScoketServerInit(std::function<void(RTCWebScoketServer
   websocket_server->onOpenHandler(open_callback);
   websocket_server->onCloseHandler(cls_callback);
   websocket_server->set_tls_init_handler(bind(&on_tls_init,MOZILLA_MODERN, basename, ::_1));
+  websocket_server->startSignalingPump(kSignalingPumpMs);
   
-  //websocket_server->clear_access_channels(websocketpp::log::alevel::all); 
-  websocket_server->set_access_channels(websocketpp::log::alevel::all);
+  // alevel::all writes every frame header and payload synchronously
+  websocket_server->clear_access_channels(websocketpp::log::alevel::all); 
+  websocket_server->set_access_channels(websocketpp::log::alevel::connect | websocketpp::log::alevel::disconnect
+                                        | websocketpp::log::alevel::fail);
 //
   // DO NOT websocket_server.poll(); here!! becasu it is block.
 
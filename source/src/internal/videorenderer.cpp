@@ -2,11 +2,22 @@
 #include <third_party/libyuv/include/libyuv/convert_argb.h>
 #include <stack>
 #include "internal/videorenderer.h"
+#include "internal/FrameTrace.h"
+#include "internal/AsyncLog.h"
+
+// Without a Capture() / CaptureNext() for this long, decoded frames are not converted anymore.
+static const int64_t kConsumerIdleUs = 2000000;
 
 VideoRenderer::VideoRenderer(int w, int h,
     rtc::scoped_refptr<webrtc::VideoTrackInterface> track_to_render,
-	std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> i_stack)
-  : VideoSink(track_to_render), /*rendered_track(track_to_render),*/ width(w), height(h), stack(i_stack) {
+	std::shared_ptr<core::queue::ConcurrentQueue<cv::Mat>> i_stack, const std::string& peerid)
+  : VideoSink(track_to_render), /*rendered_track(track_to_render),*/ width(w), height(h), stack(i_stack)
+  , conversion(LatencyRegistry::instance().get("peer:" + (peerid.empty() ? track_to_render->id() : peerid), kLatencyRendererConversion))
+  , context(StreamContext::of(i_stack.get()))
+  , stats(context->stats)
+  , sequence(context->sequence)
+  , shared_ring(context->sharedRing)
+  , recorder(context->recorder) {
 
   /*rendered_track->AddOrUpdateSink(this, rtc::VideoSinkWants());*/
 
@@ -18,7 +29,7 @@ VideoRenderer::~VideoRenderer() {
 }
 
 void VideoRenderer::SetSize(int w, int h) {
-  RTC_LOG(LS_VERBOSE) << "VideoRenderer::SetSize(" << w << "," << h << ")";
+  CLOG(kLogMedia, LS_VERBOSE) << "VideoRenderer::SetSize(" << w << "," << h << ")";
 
   if (width == w && height == h) {
     return;
@@ -26,31 +37,68 @@ void VideoRenderer::SetSize(int w, int h) {
 
   width = w;
   height = h;
-
-  image.reset(new std::uint8_t[width * height * 4]);
 }
 
 void VideoRenderer::OnFrame(const webrtc::VideoFrame& video_frame) {
 
-  RTC_LOG(LS_VERBOSE) << "VideoRenderer::OnFrame()";
+  CLOG(kLogMedia, LS_VERBOSE) << "VideoRenderer::OnFrame()";
+
+  int64_t convertBegin = FrameTrace::enabled() ? FrameTrace::nowUs() : -1;
+  int64_t conversionBegin = LatencyHistogram::nowUs();
+  stats->onInput();
 
+  // nobody reads the queue nor waits for a sequence, the frame would be replaced unread
+  bool queueRead = conversionBegin - stack->lastPopTimeUs() <= kConsumerIdleUs;
+  bool sequenceRead = conversionBegin - sequence->lastWaitTimeUs() <= kConsumerIdleUs;
+  bool ringOpen = shared_ring->isOpen();
+  bool recording = recorder->active();
+  if (!queueRead && !sequenceRead && !ringOpen && !recording) {
+    stats->onDropped(1);
+    return;
+  }
   rtc::scoped_refptr<webrtc::I420BufferInterface> buffer(video_frame.video_frame_buffer()->ToI420());
 
+  // other processes read the ring: published whether this one reads or not
+  if (ringOpen) {
+    FrameTraceSpan span("SharedRing", video_frame.timestamp());
+    shared_ring->publish(buffer->DataY(), buffer->StrideY(), buffer->DataU(), buffer->StrideU(),
+                         buffer->DataV(), buffer->StrideV(), buffer->width(), buffer->height(), conversionBegin);
+  }
+  // copied to the recorder backlog, its thread does the disk I/O
+  std::shared_ptr<StreamRecorder> l_recorder = recording ? recorder->get() : nullptr;
+  if (l_recorder) {
+    l_recorder->writeI420(buffer->DataY(), buffer->StrideY(), buffer->DataU(), buffer->StrideU(),
+                          buffer->DataV(), buffer->StrideV(), buffer->width(), buffer->height());
+  }
+  if (!queueRead && !sequenceRead)
+    return;
+
   SetSize(buffer->width(), buffer->height());
 
+  // a new Mat per frame: consumers keep it without copy
+  cv::Mat img(height, width, CV_8UC4);
   libyuv::I420ToARGB(buffer->DataY(), buffer->StrideY(),
                      buffer->DataU(), buffer->StrideU(),
                      buffer->DataV(), buffer->StrideV(),
-                     image.get(),
-                     width * 4,
+                     img.data,
+                     static_cast<int>(img.step),
                      buffer->width(), buffer->height());
 
-  cv::Mat img = cv::Mat(cv::Size(width, height), CV_8UC4, image.get()).clone();
-  cv::Mat overFlow;
-  
-  stack->clear();
+  if (convertBegin >= 0)
+    FrameTrace::record("I420ToARGB", convertBegin, FrameTrace::nowUs(), video_frame.timestamp());
+  int64_t conversionUs = LatencyHistogram::nowUs() - conversionBegin;
+  conversion->record(conversionUs);
+  stats->onConversion(conversionUs);
+
+  FrameTraceSpan publish("Publish", video_frame.timestamp());
+  if (sequenceRead)
+    sequence->publish(img, conversionBegin, video_frame.timestamp(), kConsumerIdleUs);
+  if (!queueRead)
+    return;
 
-  stack->push(img);
+  // the queue policy counts the replaced, rejected and expired frames,
+  // a decoder blocked for room (FIFO_BLOCK) is released if Capture() stops
+  stack->push(img, [this]() { return LatencyHistogram::nowUs() - stack->lastPopTimeUs() > kConsumerIdleUs; });
 
   /*capturer.Render(image.get(), width, height);*/
 }
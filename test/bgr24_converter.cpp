@@ -0,0 +1,200 @@
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <third_party/libyuv/include/libyuv/convert.h>
+#include <internal/Bgr24Converter.h>
+
+// Every kernel the cpu supports against the scalar one (bit exact) and
+// against libyuv::RGB24ToI420 (libyuv rounds its SIMD averages differently,
+// hence the tolerance), I420 and NV12, over odd sizes that exercise the
+// scalar tails and over ROIs whose rows do not start on a pixel boundary of
+// the full frame. The destination padding must not be written.
+
+static const int kMaxDiffFromLibyuv = 2;
+static const uint8_t kUnwritten = 0xCD;
+
+struct Size
+{
+	int width;
+	int height;
+};
+
+// pixels of a ROI at (1, 1) in a larger frame when roi is set
+struct Source
+{
+	std::vector<uint8_t> pixels;
+	const uint8_t*       data;
+	int                  stride;
+};
+
+static Source MakeSource(std::mt19937& random, int width, int height, bool roi)
+{
+	Source source;
+	int columns = width + (roi ? 3 : 0);
+	int rows = height + (roi ? 2 : 0);
+	source.stride = columns * 3 + (roi ? 5 : 0);
+	source.pixels.resize(static_cast<size_t>(source.stride) * rows);
+	for (auto& value : source.pixels)
+		value = static_cast<uint8_t>(random());
+	source.data = source.pixels.data() + (roi ? source.stride + 3 : 0);
+	return source;
+}
+
+struct Planes
+{
+	int                  width;
+	int                  height;
+	int                  strideY;
+	int                  strideC; // U and V, or UV for NV12
+	std::vector<uint8_t> y;
+	std::vector<uint8_t> u;
+	std::vector<uint8_t> v;
+
+	Planes(int w, int h, bool nv12) : width(w), height(h)
+	{
+		int chromaWidth = (w + 1) / 2;
+		int chromaHeight = (h + 1) / 2;
+		// padded: a kernel writing past the row end is caught
+		strideY = w + 7;
+		strideC = (nv12 ? 2 * chromaWidth : chromaWidth) + 7;
+		y.assign(static_cast<size_t>(strideY) * h, kUnwritten);
+		u.assign(static_cast<size_t>(strideC) * chromaHeight, kUnwritten);
+		v.assign(nv12 ? 0 : static_cast<size_t>(strideC) * chromaHeight, kUnwritten);
+	}
+};
+
+static void Convert(const Source& source, Planes& planes, bool nv12)
+{
+	if (nv12)
+		Bgr24Converter::toNV12(source.data, source.stride, planes.y.data(), planes.strideY,
+		                       planes.u.data(), planes.strideC, planes.width, planes.height);
+	else
+		Bgr24Converter::toI420(source.data, source.stride, planes.y.data(), planes.strideY,
+		                       planes.u.data(), planes.strideC, planes.v.data(), planes.strideC,
+		                       planes.width, planes.height);
+}
+
+// largest difference over width x height samples, step bytes apart
+static int PlaneDiff(const uint8_t* actual, int actualStride, int actualStep,
+                     const uint8_t* expected, int expectedStride, int expectedStep, int width, int height)
+{
+	int diff = 0;
+	for (int row = 0; row < height; row++)
+	{
+		const uint8_t* a = actual + static_cast<size_t>(row) * actualStride;
+		const uint8_t* e = expected + static_cast<size_t>(row) * expectedStride;
+		for (int x = 0; x < width; x++)
+			diff = std::max(diff, std::abs(static_cast<int>(a[x * actualStep]) - static_cast<int>(e[x * expectedStep])));
+	}
+	return diff;
+}
+
+static bool PaddingWritten(const std::vector<uint8_t>& plane, int stride, int rowBytes)
+{
+	for (size_t offset = 0; offset < plane.size(); offset += stride)
+	{
+		for (int x = rowBytes; x < stride; x++)
+		{
+			if (plane[offset + x] != kUnwritten)
+				return true;
+		}
+	}
+	return false;
+}
+
+static bool PaddingWritten(const Planes& planes, bool nv12)
+{
+	int chromaBytes = (planes.width + 1) / 2 * (nv12 ? 2 : 1);
+	return PaddingWritten(planes.y, planes.strideY, planes.width)
+		|| PaddingWritten(planes.u, planes.strideC, chromaBytes)
+		|| (!nv12 && PaddingWritten(planes.v, planes.strideC, chromaBytes));
+}
+
+// U and V against planar u and v, or interleaved ones when step is 2
+static int ChromaDiff(const Planes& actual, bool nv12, const uint8_t* u, const uint8_t* v, int stride, int step)
+{
+	int width = (actual.width + 1) / 2;
+	int height = (actual.height + 1) / 2;
+	const uint8_t* actualU = actual.u.data();
+	const uint8_t* actualV = nv12 ? actualU + 1 : actual.v.data();
+	int actualStep = nv12 ? 2 : 1;
+	return std::max(PlaneDiff(actualU, actual.strideC, actualStep, u, stride, step, width, height),
+	                PlaneDiff(actualV, actual.strideC, actualStep, v, stride, step, width, height));
+}
+
+int main()
+{
+	const Size sizes[] = {
+		{ 1, 1 }, { 2, 2 }, { 3, 3 }, { 5, 7 }, { 15, 3 }, { 16, 16 }, { 17, 9 }, { 31, 33 }, { 32, 2 },
+		{ 33, 17 }, { 63, 5 }, { 64, 64 }, { 65, 3 }, { 127, 11 }, { 129, 7 }, { 101, 37 }, { 641, 361 }
+	};
+	const Bgr24Converter::Kernel kernels[] = {
+		Bgr24Converter::kSSE41, Bgr24Converter::kAVX2, Bgr24Converter::kAVX512, Bgr24Converter::kNEON
+	};
+
+	std::mt19937 random(2024);
+	int failures = 0;
+	int checks = 0;
+	for (const Size& size : sizes)
+	{
+		for (bool roi : { false, true })
+		{
+			Source source = MakeSource(random, size.width, size.height, roi);
+
+			int chromaWidth = (size.width + 1) / 2;
+			int chromaHeight = (size.height + 1) / 2;
+			std::vector<uint8_t> y(static_cast<size_t>(size.width) * size.height);
+			std::vector<uint8_t> u(static_cast<size_t>(chromaWidth) * chromaHeight);
+			std::vector<uint8_t> v(u.size());
+			// libyuv RGB24 is BGR in memory order
+			libyuv::RGB24ToI420(source.data, source.stride, y.data(), size.width, u.data(), chromaWidth,
+			                    v.data(), chromaWidth, size.width, size.height);
+
+			for (bool nv12 : { false, true })
+			{
+				Bgr24Converter::setKernel(Bgr24Converter::kScalar);
+				Planes scalar(size.width, size.height, nv12);
+				Convert(source, scalar, nv12);
+
+				for (int k = -1; k < static_cast<int>(sizeof(kernels) / sizeof(kernels[0])); k++)
+				{
+					Bgr24Converter::Kernel kernel = k < 0 ? Bgr24Converter::kScalar : kernels[k];
+					if (!Bgr24Converter::setKernel(kernel))
+						continue;
+
+					Planes planes(size.width, size.height, nv12);
+					Convert(source, planes, nv12);
+
+					int fromScalarY = PlaneDiff(planes.y.data(), planes.strideY, 1, scalar.y.data(), scalar.strideY, 1,
+					                            size.width, size.height);
+					int fromScalarC = nv12
+						? ChromaDiff(planes, true, scalar.u.data(), scalar.u.data() + 1, scalar.strideC, 2)
+						: ChromaDiff(planes, false, scalar.u.data(), scalar.v.data(), scalar.strideC, 1);
+					int fromLibyuvY = PlaneDiff(planes.y.data(), planes.strideY, 1, y.data(), size.width, 1,
+					                            size.width, size.height);
+					int fromLibyuvC = ChromaDiff(planes, nv12, u.data(), v.data(), chromaWidth, 1);
+
+					bool padding = PaddingWritten(planes, nv12);
+
+					checks++;
+					if (fromScalarY != 0 || fromScalarC != 0 || fromLibyuvY > kMaxDiffFromLibyuv
+						|| fromLibyuvC > kMaxDiffFromLibyuv || padding)
+					{
+						failures++;
+						printf("FAIL %s %s %dx%d%s: scalar diff Y %d C %d, libyuv diff Y %d C %d%s\n",
+						       Bgr24Converter::kernelName(kernel), nv12 ? "nv12" : "i420", size.width, size.height,
+						       roi ? " roi" : "", fromScalarY, fromScalarC, fromLibyuvY, fromLibyuvC,
+						       padding ? ", wrote past the row end" : "");
+					}
+				}
+			}
+		}
+	}
+	Bgr24Converter::resetKernel();
+
+	printf("%d conversions checked, %d failed\n", checks, failures);
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}